@@ -16,6 +16,8 @@ std::ostream &operator<<(std::ostream &out, AnyVar const &value) {
     out << value.Cast<int>();
   } else if (type == TypeInfoOf<float>()) {
     out << value.Cast<float>();
+  } else if (type == TypeInfoOf<bool>()) {
+    out << (value.Cast<bool>() ? "true" : "false");
   } else if (type == TypeInfoOf<long>()) {
     out << value.Cast<long>();
   } else if (type == TypeInfoOf<std::string>()) {
@@ -17,7 +17,8 @@ TestBaseObject::TestBaseObject()
       float_value_(23.23),
       ptr_value_(&g_Global),
       cptr_value_(&g_Global),
-      const_int_value_(23) {
+      const_int_value_(23),
+      bool_value_(true) {
 }
 
 TestBaseObject::~TestBaseObject() {
@@ -76,6 +77,14 @@ void TestBaseObject::set_float2(Float2 float2) {
   float2_ = float2;
 }
 
+bool TestBaseObject::bool_value() const {
+  return bool_value_;
+}
+
+void TestBaseObject::set_bool_value(bool bool_value) {
+  bool_value_ = bool_value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 TestObject::TestObject() : int_ptr_(nullptr), more_flags_(kSpecial_Flag) {}
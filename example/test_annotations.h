@@ -90,6 +90,9 @@ public:
   Float2 float2() const;
   void set_float2(Float2 float2);
 
+  bool bool_value() const;
+  void set_bool_value(bool bool_value);
+
 private:
   friend class TestBaseObjectClass;
 
@@ -137,6 +140,10 @@ private:
   rfl_property(id = "float2", kind = "generic", name = "Float2",
                default = "1, 2")
   Float2 float2_;
+
+  rfl_property(id = "bool_value", kind = "generic", name = "Bool Value",
+               default = true)
+  bool bool_value_;
 };
 
 class EXAMPLE_EXPORT rfl_class() TestObject : public TestBaseObject {
@@ -5,14 +5,48 @@
 import os
 import errno
 import rfl
+import rfl.proto
 import platform
 from jinja2 import Environment, ChoiceLoader, PackageLoader
 
 
+def AnnotationEntryValue(entry):
+    Entry = rfl.proto.Annotation.Entry
+    if entry.type == Entry.INT:
+        return entry.int_value
+    elif entry.type == Entry.FLOAT:
+        return entry.float_value
+    elif entry.type == Entry.BOOL:
+        return entry.bool_value
+    return entry.value
+
+
+def AnnotationEntryLiteral(entry):
+    # text of the value as written, to be pasted to generated code
+    if entry.HasField('value'):
+        return entry.value
+    # packages scanned before the text was kept with typed values
+    Entry = rfl.proto.Annotation.Entry
+    if entry.type == Entry.INT:
+        return str(entry.int_value)
+    elif entry.type == Entry.FLOAT:
+        return repr(entry.float_value)
+    elif entry.type == Entry.BOOL:
+        return 'true' if entry.bool_value else 'false'
+    return entry.value
+
+
 def AnnotationToDict(anno):
     ret = {}
     for entry in anno.entries:
-        ret[entry.key] = entry.value
+        ret[entry.key] = AnnotationEntryValue(entry)
+    return ret
+
+
+def AnnotationToLiteralDict(anno):
+    ret = {}
+    for entry in anno.entries:
+        ret[entry.key] = AnnotationEntryLiteral(entry)
     return ret
 
 
@@ -38,7 +72,8 @@ class Method(object):
         super(Method, self).__init__()
         self.proto = proto
         self.parent = parent
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
 
 
 class Field(object):
@@ -46,7 +81,8 @@ class Field(object):
         super(Field, self).__init__()
         self.proto = proto
         self.parent = parent
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
 
 
 class Enum(object):
@@ -54,7 +90,8 @@ class Enum(object):
         super(Enum, self).__init__()
         self.proto = proto
         self.parent = parent
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
         pkg_file_klass = rfl.generator.context.factory.PackageFile()
 
         self.full_name = self.proto.name
@@ -87,7 +124,8 @@ class Typedef(object):
         super(Typedef, self).__init__()
         self.proto = proto
         self.parent = parent
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
         pkg_file_klass = rfl.generator.context.factory.PackageFile()
 
         self.full_name = self.proto.name
@@ -158,7 +196,8 @@ class Class(TypeContainer):
         super(Class, self).__init__(proto, parent)
 
         self.kind = proto.annotation.kind
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
 
         # Build namespace list
         if isinstance(parent, Class):
@@ -191,7 +230,8 @@ class Function(object):
         super(Function, self).__init__()
         self.proto = proto
         self.parent = parent
-        self.annotation = AnnotationToDict(proto.annotation)
+        self.annotation = AnnotationToLiteralDict(proto.annotation)
+        self.annotation_values = AnnotationToDict(proto.annotation)
 
         pkg_file_klass = rfl.generator.context.factory.PackageFile()
         p = parent
@@ -0,0 +1,167 @@
+# Copyright (c) 2015 Pavel Novy. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+import struct
+import zlib
+
+import rfl.proto
+
+MAGIC = b'RFL'
+INDEX_MAGIC = b'RFLI'
+V1_FORMAT = 1
+V2_FORMAT = 2
+V3_FORMAT = 3
+COMPRESSED_FLAG = 0x80
+FOOTER_SIZE = 16
+
+
+class PackageFormatError(Exception):
+    pass
+
+
+def _DecodeVarint(data, pos):
+    result = 0
+    shift = 0
+    while True:
+        if pos >= len(data) or shift > 63:
+            raise PackageFormatError('truncated record length')
+        b = ord(data[pos:pos + 1])
+        result |= (b & 0x7f) << shift
+        pos += 1
+        if not b & 0x80:
+            return result, pos
+        shift += 7
+
+
+def _ReadFooter(data):
+    """Returns offset and size of version 3 index."""
+    if len(data) < 4 + FOOTER_SIZE:
+        raise PackageFormatError('missing index')
+    offset, size, magic = struct.unpack('<QI4s', data[-FOOTER_SIZE:])
+    if magic != INDEX_MAGIC or offset < 4 or \
+            offset + size != len(data) - FOOTER_SIZE:
+        raise PackageFormatError('malformed index')
+    return offset, size
+
+
+def ReadRecords(data):
+    """Yields serialized proto.Package records of .rfl file contents.
+
+    Version 1 file is a single record, version 2 file is a sequence of
+    length prefixed records, first of them holds package header. Version 3
+    is version 2 followed by an index. Compressed files are decompressed.
+    """
+    if data[:3] != MAGIC or len(data) < 4:
+        raise PackageFormatError('not a rfl package')
+    version = ord(data[3:4])
+    if version & COMPRESSED_FLAG:
+        version &= ~COMPRESSED_FLAG
+        try:
+            data = data[:4] + zlib.decompress(data[4:], 16 + zlib.MAX_WBITS)
+        except zlib.error as e:
+            raise PackageFormatError('malformed compressed data: %s' % e)
+    if version == V1_FORMAT:
+        yield data[4:]
+        return
+    end = len(data)
+    if version == V3_FORMAT:
+        end = _ReadFooter(data)[0]
+    elif version != V2_FORMAT:
+        raise PackageFormatError('unsupported version %d' % version)
+    pos = 4
+    while pos < end:
+        size, pos = _DecodeVarint(data, pos)
+        if pos + size > end:
+            raise PackageFormatError('truncated record')
+        yield data[pos:pos + size]
+        pos += size
+
+
+def ReadPackage(path):
+    pkg = rfl.proto.Package()
+    with open(path, 'rb') as f:
+        for record in ReadRecords(f.read()):
+            pkg.MergeFromString(record)
+    return pkg
+
+
+def ReadIndex(data):
+    """Returns proto.PackageIndex of version 3 .rfl file contents, None for
+    older versions.
+    """
+    if data[:3] != MAGIC or len(data) < 4:
+        raise PackageFormatError('not a rfl package')
+    if ord(data[3:4]) != V3_FORMAT:
+        return None
+    offset, size = _ReadFooter(data)
+    return rfl.proto.PackageIndex.FromString(data[offset:offset + size])
+
+
+def ReadPackageFile(data, entry):
+    """Returns proto.PackageFile of index |entry| of .rfl file contents."""
+    return rfl.proto.PackageFile.FromString(
+        data[entry.offset:entry.offset + entry.size])
+
+
+def MergePackage(pkg, src):
+    """Merges package |src| into |pkg|.
+
+    Type indices of |src| package files are shifted past types of |pkg|,
+    |src| is modified for that.
+    """
+    base = len(pkg.types)
+    if base:
+        for package_file in src.package_files:
+            package_file.type_base += base
+    pkg.MergeFrom(src)
+
+
+def _ResolveItem(pkg, package_file, item):
+    if not item.HasField('type_index'):
+        return
+    index = package_file.type_base + item.type_index
+    if index < len(pkg.types):
+        item.type_ref.CopyFrom(pkg.types[index])
+    item.ClearField('type_index')
+
+
+def _ResolveCallable(pkg, package_file, callable):
+    if callable.HasField('return_value'):
+        _ResolveItem(pkg, package_file, callable.return_value)
+    for arg in callable.arguments:
+        _ResolveItem(pkg, package_file, arg)
+
+
+def _ResolveClass(pkg, package_file, klass):
+    for field in klass.fields:
+        _ResolveItem(pkg, package_file, field)
+    for method in klass.methods:
+        _ResolveCallable(pkg, package_file, method)
+    for typedef in klass.typedefs:
+        _ResolveItem(pkg, package_file, typedef)
+    for nested in klass.classes:
+        _ResolveClass(pkg, package_file, nested)
+
+
+def _ResolveNamespace(pkg, package_file, ns):
+    for klass in ns.classes:
+        _ResolveClass(pkg, package_file, klass)
+    for function in ns.functions:
+        _ResolveCallable(pkg, package_file, function)
+    for typedef in ns.typedefs:
+        _ResolveItem(pkg, package_file, typedef)
+    for nested in ns.namespaces:
+        _ResolveNamespace(pkg, package_file, nested)
+
+
+def ResolveTypes(pkg):
+    """Moves package type table back to type_ref of fields, arguments and
+    typedefs, as generators expect them there.
+    """
+    if not len(pkg.types):
+        return
+    for package_file in pkg.package_files:
+        _ResolveNamespace(pkg, package_file, package_file)
+        package_file.ClearField('type_base')
+    pkg.ClearField('types')
@@ -0,0 +1,66 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Merges .rfl files of a package scanned separately into a single .rfl,
+// without decoding package files.
+//
+//   rfl-merge [-v] -o <output> <input.rfl...>
+
+#include "rfl/package_merge.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static void PrintUsage(char const *argv0) {
+  fprintf(stderr, "usage: %s [-v] -o <output> <input.rfl...>\n", argv0);
+}
+
+int main(int argc, char **argv) {
+  std::string output;
+  std::vector<std::string> inputs;
+  bool verbose = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (argv[i][0] == '-') {
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (output.empty() || inputs.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  rfl::PackageMerger merger;
+  std::string error;
+  for (std::string const &input : inputs) {
+    if (!merger.AddFile(input, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  if (!merger.Write(output)) {
+    fprintf(stderr, "Failed to write file %s : %s\n", output.c_str(),
+            strerror(errno));
+    unlink(output.c_str());
+    return 1;
+  }
+  if (verbose) {
+    printf("Merged %zu inputs of %s into %s, %zu package files, "
+           "%u duplicates\n",
+           inputs.size(), merger.name().c_str(), output.c_str(),
+           merger.package_files(), merger.duplicates());
+  }
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Writes synthetic package split into per source .rfl files to |dir|, then
+// merges them at the wire level and by decoding, merging and serializing
+// whole packages as rfl-gen -m does. merge_benchmark.py times the Python
+// path over the same files.
+//
+//   merge_benchmark <dir> [files] [classes per file] [iterations]
+
+#include "rfl/package_io.h"
+#include "rfl/package_merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace rfl;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+unsigned const kFieldsPerClass = 10;
+
+void BuildPackage(unsigned index, unsigned classes, proto::Package *pkg) {
+  pkg->set_name("bench");
+  pkg->set_version("1.0");
+  pkg->add_imports("base");
+  proto::PackageFile *file = pkg->add_package_files();
+  file->set_name("bench/file" + std::to_string(index) + ".h");
+  proto::Namespace *ns = file->add_namespaces();
+  ns->set_name("bench");
+  for (unsigned i = 0; i < classes; ++i) {
+    std::string name =
+        "Class" + std::to_string(index) + "_" + std::to_string(i);
+    proto::Class *klass = ns->add_classes();
+    klass->set_name(name);
+    klass->set_order(i);
+    pkg->add_provided_classes("bench::" + name);
+    for (unsigned j = 0; j < kFieldsPerClass; ++j) {
+      proto::Field *field = klass->add_fields();
+      field->set_name("field" + std::to_string(j) + "_");
+      field->set_offset(j * 4);
+      field->mutable_type_ref()->set_kind(proto::TypeRef::SYSTEM);
+      field->mutable_type_ref()->set_type_name("float");
+      field->mutable_type_ref()->set_source_file(file->name());
+      proto::Annotation::Entry *entry =
+          field->mutable_annotation()->add_entries();
+      entry->set_key("name");
+      entry->set_value("Field " + std::to_string(j));
+    }
+  }
+}
+
+bool WriteRfl(proto::Package const &pkg, std::string const &path) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  std::string data("RFL\x01");
+  pkg.AppendToString(&data);
+  bool ret = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ret;
+}
+
+bool DecodeMerge(std::vector<std::string> const &inputs,
+                 std::string const &output) {
+  proto::Package pkg;
+  for (std::string const &input : inputs) {
+    proto::Package file;
+    if (!ReadPackage(input, &file))
+      return false;
+    pkg.MergeFrom(file);
+  }
+  return WriteRfl(pkg, output);
+}
+
+bool WireMerge(std::vector<std::string> const &inputs,
+               std::string const &output) {
+  PackageMerger merger;
+  std::string error;
+  for (std::string const &input : inputs) {
+    if (!merger.AddFile(input, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+  }
+  return merger.Write(output);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: %s <dir> [files] [classes per file] [iterations]\n",
+            argv[0]);
+    return 1;
+  }
+  std::string dir = argv[1];
+  unsigned files = argc > 2 ? atoi(argv[2]) : 200;
+  unsigned classes = argc > 3 ? atoi(argv[3]) : 20;
+  unsigned iterations = argc > 4 ? atoi(argv[4]) : 5;
+  if (files == 0 || iterations == 0) {
+    fprintf(stderr, "Expected non zero files and iterations\n");
+    return 1;
+  }
+
+  std::vector<std::string> inputs;
+  for (unsigned i = 0; i < files; ++i) {
+    proto::Package pkg;
+    BuildPackage(i, classes, &pkg);
+    inputs.push_back(dir + "/file" + std::to_string(i) + ".rfl");
+    if (!WriteRfl(pkg, inputs.back())) {
+      fprintf(stderr, "Failed to write file %s\n", inputs.back().c_str());
+      return 1;
+    }
+  }
+
+  std::string output = dir + "/merged.rfl";
+  std::chrono::duration<double, std::milli> decode(0), wire(0);
+  for (unsigned i = 0; i < iterations; ++i) {
+    Clock::time_point start = Clock::now();
+    if (!DecodeMerge(inputs, output))
+      return 1;
+    Clock::time_point decoded = Clock::now();
+    if (!WireMerge(inputs, output))
+      return 1;
+    decode += decoded - start;
+    wire += Clock::now() - decoded;
+  }
+
+  printf("%u files of %u classes, %u iterations\n", files, classes,
+         iterations);
+  printf("  decode and merge: %8.3f ms\n", decode.count() / iterations);
+  printf("  wire merge:       %8.3f ms\n", wire.count() / iterations);
+  return 0;
+}
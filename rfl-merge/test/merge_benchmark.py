@@ -0,0 +1,48 @@
+#!/usr/bin/env python
+# Copyright (c) 2015 Pavel Novy. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+# Times merging of .rfl files written by merge_benchmark the way rfl-gen -m
+# does it.
+#
+#   merge_benchmark.py <rfl-gen lib dir> <dir> [iterations]
+
+import glob
+import os
+import sys
+import time
+
+
+def Main():
+    if len(sys.argv) < 3:
+        print 'usage: ', sys.argv[0], '<rfl-gen lib dir> <dir> [iterations]'
+        return 1
+    sys.path.insert(0, sys.argv[1])
+    import rfl.proto
+    import rfl.package_io
+
+    inputs = sorted(glob.glob(os.path.join(sys.argv[2], 'file*.rfl')))
+    iterations = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+    output = os.path.join(sys.argv[2], 'merged_py.rfl')
+
+    start = time.time()
+    for i in range(iterations):
+        pkg = rfl.proto.Package()
+        for proto in inputs:
+            rfl.package_io.MergePackage(pkg,
+                                             rfl.package_io.ReadPackage(proto))
+        out_rfl = open(output, 'wb')
+        out_rfl.write(b'RFL')
+        out_rfl.write(b'\x01')
+        out_rfl.write(pkg.SerializeToString())
+        out_rfl.close()
+    elapsed = (time.time() - start) * 1000.0 / iterations
+
+    print '%d files, %d iterations' % (len(inputs), iterations)
+    print '  rfl-gen -m:       %8.3f ms' % elapsed
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(Main())
@@ -0,0 +1,95 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/annotation_cache.h"
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+struct AnnoInserter {
+  AnnoInserter(ParsedAnnotation *anno) : anno_(anno) {}
+
+  // Values keep their text as written, numbers and booleans are also stored
+  // in typed slots. Malformed numbers are kept as strings.
+  void operator()(StringRef key,
+                  StringRef value,
+                  AnnotationParser::ValueType type) const {
+    ParsedAnnotation::Entry parsed_entry;
+    parsed_entry.key = key;
+    parsed_entry.value = value;
+    parsed_entry.type = type;
+    anno_->entries.push_back(parsed_entry);
+
+    proto::Annotation_Entry *entry = anno_->proto.add_entries();
+    entry->set_key(key.data(), key.size());
+    entry->set_value(value.data(), value.size());
+    switch (type) {
+      case AnnotationParser::kInt_Value: {
+        int64_t int_value;
+        if (AnnotationParser::ToInt(value, &int_value)) {
+          entry->set_type(proto::Annotation_Entry_Type_INT);
+          entry->set_int_value(int_value);
+        }
+        break;
+      }
+      case AnnotationParser::kFloat_Value: {
+        double float_value;
+        if (AnnotationParser::ToFloat(value, &float_value)) {
+          entry->set_type(proto::Annotation_Entry_Type_FLOAT);
+          entry->set_float_value(float_value);
+        }
+        break;
+      }
+      case AnnotationParser::kBool_Value:
+        entry->set_type(proto::Annotation_Entry_Type_BOOL);
+        entry->set_bool_value(value == "true");
+        break;
+      case AnnotationParser::kSymbol_Value:
+        entry->set_type(proto::Annotation_Entry_Type_SYMBOL);
+        break;
+      case AnnotationParser::kString_Value:
+        break;
+    }
+  }
+
+  ParsedAnnotation *anno_;
+};
+
+}  // namespace
+
+std::shared_ptr<ParsedAnnotation const> AnnotationCache::Lookup(
+    StringRef text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  StringMap<std::shared_ptr<ParsedAnnotation const>>::const_iterator it =
+      annotations_.find(text);
+  if (it == annotations_.end())
+    return nullptr;
+  hits_++;
+  return it->second;
+}
+
+std::shared_ptr<ParsedAnnotation const> AnnotationCache::Insert(
+    StringRef text,
+    AnnotationParser const &parser,
+    bool valid) {
+  std::shared_ptr<ParsedAnnotation> anno = std::make_shared<ParsedAnnotation>();
+  anno->valid = valid;
+  if (valid) {
+    anno->kind = parser.kind();
+    anno->proto.set_kind(anno->kind);
+    parser.Enumerate(AnnoInserter(anno.get()));
+  }
+
+  misses_++;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<ParsedAnnotation const> &cached = annotations_[text];
+  if (!cached)
+    cached = anno;
+  return cached;
+}
+
+} // namespace scan
+} // namespace rfl
@@ -0,0 +1,67 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_ANNOTATION_CACHE_H__
+#define __RFL_SCAN_ANNOTATION_CACHE_H__
+
+#include "rfl/reflected.pb.h"
+#include "rfl-scan/annotation_parser.h"
+
+#include "llvm/ADT/StringMap.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+// Immutable result of parsing one annotation text, shared by all
+// declarations annotated with the same text.
+struct ParsedAnnotation {
+  struct Entry {
+    std::string key;
+    std::string value;
+    AnnotationParser::ValueType type;
+  };
+
+  bool valid;
+  std::string kind;
+  std::vector<Entry> entries;
+  // Annotation as stored in packages, numbers converted already
+  proto::Annotation proto;
+};
+
+// Parse results keyed by raw annotation text, shared between translation
+// units. Texts are parsed by callers, outside of the lock.
+class AnnotationCache {
+public:
+  AnnotationCache() : hits_(0), misses_(0) {}
+
+  // Returns cached result for |text| or null.
+  std::shared_ptr<ParsedAnnotation const> Lookup(StringRef text);
+
+  // Stores result of |parser| that has just parsed |text|, |valid| tells
+  // whether Parse() succeeded. Returns the cached result, which may come
+  // from other thread inserting the same text first.
+  std::shared_ptr<ParsedAnnotation const> Insert(StringRef text,
+                                                 AnnotationParser const &parser,
+                                                 bool valid);
+
+  unsigned hits() const { return hits_; }
+  unsigned misses() const { return misses_; }
+
+private:
+  std::mutex mutex_;
+  StringMap<std::shared_ptr<ParsedAnnotation const>> annotations_;
+  std::atomic<unsigned> hits_;
+  std::atomic<unsigned> misses_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_ANNOTATION_CACHE_H__ */
@@ -3,82 +3,23 @@
 // found in the LICENSE file.
 
 #include "rfl-scan/annotation_parser.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
 #include <system_error>
 
 namespace rfl {
 namespace scan {
 
-namespace {
-
-std::string unescape(const std::string &s) {
-  std::string res;
-  std::string::const_iterator it = s.begin();
-  while (it != s.end()) {
-    char c = *it++;
-    if (c == '\\' && it != s.end()) {
-      switch (*it++) {
-        case '\\':
-          c = '\\';
-          break;
-        case 'n':
-          c = '\n';
-          break;
-        case 't':
-          c = '\t';
-          break;
-        case '"':
-          c = '"';
-          break;
-        // all other escapes
-        default:
-          // invalid escape sequence - skip it. alternatively you can copy it as
-          // is, throw an exception...
-          continue;
-      }
-    }
-    res += c;
-  }
-
-  return res;
-}
-
-}  // namespace
-
-std::unique_ptr<AnnotationParser> AnnotationParser::loadFromFile(
-    StringRef file_path,
-    std::string &error_msg) {
-  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
-      MemoryBuffer::getFile(file_path);
-  if (std::error_code Result = buffer.getError()) {
-    error_msg = "Error while opening JSON annotation: " + Result.message();
-    return nullptr;
-  }
-  std::unique_ptr<AnnotationParser> anno(
-      new AnnotationParser(std::move(*buffer)));
-  if (!anno->Parse(error_msg))
-    return nullptr;
-  return anno;
-}
-
-std::unique_ptr<AnnotationParser> AnnotationParser::loadFromBuffer(
-    StringRef annotation_string,
-    std::string &error_msg) {
-  std::unique_ptr<MemoryBuffer> buffer(
-      MemoryBuffer::getMemBuffer(annotation_string));
-  std::unique_ptr<AnnotationParser> anno(
-      new AnnotationParser(std::move(buffer)));
-  if (!anno->Parse(error_msg))
-    return nullptr;
-  return anno;
+AnnotationParser::AnnotationParser(BumpPtrAllocator &allocator)
+    : allocator_(allocator) {
 }
 
-AnnotationParser::AnnotationParser(std::unique_ptr<MemoryBuffer> buffer)
-    : buffer_(std::move(buffer)) {
-}
-
-bool AnnotationParser::Parse(std::string &err_msg) {
-  if (!Tokenize() || tokens_.size() < 4) {
+bool AnnotationParser::Parse(StringRef annotation_string) {
+  entries_.clear();
+  kind_ = StringRef();
+  if (!Tokenize(annotation_string) || tokens_.size() < 4) {
     return false;
   }
   if (tokens_[0].kind_ != kSymbol_Token ||
@@ -88,32 +29,141 @@ bool AnnotationParser::Parse(std::string &err_msg) {
     return false;
   }
 
-  kind_ = tokens_[0].range_.str();
   size_t i = 3;
   StringRef key;
+  bool assigned = false;
+  bool has_value = false;
   while (i < tokens_.size() -1) {
     Token const &t = tokens_[i];
-    if (t.kind_ == kSymbol_Token) {
-      key = t.range_;
-    } else if (t.kind_ != kAssign_Token && t.kind_ != kComma_Token) {
-      //outs() << key << ": " << t.range_ << " " << t.kind_ << "\n";
-      if (t.kind_ == kString_Token) {
-        value_map_[key] = unescape(t.range_.str());
-      } else {
-        value_map_[key] = t.range_.str();
+    // values have to be separated by comma
+    if (assigned && t.kind_ != kAssign_Token && t.kind_ != kComma_Token) {
+      if (has_value) {
+        errs() << "Expected comma after value of '" << key << "'\n";
+        entries_.clear();
+        return false;
       }
+      has_value = true;
+    }
+    switch (t.kind_) {
+      case kAssign_Token:
+        assigned = true;
+        break;
+      case kComma_Token:
+        assigned = false;
+        has_value = false;
+        break;
+      case kSymbol_Token:
+        if (!assigned) {
+          key = t.range_;
+        } else if (t.range_ == "true" || t.range_ == "false") {
+          SetValue(key, t.range_, kBool_Value);
+        } else {
+          SetValue(key, t.range_, kSymbol_Value);
+        }
+        break;
+      case kString_Token:
+        SetValue(key, Unescape(t.range_), kString_Value);
+        break;
+      case kInt_Token:
+      case kHexInt_Token:
+        SetValue(key, t.range_, kInt_Value);
+        break;
+      case kFloat_Token:
+        SetValue(key, t.range_, kFloat_Value);
+        break;
+      default:
+        break;
     }
     i++;
   }
+  kind_ = tokens_[0].range_;
+  return true;
+}
+
+bool AnnotationParser::ToInt(StringRef value, int64_t *result) {
+  long long int_value;
+  if (value.getAsInteger(0, int_value))
+    return false;
+  *result = int_value;
   return true;
 }
 
-StringRef AnnotationParser::GetValue(StringRef key) {
-  StringMap<std::string>::const_iterator it = value_map_.find(key);
-  if (it == value_map_.end())
-    return StringRef();
-  std::string const &value = it->getValue();
-  return StringRef(value);
+bool AnnotationParser::ToFloat(StringRef value, double *result) {
+  value = value.rtrim("fFlL");
+  if (value.empty())
+    return false;
+  SmallString<32> str(value);
+  char *end = nullptr;
+  *result = strtod(str.c_str(), &end);
+  return end == str.c_str() + str.size();
+}
+
+StringRef AnnotationParser::GetValue(StringRef key) const {
+  for (Entry const &entry : entries_) {
+    if (entry.key == key)
+      return entry.value;
+  }
+  return StringRef();
+}
+
+// Later value of a repeated key replaces the earlier one.
+void AnnotationParser::SetValue(StringRef key,
+                                StringRef value,
+                                ValueType type) {
+  for (Entry &entry : entries_) {
+    if (entry.key == key) {
+      entry.value = value;
+      entry.type = type;
+      return;
+    }
+  }
+  Entry entry;
+  entry.key = key;
+  entry.value = value;
+  entry.type = type;
+  entries_.push_back(entry);
+}
+
+// Returns |str| with escape sequences replaced, copies into allocator only
+// when there is any.
+StringRef AnnotationParser::Unescape(StringRef str) {
+  if (str.find('\\') == StringRef::npos)
+    return str;
+
+  char *res = allocator_.Allocate<char>(str.size());
+  size_t size = 0;
+  StringRef::iterator it = str.begin();
+  while (it != str.end()) {
+    char c = *it++;
+    if (c == '\\' && it != str.end()) {
+      switch (*it++) {
+        case '\\':
+          c = '\\';
+          break;
+        case 'n':
+          c = '\n';
+          break;
+        case 't':
+          c = '\t';
+          break;
+        case '"':
+          c = '"';
+          break;
+        // invalid escape sequence - skip it
+        default:
+          continue;
+      }
+    }
+    res[size++] = c;
+  }
+  return StringRef(res, size);
+}
+
+void AnnotationParser::AddToken(TokenKind kind, StringRef::iterator start) {
+  Token t;
+  t.kind_ = kind;
+  t.range_ = StringRef(start, current_ - start);
+  tokens_.push_back(t);
 }
 
 // Returns whether a character at 'position' was escaped with a leading '\'.
@@ -145,17 +195,7 @@ bool AnnotationParser::TokenizeString() {
     errs() << "Expected quote at end of scalar\n";
     return false;
   }
-
-
-  Token t;
-  t.kind_ = kString_Token;
-  t.range_ = StringRef(start+1, current_ - start -1);
-  tokens_.push_back(t);
-  if (current_ == end_) {
-    errs() << "Already end,Expected quote at end of scalar\n";
-    return false;
-  }
-
+  AddToken(kString_Token, start + 1);
   current_++; // Skip ending quote.
   return true;
 }
@@ -172,87 +212,84 @@ bool AnnotationParser::IsBlankOrBreak(StringRef::iterator position) {
 
 bool AnnotationParser::TokenizeSymbol() {
   StringRef::iterator start = current_;
-  while (current_ != end_ && !IsBlankOrBreak(current_) && *current_ != ':' && *current_ != '=' && *current_ != '}') {
+  while (current_ != end_ && !IsBlankOrBreak(current_) && *current_ != ':' &&
+         *current_ != '=' && *current_ != ',' && *current_ != '}') {
     current_++;
   }
-  Token t;
-  t.kind_ = kSymbol_Token;
-  t.range_ = StringRef(start, current_ - start);
-  tokens_.push_back(t);
-  //errs() << t.range_.str() << "\n";
+  AddToken(kSymbol_Token, start);
   return true;
 }
 
+// Numbers are decimal or hex integers, or floats with fraction and/or
+// exponent. Trailing letters (C++ literal suffixes) are kept in the token,
+// see ToInt() and ToFloat().
 bool AnnotationParser::TokenizeNumber() {
   StringRef::iterator start = current_;
   TokenKind kind = kInt_Token;
-  while (isxdigit(*current_) || *current_ == '.' || *current_ == 'x' ||
-         *current_ == 'X') {
-    if (*current_ == 'x' || *current_ == 'X') {
-      if (kind != kInt_Token) {
-        errs() << "Malformed float number\n";
-        return false;
+  if (*current_ == '-')
+    current_++;
+  if (end_ - current_ > 1 && current_[0] == '0' &&
+      (current_[1] == 'x' || current_[1] == 'X')) {
+    kind = kHexInt_Token;
+    current_ += 2;
+    while (current_ != end_ && isxdigit(*current_))
+      current_++;
+  } else {
+    while (current_ != end_ && (isdigit(*current_) || *current_ == '.')) {
+      if (*current_ == '.') {
+        if (kind != kInt_Token) {
+          errs() << "Malformed float number\n";
+          return false;
+        }
+        kind = kFloat_Token;
       }
-      kind = kHexInt_Token;
+      current_++;
     }
-    if (*current_ == '.' || *current_ == ',') {
-      if (kind != kInt_Token) {
-        errs() << "Malformed hex number\n";
-        return false;
+    // exponent, sign of which would be a number of its own otherwise
+    if (current_ != end_ && (*current_ == 'e' || *current_ == 'E')) {
+      StringRef::iterator exponent = current_ + 1;
+      if (exponent != end_ && (*exponent == '-' || *exponent == '+'))
+        exponent++;
+      if (exponent != end_ && isdigit(*exponent)) {
+        kind = kFloat_Token;
+        current_ = exponent;
+        while (current_ != end_ && isdigit(*current_))
+          current_++;
       }
-      kind = kFloat_Token;
     }
-    current_++;
   }
-  Token t;
-  t.kind_ = kind;
-  t.range_ = StringRef(start, current_ - start);
-  tokens_.push_back(t);
+  while (current_ != end_ && isalnum(*current_))
+    current_++;
+  AddToken(kind, start);
   return true;
 }
 
-bool AnnotationParser::Tokenize() {
-  current_ = buffer_->getBufferStart();
-  end_ = buffer_->getBufferEnd();
+bool AnnotationParser::Tokenize(StringRef str) {
+  current_ = str.begin();
+  end_ = str.end();
   tokens_.clear();
-  current_ = buffer_->getBufferStart();
   while (current_ != end_) {
     switch (*current_) {
       case (':'):
-      case ('='): {
-        Token t;
-        t.kind_ = kAssign_Token;
-        t.range_ = StringRef(current_, 1);
-        tokens_.push_back(t);
+      case ('='):
         current_++;
+        AddToken(kAssign_Token, current_ - 1);
         break;
-      }
-      case (','): {
-        Token t;
-        t.kind_ = kComma_Token;
-        t.range_ = StringRef(current_, 1);
-        tokens_.push_back(t);
+      case (','):
         current_++;
+        AddToken(kComma_Token, current_ - 1);
         break;
-      }
-      case ('{'): {
-        Token t;
-        t.kind_ = kCurlyBracketLeft_Token;
-        t.range_ = StringRef(current_, 1);
-        tokens_.push_back(t);
+      case ('{'):
         current_++;
+        AddToken(kCurlyBracketLeft_Token, current_ - 1);
         break;
-      }
-      case ('}'): {
-        Token t;
-        t.kind_ = kCurlyBracketRight_Token;
-        t.range_ = StringRef(current_, 1);
-        tokens_.push_back(t);
+      case ('}'):
         current_++;
+        AddToken(kCurlyBracketRight_Token, current_ - 1);
         break;
-      }
       case ('"'): {
-        TokenizeString();
+        if (!TokenizeString())
+          return false;
         break;
       }
       case (' '):
@@ -266,15 +303,18 @@ bool AnnotationParser::Tokenize() {
         TokenizeSymbol();
         break;
 
+      case ('-'):
       case ('.'):
-        TokenizeNumber();
+        if (!TokenizeNumber())
+          return false;
         break;
 
       default: {
         if (isalpha(*current_)) {
           TokenizeSymbol();
         } else if (isdigit(*current_)) {
-          TokenizeNumber();
+          if (!TokenizeNumber())
+            return false;
         } else {
           errs() << "Unknown character '" << *current_ << "'\n";
           return false;
@@ -286,9 +326,5 @@ bool AnnotationParser::Tokenize() {
   return true;
 }
 
-char const *AnnotationParser::kind() const {
-  return kind_.c_str();
-}
-
 } // namespace scan
 } // namespace rfl
@@ -5,46 +5,50 @@
 #ifndef __RFL_SCAN_ANNOTATION_PARSER_H__
 #define __RFL_SCAN_ANNOTATION_PARSER_H__
 
-#include "rfl/reflected.h"
-
-#include "llvm/Support/MemoryBuffer.h"
-#include "llvm/Support/SourceMgr.h"
-#include "llvm/Support/YAMLParser.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/ADT/StringMap.h"
-
-#include <string>
+#include "llvm/Support/Allocator.h"
 
 namespace rfl {
 namespace scan {
 
 using namespace llvm;
 
+// Parses annotation strings of form 'kind:{key = value, ...}'. Meant to be
+// reused, results are views into the parsed string or, for unescaped
+// string values, into the |allocator| passed to constructor. They are valid
+// until next Parse() or until the allocator is reset.
 class AnnotationParser {
 public:
-  static std::unique_ptr<AnnotationParser> loadFromFile(
-      StringRef file_path,
-      std::string &error_msg);
-  static std::unique_ptr<AnnotationParser> loadFromBuffer(
-      StringRef annotation_string,
-      std::string &error_msg);
+  // Type of value as written in annotation, 'true' and 'false' symbols are
+  // booleans. Matches rfl::Annotation::ValueType.
+  enum ValueType {
+    kString_Value = 0,
+    kInt_Value,
+    kFloat_Value,
+    kBool_Value,
+    kSymbol_Value,
+  };
 
-  StringRef GetValue(StringRef key);
+  explicit AnnotationParser(BumpPtrAllocator &allocator);
 
-  char const *kind() const;
+  bool Parse(StringRef annotation_string);
+
+  // Converts kInt_Value and kFloat_Value texts, C++ literal suffixes of
+  // floats are ignored. Return false for malformed numbers.
+  static bool ToInt(StringRef value, int64_t *result);
+  static bool ToFloat(StringRef value, double *result);
+
+  StringRef kind() const { return kind_; }
+  StringRef GetValue(StringRef key) const;
 
   template <class E>
   void Enumerate(E const &inserter) const {
-    for (StringMap<std::string>::MapEntryTy const &entry : value_map_) {
-        inserter(entry.getKey().str(), entry.getValue());
+    for (Entry const &entry : entries_) {
+      inserter(entry.key, entry.value, entry.type);
     }
   }
 
-private:
-  AnnotationParser(std::unique_ptr<MemoryBuffer> buffer);
-
-  bool Parse(std::string &err_msg);
-
 private:
   enum TokenKind {
     kNone_Token = 0,
@@ -63,17 +67,26 @@ private:
     TokenKind kind_;
     StringRef range_;
   };
-  typedef std::vector<Token> Tokens;
+  typedef SmallVector<Token, 32> Tokens;
+
+  struct Entry {
+    StringRef key;
+    StringRef value;
+    ValueType type;
+  };
+
+  void AddToken(TokenKind kind, StringRef::iterator start);
+  void SetValue(StringRef key, StringRef value, ValueType type);
+  StringRef Unescape(StringRef str);
   bool TokenizeString();
   bool TokenizeSymbol();
   bool TokenizeNumber();
   bool IsBlankOrBreak(StringRef::iterator position);
-  bool Tokenize();
+  bool Tokenize(StringRef str);
 
-  std::unique_ptr<MemoryBuffer> buffer_;
-  SourceMgr source_mgr_;
-  StringMap<std::string> value_map_;
-  std::string kind_;
+  BumpPtrAllocator &allocator_;
+  SmallVector<Entry, 8> entries_;
+  StringRef kind_;
 
   Tokens tokens_;
   StringRef::iterator current_;
@@ -0,0 +1,139 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+#include "rfl-scan/annotation_parser.h"
+
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+struct ParsedEntry {
+  std::string key;
+  std::string value;
+  AnnotationParser::ValueType type;
+};
+
+struct EntryCollector {
+  EntryCollector(std::vector<ParsedEntry> *entries) : entries_(entries) {}
+
+  void operator()(StringRef key,
+                  StringRef value,
+                  AnnotationParser::ValueType type) const {
+    ParsedEntry entry;
+    entry.key = key;
+    entry.value = value;
+    entry.type = type;
+    entries_->push_back(entry);
+  }
+
+  std::vector<ParsedEntry> *entries_;
+};
+
+std::vector<ParsedEntry> ParseEntries(AnnotationParser &parser,
+                                      StringRef text) {
+  std::vector<ParsedEntry> entries;
+  EXPECT_TRUE(parser.Parse(text)) << text.str();
+  parser.Enumerate(EntryCollector(&entries));
+  return entries;
+}
+
+} // namespace
+
+TEST(TestAnnotationParser, TypedValues) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  std::vector<ParsedEntry> entries = ParseEntries(
+      parser,
+      "property:{name = \"Value\", id = 10, mask = 0x1F, step = 0.5,"
+      " visible = true, hidden = false}");
+  EXPECT_EQ("property", parser.kind());
+  ASSERT_EQ(6u, entries.size());
+  EXPECT_EQ("name", entries[0].key);
+  EXPECT_EQ("Value", entries[0].value);
+  EXPECT_EQ(AnnotationParser::kString_Value, entries[0].type);
+  EXPECT_EQ("10", entries[1].value);
+  EXPECT_EQ(AnnotationParser::kInt_Value, entries[1].type);
+  EXPECT_EQ("0x1F", entries[2].value);
+  EXPECT_EQ(AnnotationParser::kInt_Value, entries[2].type);
+  EXPECT_EQ("0.5", entries[3].value);
+  EXPECT_EQ(AnnotationParser::kFloat_Value, entries[3].type);
+  EXPECT_EQ("true", entries[4].value);
+  EXPECT_EQ(AnnotationParser::kBool_Value, entries[4].type);
+  EXPECT_EQ("false", entries[5].value);
+  EXPECT_EQ(AnnotationParser::kBool_Value, entries[5].type);
+}
+
+TEST(TestAnnotationParser, NegativeNumbers) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  std::vector<ParsedEntry> entries = ParseEntries(
+      parser, "property:{min = -10, mask = -0x10, step = -0.25}");
+  ASSERT_EQ(3u, entries.size());
+  EXPECT_EQ("-10", entries[0].value);
+  EXPECT_EQ(AnnotationParser::kInt_Value, entries[0].type);
+  EXPECT_EQ("-0x10", entries[1].value);
+  EXPECT_EQ(AnnotationParser::kInt_Value, entries[1].type);
+  EXPECT_EQ("-0.25", entries[2].value);
+  EXPECT_EQ(AnnotationParser::kFloat_Value, entries[2].type);
+
+  int64_t int_value = 0;
+  EXPECT_TRUE(AnnotationParser::ToInt(entries[0].value, &int_value));
+  EXPECT_EQ(-10, int_value);
+  double float_value = 0;
+  EXPECT_TRUE(AnnotationParser::ToFloat(entries[2].value, &float_value));
+  EXPECT_EQ(-0.25, float_value);
+}
+
+TEST(TestAnnotationParser, SymbolValue) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  std::vector<ParsedEntry> entries =
+      ParseEntries(parser, "property:{kind = number, flag}");
+  ASSERT_EQ(1u, entries.size());
+  EXPECT_EQ("kind", entries[0].key);
+  EXPECT_EQ("number", entries[0].value);
+  EXPECT_EQ(AnnotationParser::kSymbol_Value, entries[0].type);
+  EXPECT_EQ("number", parser.GetValue("kind"));
+}
+
+TEST(TestAnnotationParser, Exponent) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  std::vector<ParsedEntry> entries = ParseEntries(
+      parser, "property:{a = 1e5, b = 1e-5, c = -2.5E+3, d = 1.5e2f}");
+  ASSERT_EQ(4u, entries.size());
+  EXPECT_EQ("1e5", entries[0].value);
+  EXPECT_EQ("1e-5", entries[1].value);
+  EXPECT_EQ("-2.5E+3", entries[2].value);
+  EXPECT_EQ("1.5e2f", entries[3].value);
+  for (ParsedEntry const &entry : entries) {
+    EXPECT_EQ(AnnotationParser::kFloat_Value, entry.type) << entry.key;
+  }
+
+  double float_value = 0;
+  EXPECT_TRUE(AnnotationParser::ToFloat(entries[1].value, &float_value));
+  EXPECT_DOUBLE_EQ(1e-5, float_value);
+  EXPECT_TRUE(AnnotationParser::ToFloat(entries[3].value, &float_value));
+  EXPECT_DOUBLE_EQ(150.0, float_value);
+}
+
+TEST(TestAnnotationParser, MissingComma) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  EXPECT_FALSE(parser.Parse("property:{a = 1 -5}"));
+  EXPECT_FALSE(parser.Parse("property:{a = 1 b = 2}"));
+  EXPECT_FALSE(parser.Parse("property:{a = \"x\" \"y\"}"));
+  EXPECT_TRUE(parser.kind().empty());
+
+  EXPECT_TRUE(parser.Parse("property:{a = 1, b = 2}"));
+  EXPECT_EQ("2", parser.GetValue("b"));
+}
+
+} // namespace scan
+} // namespace rfl
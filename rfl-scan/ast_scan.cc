@@ -4,6 +4,7 @@
 
 #include "rfl-scan/ast_scan.h"
 #include "rfl-scan/annotation_parser.h"
+#include "rfl-scan/path_util.h"
 #include "rfl/reflected.h"
 
 #include "clang/Frontend/CompilerInstance.h"
@@ -26,77 +27,20 @@
 namespace rfl {
 namespace scan {
 
-namespace {
-
-struct AnnoInserter {
-  AnnoInserter(Annotation *anno) : anno_(anno) {}
-
-  void operator()(std::string const &key, std::string const &value) const {
-    anno_->AddEntry(key.c_str(), value.c_str());
-  }
-
-  Annotation *anno_;
-};
-
-struct AnnoDebugPrinter {
-  void operator()(std::string const &key, std::string const &value) const {
-    outs() << "  " << key << " : " << value << "\n";
-  }
-};
-
-static std::string PathRelativeToBaseDir(SourceLocation const &source_loc,
-                                         SourceManager const &src_manager,
-                                         StringRef const &basedir) {
-
-  PresumedLoc presumed_loc = src_manager.getPresumedLoc(source_loc, false);
-  StringRef hfile(presumed_loc.getFilename());
-  SmallString<256> path(hfile.begin(), hfile.end());
-  sys::fs::make_absolute(path);
-  SmallVector<StringRef,16> components;
-  SmallVector<StringRef, 16>::iterator comp_it = components.begin();
-  for (sys::path::const_iterator path_it = sys::path::begin(path);
-       path_it != sys::path::end(path); ++path_it) {
-    StringRef component = *path_it;
-    if (component.size() > 0 && component[0] == '.') {
-        if (component.size() == 2 && comp_it > components.begin()){
-          --comp_it;
-        }
-    } else {
-      if (!component.empty())
-        components.insert(comp_it++, component);
-    }
-  }
-  components.resize(comp_it - components.begin());
-
-  SmallString<256> full_path;
-  SmallVector<StringRef, 16>::const_iterator it = components.begin();
-  if (it != components.end()) {
-    ++it;
-  }
-  for (; it != components.end(); ++it) {
-    StringRef comp = *it;
-    full_path.append(sys::path::get_separator());
-    full_path.append(comp.begin(), comp.end());
-  }
-
-  StringRef path_str = full_path.str();
-  if (path_str.size() > basedir.size() && path_str.startswith(basedir)) {
-    path_str = path_str.substr(basedir.size(), path_str.size());
-  }
-  return path_str.str();
-}
-
-} // namespace
-
 ////////////////////////////////////////////////////////////////////////////////
 
 ASTScanner::ASTScanner(ASTScannerContext *scan_ctx, raw_ostream *out)
-    : scanner_context_(scan_ctx), context_(nullptr), out_(out ? *out : outs()) {
+    : scanner_context_(scan_ctx),
+      context_(nullptr),
+      out_(out ? *out : outs()),
+      annotation_parser_(annotation_allocator_) {
 }
 
 void ASTScanner::HandleTranslationUnit(ASTContext &Context) {
   TranslationUnitDecl *D = Context.getTranslationUnitDecl();
   context_ = &Context;
+  relative_paths_.clear();
+  sys::fs::current_path(working_dir_);
 
   if (verbose()) {
     FileID main_id = src_manager().getMainFileID();
@@ -105,7 +49,16 @@ void ASTScanner::HandleTranslationUnit(ASTContext &Context) {
     location.print(outs(), src_manager());
     outs() << "\n";
   }
-  TraverseDecl(D);
+  if (!scanner_context_->prune_system_decls()) {
+    TraverseDecl(D);
+    return;
+  }
+  for (Decl *decl : D->decls()) {
+    SourceLocation location = decl->getLocation();
+    if (location.isInvalid() || src_manager().isInSystemHeader(location))
+      continue;
+    TraverseDecl(decl);
+  }
 }
 
 bool ASTScanner::TraverseDecl(Decl *D) {
@@ -176,22 +129,33 @@ bool ASTScanner::ReadAnnotation(NamedDecl *D, Annotation *anno) {
     outs().flush();
   }
 
-  std::string err_msg;
-  std::unique_ptr<AnnotationParser> parser =
-    AnnotationParser::loadFromBuffer(attribute_text, err_msg);
-  if (parser == nullptr) {
+  AnnotationCache *cache = scanner_context_->annotation_cache();
+  std::shared_ptr<ParsedAnnotation const> parsed =
+      cache->Lookup(attribute_text);
+  if (!parsed) {
+    // values are copied right away, the allocator holds only this annotation
+    annotation_allocator_.Reset();
+    bool valid = annotation_parser_.Parse(attribute_text);
+    parsed = cache->Insert(attribute_text, annotation_parser_, valid);
+  }
+  if (!parsed->valid) {
     location.print(errs(), src_manager());
     errs() << " Failed to parse annotation: '" << attribute_text << "'\n";
     return false;
   }
 
   if (anno != nullptr) {
-    anno->set_kind(parser->kind());
-    parser->Enumerate(AnnoInserter(anno));
+    anno->set_kind(parsed->kind.c_str());
+    for (ParsedAnnotation::Entry const &entry : parsed->entries) {
+      anno->AddEntry(entry.key.c_str(), entry.value.c_str(),
+                     static_cast<Annotation::ValueType>(entry.type));
+    }
   }
 
   if (verbose() > 2) {
-    parser->Enumerate(AnnoDebugPrinter());
+    for (ParsedAnnotation::Entry const &entry : parsed->entries) {
+      outs() << "  " << entry.key << " : " << entry.value << "\n";
+    }
   }
   return true;
 }
@@ -218,9 +182,9 @@ Namespace *ASTScanner::GetOrCreateNamespaceForRecord(Decl *D) {
       llvm::raw_string_ostream os(ns_name);
       os << *ND;
       os.flush();
-      Namespace *ns = current_ns->FindNamespace(ns_name.c_str());
+      Namespace *ns = current_ns->FindNamespace(Intern(ns_name));
       if (!ns) {
-        ns = new Namespace(os.str().c_str());
+        ns = package()->arena()->NewNamespace(os.str().c_str());
         current_ns->AddNamespace(ns);
       }
       current_ns = ns;
@@ -250,7 +214,7 @@ bool ASTScanner::_TraverseTypedefDecl(TypedefDecl *D) {
 
   std::string name = D->getDeclName().getAsString();
 
-  if (ns->FindClass(name.c_str())) {
+  if (ns->FindClass(Intern(name))) {
     // already processed
     return true;
   }
@@ -258,12 +222,11 @@ bool ASTScanner::_TraverseTypedefDecl(TypedefDecl *D) {
   LogDecl(D);
 
   SourceLocation source_loc = D->getSourceRange().getBegin();
-  std::string header_file =
-      PathRelativeToBaseDir(source_loc, src_manager(), basedir());
+  std::string header_file = RelativePath(source_loc);
   PackageFile *pkg_file =
       package()->GetOrCreatePackageFile(header_file.c_str());
 
-  Class *klass = new Class(name.c_str(), pkg_file, anno);
+  Class *klass = package()->arena()->NewClass(name.c_str(), pkg_file, anno);
   klass->set_order(class_count());
   set_class_count(class_count() + 1);
   ns->AddClass(klass);
@@ -285,15 +248,16 @@ bool ASTScanner::_TraverseCXXRecord(CXXRecordDecl *D) {
   Class *parent = CurrentClass();
   Class *super = nullptr;
   Namespace *ns = nullptr;
+  Atom name_atom = Intern(name);
   // check that class does not already exists
   if (parent) {
     // this class decl is nested, look in parent class
-    if (parent->FindClass(name.c_str()))
+    if (parent->FindClass(name_atom))
       return true;
   } else {
     // this class decl is nested, look in parent class
     ns = GetOrCreateNamespaceForRecord(D);
-    if (!ns || ns->FindClass(name.c_str())) {
+    if (!ns || ns->FindClass(name_atom)) {
       // already processed
       return true;
     }
@@ -345,7 +309,7 @@ bool ASTScanner::_TraverseCXXRecord(CXXRecordDecl *D) {
       if (!base_ns) {
         continue;
       }
-      super = base_ns->FindClass(record_name.c_str());
+      super = base_ns->FindClass(Intern(record_name));
       if (super)
         continue;
     }
@@ -354,14 +318,14 @@ bool ASTScanner::_TraverseCXXRecord(CXXRecordDecl *D) {
   }
 
   SourceLocation source_loc = D->getSourceRange().getBegin();
-  std::string header_file =
-      PathRelativeToBaseDir(source_loc, src_manager(), basedir());
+  std::string header_file = RelativePath(source_loc);
 
   PackageFile *pkg_file =
       package()->GetOrCreatePackageFile(header_file.c_str());
 
 
-  Class *klass = new Class(name.c_str(), pkg_file, anno, super);
+  Class *klass =
+      package()->arena()->NewClass(name.c_str(), pkg_file, anno, super);
   klass->set_order(class_count());
   klass->set_base_class_offset(base_class_offset);
   set_class_count(class_count() + 1);
@@ -448,7 +412,7 @@ bool ASTScanner::_TraverseFieldDecl(FieldDecl *D) {
         os.flush();
       } else {
 				Namespace *ns = GetOrCreateNamespaceForRecord(ED);
-				Enum *enm = ns->FindEnum(ED->getName().data());
+				Enum *enm = ns->FindEnum(Intern(ED->getName().str()));
 				if (enm == nullptr) {
 					errs() << "Could not find enum ";
 					ED->printQualifiedName(errs());
@@ -467,7 +431,7 @@ bool ASTScanner::_TraverseFieldDecl(FieldDecl *D) {
       type_name = D->getType().getAsString(policy);
     }
 		if (tr.kind() == TypeRef::kInvalid_Kind)
-			tr.set_type_name(type_name.c_str());
+			tr.set_type_name(Intern(type_name));
   } else {
     errs() << "Error missing TypeSourceInfo "
            << D->getType().getLocalUnqualifiedType().getAsString() << "\n";
@@ -485,8 +449,8 @@ bool ASTScanner::_TraverseFieldDecl(FieldDecl *D) {
   ASTRecordLayout const &layout = context_->getASTRecordLayout(D->getParent());
   uint32 offset = (uint32)layout.getFieldOffset(D->getFieldIndex());
 
-  klass->AddField(
-      new Field(field_name.c_str(), tr, offset, tq, anno));
+  klass->AddField(package()->arena()->NewField(field_name.c_str(), tr, offset,
+                                               tq, anno));
   return true;
 }
 
@@ -504,32 +468,34 @@ bool ASTScanner::_TraverseEnumDecl(EnumDecl *D) {
 
   Class *parent = CurrentClass();
   Namespace *ns = nullptr;
+  Atom name_atom = Intern(name);
   if (parent == nullptr) {
     ns = GetOrCreateNamespaceForRecord(D);
-    if (!ns || ns->FindEnum(name.c_str()) != nullptr)
+    if (!ns || ns->FindEnum(name_atom) != nullptr)
       return true;
-  } else if (parent->FindEnum(name.c_str()) != nullptr){
+  } else if (parent->FindEnum(name_atom) != nullptr){
       return true;
   }
 
   LogDecl(D);
 
   SourceLocation source_loc = D->getSourceRange().getBegin();
-  std::string header_file = PathRelativeToBaseDir(source_loc, src_manager(), basedir());
+  std::string header_file = RelativePath(source_loc);
 
   PackageFile *pkg_file =
       package()->GetOrCreatePackageFile(header_file.c_str());
-  Enum *e = new Enum(name.c_str(), type.c_str(), pkg_file, anno, ns, parent);
+  Enum *e = package()->arena()->NewEnum(name.c_str(), type.c_str(), pkg_file,
+                                       anno, ns, parent);
 
   // collect enum items
   for (EnumDecl::enumerator_iterator it = D->enumerator_begin();
        it != D->enumerator_end(); ++it) {
     EnumConstantDecl *e_item = *it;
     EnumItem item;
-    item.set_id(e_item->getNameAsString().c_str());
+    item.set_id(Intern(e_item->getNameAsString()));
     llvm::APSInt const &value = e_item->getInitVal();
     item.set_value((long) value.getSExtValue());
-    item.set_name(anno.GetEntry(item.id())); // XXX check
+    item.set_name(package()->atoms()->Intern(anno.GetEntry(item.id())));
     e->AddEnumItem(item);
   }
   if (!parent) {
@@ -559,11 +525,11 @@ bool ASTScanner::_TraverseMethodDecl(CXXMethodDecl *D) {
       D->getReturnType().getLocalUnqualifiedType().getAsString();
 
   Class *klass = class_queue_.front();
-  Method *method = new Method(name.c_str(), anno);
+  Method *method = package()->arena()->NewMethod(name.c_str(), anno);
   // TODO check that method does not exists, handle overloads
   klass->AddMethod(method);
-  method->AddArgument(
-      new Argument("return", Argument::kReturn_Kind, ret_type.c_str(), Annotation()));
+  method->AddArgument(package()->arena()->NewArgument(
+      "return", Argument::kReturn_Kind, ret_type.c_str(), Annotation()));
 
   for (CXXMethodDecl::param_iterator it = D->param_begin();
        it != D->param_end(); ++it) {
@@ -583,7 +549,7 @@ bool ASTScanner::_TraverseMethodDecl(CXXMethodDecl *D) {
     char const *kind_entry = param_anno.GetEntry("kind");
     if (!kind_entry) {
       errs() << "Missing 'kind' annotation on argument " << param_name << "\n";
-      // FIXME method & params are invalid, release memory
+      // FIXME method & params are invalid
       return true;
     }
     std::string kind_anno = kind_entry;
@@ -596,12 +562,12 @@ bool ASTScanner::_TraverseMethodDecl(CXXMethodDecl *D) {
       kind = Argument::kInOut_Kind;
     } else {
       errs() << "Unknown argument kind '" << kind_anno << "'\n";
-      // FIXME method & params are invalid, release memory
+      // FIXME method & params are invalid
       return true;
     }
 
-    Argument *arg =
-        new Argument(param_name.data(), kind, param_type.c_str(), param_anno);
+    Argument *arg = package()->arena()->NewArgument(
+        param_name.data(), kind, param_type.c_str(), param_anno);
     method->AddArgument(arg);
   }
 
@@ -641,6 +607,25 @@ void ASTScanner::LogDecl(NamedDecl *D) const {
   }
 }
 
+std::string ASTScanner::RelativePath(SourceLocation loc) {
+  FileID file_id = src_manager().getFileID(src_manager().getExpansionLoc(loc));
+  DenseMap<FileID, std::string>::const_iterator it =
+      relative_paths_.find(file_id);
+  if (it != relative_paths_.end())
+    return it->second;
+
+  PresumedLoc presumed_loc = src_manager().getPresumedLoc(loc, false);
+  SmallString<256> filename(presumed_loc.getFilename());
+  if (!sys::path::is_absolute(filename)) {
+    filename = working_dir_;
+    sys::path::append(filename, presumed_loc.getFilename());
+  }
+  std::string path =
+      scanner_context_->path_cache()->RelativeToBaseDir(filename);
+  relative_paths_[file_id] = path;
+  return path;
+}
+
 SourceManager const &ASTScanner::src_manager() const {
   return context_->getSourceManager();
 }
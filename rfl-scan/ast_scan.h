@@ -6,12 +6,18 @@
 #define __RFL_AST_SCAN_ACTION_H__
 
 #include "rfl/reflected.h"
+#include "rfl-scan/annotation_cache.h"
+#include "rfl-scan/annotation_parser.h"
+#include "rfl-scan/path_util.h"
 
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Tooling/Tooling.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+
 #include <deque>
 
 namespace rfl {
@@ -25,7 +31,12 @@ public:
   ASTScannerContext(Package *pkg,
                     std::string const &basedir,
                     unsigned verbose = 0)
-      : package_(pkg), basedir_(basedir), verbose_(verbose), class_count_(0) {}
+      : package_(pkg),
+        basedir_(basedir),
+        verbose_(verbose),
+        class_count_(0),
+        prune_system_decls_(true),
+        path_cache_(basedir) {}
 
   Package *package() const { return package_; }
   std::string const &basedir() const { return basedir_; }
@@ -34,11 +45,22 @@ public:
   unsigned class_count() const { return class_count_; }
   void set_class_count(unsigned count) { class_count_ = count; }
 
+  // Declarations of included headers may be reflected as dependencies,
+  // only top-level declarations of system headers are skipped.
+  bool prune_system_decls() const { return prune_system_decls_; }
+  void set_prune_system_decls(bool prune) { prune_system_decls_ = prune; }
+
+  PathCache *path_cache() { return &path_cache_; }
+  AnnotationCache *annotation_cache() { return &annotation_cache_; }
+
 private:
   Package *package_;
   std::string basedir_;
   unsigned verbose_;
   unsigned class_count_;
+  bool prune_system_decls_;
+  PathCache path_cache_;
+  AnnotationCache annotation_cache_;
 };
 
 class ASTScanner : public ASTConsumer, public RecursiveASTVisitor<ASTScanner> {
@@ -66,12 +88,16 @@ private:
   Namespace *GetOrCreateNamespaceForRecord(Decl *D);
 
   void LogDecl(NamedDecl *D) const;
+  std::string RelativePath(SourceLocation loc);
 
   Class *CurrentClass() const {
     return !class_queue_.empty() ? class_queue_.front() : nullptr;
   }
 
   Package *package() const { return scanner_context_->package(); }
+  Atom Intern(std::string const &str) const {
+    return package()->atoms()->Intern(str.c_str());
+  }
   std::string const &basedir() const { return scanner_context_->basedir(); }
   unsigned verbose() const { return scanner_context_->verbose(); }
   SourceManager const &src_manager() const;
@@ -85,6 +111,10 @@ private:
   raw_ostream &out_;
   std::deque<Namespace *> namespace_queue_;
   std::deque<Class *> class_queue_;
+  DenseMap<FileID, std::string> relative_paths_;
+  SmallString<256> working_dir_;
+  BumpPtrAllocator annotation_allocator_;
+  AnnotationParser annotation_parser_;
 };
 
 class ASTScanAction : public ASTFrontendAction {
@@ -4,29 +4,102 @@
 
 #include "rfl-scan/compilation_db.h"
 
+#include "rfl-scan/path_util.h"
+
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_os_ostream.h"
 
+#include <algorithm>
+
 namespace rfl {
 namespace scan {
 
+char const *const kHeaderExtensions[] = {".h", ".hh", ".hpp", ".h++"};
+char const *const kSourceExtensions[] = {".cc", ".cpp", ".cxx", ".c++", ".c"};
+
+CompileCommandIndex::CompileCommandIndex(CompilationDatabase const &cdb)
+    : commands_(cdb.getAllCompileCommands()) {
+  ArrayRef<char const *> src_exts(kSourceExtensions);
+  for (unsigned i = 0; i < commands_.size(); ++i) {
+    CompileCommand const &cmd = commands_[i];
+    SmallString<1024> file;
+    if (!sys::path::is_absolute(cmd.Filename))
+      file = cmd.Directory;
+    sys::path::append(file, cmd.Filename);
+    std::string path = PathRelativeToBaseDir(file, "");
+
+    StringRef ext = sys::path::extension(path);
+    ArrayRef<char const *>::const_iterator ext_it =
+        std::find_if(src_exts.begin(), src_exts.end(),
+                     [&](char const *src_ext) { return ext == src_ext; });
+    if (ext_it != src_exts.end()) {
+      unsigned rank = ext_it - src_exts.begin();
+      StringRef stem(path.data(), path.size() - ext.size());
+      auto inserted = by_stem_.insert(
+          std::make_pair(stem, std::make_pair(i, rank)));
+      if (!inserted.second && inserted.first->second.second > rank)
+        inserted.first->second = std::make_pair(i, rank);
+    }
+
+    // the first command below a directory represents it, parents of
+    // directories already seen have their commands as well
+    for (StringRef dir = sys::path::parent_path(path); !dir.empty();
+         dir = sys::path::parent_path(dir)) {
+      if (!by_directory_.insert(std::make_pair(dir, i)).second)
+        break;
+    }
+  }
+}
+
+CompileCommand const *CompileCommandIndex::FindByStem(StringRef path) const {
+  std::string normalized = PathRelativeToBaseDir(path, "");
+  StringRef stem = normalized;
+  stem = stem.drop_back(sys::path::extension(stem).size());
+  auto it = by_stem_.find(stem);
+  if (it == by_stem_.end())
+    return nullptr;
+  return &commands_[it->second.first];
+}
+
+CompileCommand const *CompileCommandIndex::FindByDirectory(
+    StringRef path) const {
+  std::string normalized = PathRelativeToBaseDir(path, "");
+  for (StringRef dir = sys::path::parent_path(normalized); !dir.empty();
+       dir = sys::path::parent_path(dir)) {
+    auto it = by_directory_.find(dir);
+    if (it != by_directory_.end())
+      return &commands_[it->second];
+  }
+  return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 ScanCompilationDatabase::ScanCompilationDatabase(
     CompilationDatabase &cdb,
-    std::vector<std::string> sources) : compilation_db_(cdb), source_files_(sources){
+    std::vector<std::string> sources,
+    std::shared_ptr<CompileCommandIndex const> index)
+    : compilation_db_(&cdb),
+      source_files_(sources),
+      shared_index_(index) {
 }
 
-ScanCompilationDatabase::~ScanCompilationDatabase() {
+ScanCompilationDatabase::ScanCompilationDatabase(
+    std::shared_ptr<CompilationDatabaseSnapshot const> snapshot,
+    std::vector<std::string> sources)
+    : compilation_db_(nullptr), source_files_(sources), snapshot_(snapshot) {
 }
 
-char const *const kHeaderExtensions[] = {".h", ".hh", ".hpp", ".h++"};
-char const *const kSourceExtensions[] = {".cc", ".cpp", ".cxx", ".c++", ".c"};
+ScanCompilationDatabase::~ScanCompilationDatabase() {
+}
 
 void ScanCompilationDatabase::cleanupCommands(std::vector<CompileCommand> &cmds,
                                               StringRef const &filename) const {
   // go through all commandlines and replace -c file with ours
   for (CompileCommand &cmd : cmds) {
+    cmd.Filename = filename;
     for (std::vector<std::string>::iterator it = cmd.CommandLine.begin();
          it != cmd.CommandLine.end();) {
       if (!it->empty() && it->compare("-c") == 0) {
@@ -45,51 +118,102 @@ void ScanCompilationDatabase::cleanupCommands(std::vector<CompileCommand> &cmds,
   }
 }
 
-std::vector<CompileCommand> ScanCompilationDatabase::getCompileCommands(
-    StringRef file) const {
-  std::vector<CompileCommand> result = compilation_db_.getCompileCommands(file);
-  if (!result.empty())
+std::vector<CompileCommand> ScanCompilationDatabase::findCompileCommands(
+    StringRef file,
+    CommandMatch *match) const {
+  std::vector<CompileCommand> result =
+      compilation_db_->getCompileCommands(file);
+  if (!result.empty()) {
+    *match = kExact_Match;
     return result;
+  }
 
   // check whether this is a header, if so, try to find .cc file
   StringRef ext = sys::path::extension(file);
   ArrayRef<char const *> hdr_exts(kHeaderExtensions);
-  ArrayRef<char const *> src_exts(kSourceExtensions);
-  for (ArrayRef<char const *>::const_iterator it = hdr_exts.begin();
-       it != hdr_exts.end();
-       ++it) {
-    if (ext.compare(*it) == 0) {
-      // header extensions match, so try to replace it with source ext.
-      for (ArrayRef<char const *>::const_iterator cit = src_exts.begin();
-           cit != src_exts.end();
-           ++cit) {
-        SmallString<1024> src_file(file);
-        sys::path::replace_extension(src_file, *cit);
-        result = compilation_db_.getCompileCommands(src_file);
-        if (result.size()) {
-          cleanupCommands(result,file);
-          return result;
-        }
-      }
-      break;
+  if (std::find_if(hdr_exts.begin(), hdr_exts.end(),
+                   [&](char const *hdr_ext) { return ext == hdr_ext; }) !=
+      hdr_exts.end()) {
+    result = findStemCommands(file);
+    if (!result.empty()) {
+      *match = kStem_Match;
+      return result;
     }
   }
 
-  outs() << "No luck for: " << file << "\n";
-  outs().flush();
+  // nothing found, use flags of a source in the closest directory
+  CompileCommand const *cmd = index()->FindByDirectory(file);
+  if (!cmd) {
+    *match = kNone_Match;
+    return result;
+  }
+  *match = kDirectory_Match;
+  result.push_back(*cmd);
+  return result;
+}
 
-  // Nothing found, try all other files
-  for (std::string const &src : source_files_) {
-    if (src.compare(file) == 0)
-      continue;
-    result = getCompileCommands(src);
+std::vector<CompileCommand> ScanCompilationDatabase::findStemCommands(
+    StringRef file) const {
+  std::vector<CompileCommand> result;
+  if (shared_index_) {
+    CompileCommand const *cmd = shared_index_->FindByStem(file);
+    if (cmd)
+      result.push_back(*cmd);
+    return result;
+  }
+  // a few lookups are cheaper than indexing the whole database, which is
+  // left for sources without any
+  for (char const *src_ext : kSourceExtensions) {
+    SmallString<1024> src_file(file);
+    sys::path::replace_extension(src_file, src_ext);
+    result = compilation_db_->getCompileCommands(src_file);
     if (!result.empty())
-      cleanupCommands(result,file);
-      return result;
+      break;
+  }
+  return result;
+}
+
+CompileCommandIndex const *ScanCompilationDatabase::index() const {
+  if (shared_index_)
+    return shared_index_.get();
+  std::call_once(index_once_, [this]() {
+    index_.reset(new CompileCommandIndex(*compilation_db_));
+  });
+  return index_.get();
+}
+
+std::vector<CompileCommand> ScanCompilationDatabase::getCompileCommands(
+    StringRef file) const {
+  std::vector<CompileCommand> result;
+  CommandMatch match = kNone_Match;
+  if (snapshot_) {
+    CompilationDatabaseSnapshot::Entry const *entry = snapshot_->Find(file);
+    if (entry) {
+      result = entry->commands;
+      match = entry->match;
+    }
+  } else {
+    result = findCompileCommands(file, &match);
   }
+
+  if (match == kDirectory_Match || match == kNone_Match) {
+    outs() << "No luck for: " << file << "\n";
+    outs().flush();
+  }
+  if (match != kExact_Match)
+    cleanupCommands(result, file);
   return result;
 }
 
+void ScanCompilationDatabase::AddToSnapshot(
+    CompilationDatabaseSnapshot *snapshot) const {
+  for (std::string const &source : source_files_) {
+    CompilationDatabaseSnapshot::Entry entry;
+    entry.commands = findCompileCommands(source, &entry.match);
+    snapshot->Add(source, entry);
+  }
+}
+
 std::vector<std::string> ScanCompilationDatabase::getAllFiles() const {
   return source_files_;
 }
@@ -97,8 +221,15 @@ std::vector<std::string> ScanCompilationDatabase::getAllFiles() const {
 std::vector<CompileCommand> ScanCompilationDatabase::getAllCompileCommands() const {
   std::vector<CompileCommand> cmds;
   for (std::string const &source : source_files_) {
-    std::vector<CompileCommand> source_cmds =
-        compilation_db_.getCompileCommands(source);
+    std::vector<CompileCommand> source_cmds;
+    if (snapshot_) {
+      CompilationDatabaseSnapshot::Entry const *entry =
+          snapshot_->Find(source);
+      if (entry && entry->match == kExact_Match)
+        source_cmds = entry->commands;
+    } else {
+      source_cmds = compilation_db_->getCompileCommands(source);
+    }
     if (!source_cmds.empty())
       cmds.insert(cmds.end(), source_cmds.begin(), source_cmds.end());
   }
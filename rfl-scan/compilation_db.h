@@ -5,7 +5,13 @@
 #ifndef __RFL_SCAN_COMPILATION_DB_H__
 #define __RFL_SCAN_COMPILATION_DB_H__
 
+#include "rfl-scan/compilation_db_snapshot.h"
+
 #include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <memory>
+#include <mutex>
 
 namespace rfl {
 namespace scan {
@@ -13,25 +19,76 @@ namespace scan {
 using namespace llvm;
 using namespace clang::tooling;
 
+// Compile commands of a compilation database indexed by absolute path
+// without extension of their source files, and by directory. Every
+// directory has a representative command, the first one of sources in it
+// or in its subdirectories. Built once, so that commands for headers are
+// found without querying the database for every other file.
+class CompileCommandIndex {
+public:
+  explicit CompileCommandIndex(CompilationDatabase const &cdb);
+
+  // Returns command of source of |path| with its extension replaced by
+  // one of source extensions, .cc being preferred over .cpp and others.
+  CompileCommand const *FindByStem(StringRef path) const;
+  // Returns representative command of the closest parent directory of
+  // |path|, that of the root directory if there is no closer one.
+  CompileCommand const *FindByDirectory(StringRef path) const;
+
+  size_t size() const { return commands_.size(); }
+
+private:
+  std::vector<CompileCommand> commands_;
+  // command index and rank of its source extension
+  StringMap<std::pair<unsigned, unsigned>> by_stem_;
+  StringMap<unsigned> by_directory_;
+};
+
 // CompilationDatabase that tries to use flags of .cc/.cpp/.cxx/.c++ of when
 // requesting a header file
 // It's a workaround for CMake, that does not generate
 // compile commands for header files
 class ScanCompilationDatabase : public CompilationDatabase {
 public:
-  ScanCompilationDatabase(CompilationDatabase &cdb,
-                          std::vector<std::string> sources);
+  // |index| of |cdb| is built when not given, on the first source whose
+  // command is not found by probing |cdb| with source extensions.
+  ScanCompilationDatabase(
+      CompilationDatabase &cdb,
+      std::vector<std::string> sources,
+      std::shared_ptr<CompileCommandIndex const> index = nullptr);
+  // Serves commands of |sources| from |snapshot| that covers them, without
+  // the compilation database.
+  ScanCompilationDatabase(
+      std::shared_ptr<CompilationDatabaseSnapshot const> snapshot,
+      std::vector<std::string> sources);
   virtual ~ScanCompilationDatabase();
 
+  // Adds commands of all sources to |snapshot|, these have to be found in
+  // the compilation database.
+  void AddToSnapshot(CompilationDatabaseSnapshot *snapshot) const;
+
   virtual std::vector<CompileCommand> getCompileCommands(
       StringRef FilePath) const;
   virtual std::vector<std::string> getAllFiles() const;
   virtual std::vector<CompileCommand> getAllCompileCommands() const;
 
 private:
+  // Returns commands of |file| as they are in the compilation database,
+  // those of another file when |match| is not kExact_Match.
+  std::vector<CompileCommand> findCompileCommands(StringRef file,
+                                                  CommandMatch *match) const;
+  // Returns commands of source of header |file| found by replacing its
+  // extension, asks the index when it was given.
+  std::vector<CompileCommand> findStemCommands(StringRef file) const;
+  CompileCommandIndex const *index() const;
   void cleanupCommands(std::vector<CompileCommand> &cmds, StringRef const &filename) const;
-  CompilationDatabase &compilation_db_;
+  CompilationDatabase *compilation_db_;
   std::vector<std::string> source_files_;
+  std::shared_ptr<CompileCommandIndex const> shared_index_;
+  // built lazily, scan pool workers look up commands concurrently
+  mutable std::unique_ptr<CompileCommandIndex const> index_;
+  mutable std::once_flag index_once_;
+  std::shared_ptr<CompilationDatabaseSnapshot const> snapshot_;
 };
 
 } // namespace scan
@@ -0,0 +1,346 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/compilation_db_snapshot.h"
+
+#include "rfl-scan/path_util.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+// Bump whenever the format changes, older snapshots are then rebuilt
+char const kSnapshotMagic[] = "RFLCDB";
+unsigned const kSnapshotFormat = 2;
+
+// Coarsest timestamp resolution of file systems in use (FAT), JSON file
+// modified this close to the time snapshot was written may have changed
+// without changing its modification time.
+uint64_t const kRacyModificationNs = 2000000000ull;
+
+// Modification time in nanoseconds since the epoch.
+bool StatFile(std::string const &path, uint64_t *mtime, uint64_t *size) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+#if defined(__APPLE__)
+  struct timespec const &ts = st.st_mtimespec;
+#else
+  struct timespec const &ts = st.st_mtim;
+#endif
+  *mtime = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+  *size = st.st_size;
+  return true;
+}
+
+void WriteVarint(uint64_t value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void WriteString(StringRef str, std::string *out) {
+  WriteVarint(str.size(), out);
+  out->append(str.data(), str.size());
+}
+
+// Bounds checked reader of snapshot data.
+class Reader {
+public:
+  explicit Reader(StringRef data) : data_(data), failed_(false) {}
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (data_.empty())
+        break;
+      unsigned char byte = data_.front();
+      data_ = data_.drop_front();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    failed_ = true;
+    return 0;
+  }
+
+  StringRef ReadString() {
+    uint64_t size = ReadVarint();
+    if (failed_ || size > data_.size()) {
+      failed_ = true;
+      return StringRef();
+    }
+    StringRef str = data_.substr(0, size);
+    data_ = data_.drop_front(size);
+    return str;
+  }
+
+  bool failed() const { return failed_; }
+
+private:
+  StringRef data_;
+  bool failed_;
+};
+
+// Strings of commands repeat a lot, every one is stored once and referred
+// to by its index.
+class StringTable {
+public:
+  uint64_t Add(StringRef str) {
+    auto inserted = indices_.insert(std::make_pair(str, strings_.size()));
+    if (inserted.second)
+      strings_.push_back(str);
+    return inserted.first->second;
+  }
+
+  void Write(std::string *out) const {
+    WriteVarint(strings_.size(), out);
+    for (StringRef str : strings_) {
+      WriteString(str, out);
+    }
+  }
+
+private:
+  StringMap<uint64_t> indices_;
+  std::vector<StringRef> strings_;
+};
+
+}  // namespace
+
+CompilationDatabaseSnapshot::CompilationDatabaseSnapshot()
+    : json_mtime_(0), json_size_(0), modified_(false) {
+}
+
+CompilationDatabaseSnapshot::~CompilationDatabaseSnapshot() {
+}
+
+bool CompilationDatabaseSnapshot::StatJSONFile(uint64_t *mtime,
+                                               uint64_t *size) const {
+  return StatFile(json_path_, mtime, size);
+}
+
+bool CompilationDatabaseSnapshot::HashJSONFile(std::string *hash) const {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+      MemoryBuffer::getFile(json_path_);
+  if (!buffer)
+    return false;
+  MD5 md5;
+  md5.update((*buffer)->getBuffer());
+  MD5::MD5Result result;
+  md5.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  *hash = hex.str();
+  return true;
+}
+
+bool CompilationDatabaseSnapshot::Load(std::string const &path,
+                                       std::string const &json_path) {
+  std::string abs_json_path = PathRelativeToBaseDir(json_path, "");
+  uint64_t mtime = 0;
+  uint64_t size = 0;
+  std::string hash;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  bool loaded = buffer && Parse((*buffer)->getBuffer()) &&
+                json_path_ == abs_json_path && StatJSONFile(&mtime, &size) &&
+                size == json_size_;
+  uint64_t snapshot_mtime = 0;
+  uint64_t snapshot_size = 0;
+  if (loaded && mtime == json_mtime_ &&
+      (!StatFile(path, &snapshot_mtime, &snapshot_size) ||
+       json_mtime_ + kRacyModificationNs > snapshot_mtime)) {
+    // written just after the JSON file, which may have been rewritten since
+    // within the resolution of its timestamp; once verified, the snapshot is
+    // saved again, so that it is not hashed every time
+    loaded = HashJSONFile(&hash) && hash == json_hash_;
+    modified_ = true;
+  } else if (loaded && mtime != json_mtime_) {
+    // regenerated by CMake, but possibly the same
+    loaded = HashJSONFile(&hash) && hash == json_hash_;
+    json_mtime_ = mtime;
+    modified_ = true;
+  }
+  if (loaded)
+    return true;
+
+  entries_.clear();
+  json_path_ = abs_json_path;
+  json_hash_ = hash;
+  json_mtime_ = 0;
+  json_size_ = 0;
+  StatJSONFile(&json_mtime_, &json_size_);
+  modified_ = true;
+  return false;
+}
+
+bool CompilationDatabaseSnapshot::Parse(StringRef data) {
+  if (!data.startswith(StringRef(kSnapshotMagic, sizeof(kSnapshotMagic))))
+    return false;
+  Reader reader(data.drop_front(sizeof(kSnapshotMagic)));
+  if (reader.ReadVarint() != kSnapshotFormat)
+    return false;
+  json_path_ = reader.ReadString();
+  json_mtime_ = reader.ReadVarint();
+  json_size_ = reader.ReadVarint();
+  json_hash_ = reader.ReadString();
+
+  std::vector<StringRef> strings(reader.ReadVarint());
+  for (StringRef &str : strings) {
+    str = reader.ReadString();
+  }
+  auto read_string = [&]() -> std::string {
+    uint64_t index = reader.ReadVarint();
+    return index < strings.size() ? strings[index].str() : std::string();
+  };
+
+  entries_.clear();
+  uint64_t entry_count = reader.ReadVarint();
+  for (uint64_t i = 0; i < entry_count && !reader.failed(); ++i) {
+    std::string source = read_string();
+    Entry &entry = entries_[source];
+    entry.match = static_cast<CommandMatch>(reader.ReadVarint());
+    uint64_t command_count = reader.ReadVarint();
+    for (uint64_t j = 0; j < command_count && !reader.failed(); ++j) {
+      CompileCommand cmd;
+      cmd.Directory = read_string();
+      cmd.Filename = read_string();
+      uint64_t argc = reader.ReadVarint();
+      for (uint64_t k = 0; k < argc && !reader.failed(); ++k) {
+        cmd.CommandLine.push_back(read_string());
+      }
+      entry.commands.push_back(cmd);
+    }
+  }
+  modified_ = false;
+  return !reader.failed();
+}
+
+bool CompilationDatabaseSnapshot::Save(std::string const &path) {
+  if (json_hash_.empty() && !HashJSONFile(&json_hash_))
+    return false;
+
+  // rfl-scan processes of a parallel build share the snapshot, the one saved
+  // meanwhile is merged under lock, so that their entries are not lost
+  std::string lock_path = path + ".lock";
+  int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0666);
+  if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+    errs() << "Failed to lock " << lock_path << "\n";
+    if (lock_fd >= 0)
+      close(lock_fd);
+    return false;
+  }
+  MergeSaved(path);
+  bool written = Write(path);
+  // releases the lock
+  close(lock_fd);
+  return written;
+}
+
+void CompilationDatabaseSnapshot::MergeSaved(std::string const &path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  CompilationDatabaseSnapshot saved;
+  if (!buffer || !saved.Parse((*buffer)->getBuffer()))
+    return;
+  // entries of other JSON content are stale
+  if (saved.json_path_ != json_path_ || saved.json_size_ != json_size_ ||
+      saved.json_hash_ != json_hash_) {
+    return;
+  }
+  for (auto const &it : saved.entries_) {
+    // entries of this process are newer
+    entries_.insert(std::make_pair(it.getKey(), it.getValue()));
+  }
+}
+
+bool CompilationDatabaseSnapshot::Write(std::string const &path) const {
+  StringTable strings;
+  std::string entries;
+  WriteVarint(entries_.size(), &entries);
+  for (auto const &it : entries_) {
+    Entry const &entry = it.getValue();
+    WriteVarint(strings.Add(it.getKey()), &entries);
+    WriteVarint(entry.match, &entries);
+    WriteVarint(entry.commands.size(), &entries);
+    for (CompileCommand const &cmd : entry.commands) {
+      WriteVarint(strings.Add(cmd.Directory), &entries);
+      WriteVarint(strings.Add(cmd.Filename), &entries);
+      WriteVarint(cmd.CommandLine.size(), &entries);
+      for (std::string const &arg : cmd.CommandLine) {
+        WriteVarint(strings.Add(arg), &entries);
+      }
+    }
+  }
+
+  std::string data(kSnapshotMagic, sizeof(kSnapshotMagic));
+  WriteVarint(kSnapshotFormat, &data);
+  WriteString(json_path_, &data);
+  WriteVarint(json_mtime_, &data);
+  WriteVarint(json_size_, &data);
+  WriteString(json_hash_, &data);
+  strings.Write(&data);
+  data.append(entries);
+
+  int fd = -1;
+  SmallString<256> temp_path;
+  if (sys::fs::createUniqueFile(path + ".%%%%%%", fd, temp_path)) {
+    errs() << "Failed to create " << path << "\n";
+    return false;
+  }
+  {
+    raw_fd_ostream out(fd, true);
+    out << data;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      sys::fs::remove(temp_path);
+      errs() << "Failed to write " << temp_path << "\n";
+      return false;
+    }
+  }
+  if (sys::fs::rename(temp_path, path)) {
+    sys::fs::remove(temp_path);
+    errs() << "Failed to rename " << temp_path << " to " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool CompilationDatabaseSnapshot::Covers(
+    std::vector<std::string> const &sources) const {
+  for (std::string const &source : sources) {
+    if (!Find(source))
+      return false;
+  }
+  return true;
+}
+
+CompilationDatabaseSnapshot::Entry const *CompilationDatabaseSnapshot::Find(
+    StringRef source) const {
+  auto it = entries_.find(PathRelativeToBaseDir(source, ""));
+  if (it == entries_.end())
+    return nullptr;
+  return &it->getValue();
+}
+
+void CompilationDatabaseSnapshot::Add(StringRef source, Entry const &entry) {
+  entries_[PathRelativeToBaseDir(source, "")] = entry;
+  modified_ = true;
+}
+
+} // namespace scan
+} // namespace rfl
@@ -0,0 +1,89 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_COMPILATION_DB_SNAPSHOT_H__
+#define __RFL_SCAN_COMPILATION_DB_SNAPSHOT_H__
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+using namespace clang::tooling;
+
+// How commands of a scanned file were found in the compilation database.
+enum CommandMatch {
+  kNone_Match,
+  // commands of the file itself
+  kExact_Match,
+  // command of source with the same name as the header
+  kStem_Match,
+  // representative command of the closest directory
+  kDirectory_Match
+};
+
+// Compile commands of scanned files resolved from JSON compilation
+// database, kept in a compact binary file, so that rfl-scan processes do not
+// parse the whole compile_commands.json to scan a few files. Only the files
+// rfl-scan was asked about are there. The snapshot belongs to the JSON file
+// in the state given by its modification time (in nanoseconds), size and MD5
+// hash.
+class CompilationDatabaseSnapshot {
+public:
+  struct Entry {
+    Entry() : match(kNone_Match) {}
+
+    CommandMatch match;
+    // unmodified commands of the source they were taken from
+    std::vector<CompileCommand> commands;
+  };
+
+  CompilationDatabaseSnapshot();
+  ~CompilationDatabaseSnapshot();
+
+  // Loads snapshot of |json_path| from |path|. Returns false, leaving an
+  // empty snapshot of the current JSON file, when there is no snapshot or
+  // it was written for another file or content. A snapshot of JSON file
+  // that was only touched is kept and will be saved with its new time.
+  bool Load(std::string const &path, std::string const &json_path);
+  // Writes the snapshot to temporary file renamed to |path|, so that
+  // concurrent rfl-scan processes never read a partial one. Entries of the
+  // snapshot saved to |path| by other processes since it was loaded are
+  // merged first, while holding lock file |path|.lock.
+  bool Save(std::string const &path);
+
+  // Returns whether all |sources| have their entry.
+  bool Covers(std::vector<std::string> const &sources) const;
+  Entry const *Find(StringRef source) const;
+  void Add(StringRef source, Entry const &entry);
+
+  bool is_modified() const { return modified_; }
+  size_t size() const { return entries_.size(); }
+
+private:
+  bool Parse(StringRef data);
+  void MergeSaved(std::string const &path);
+  bool Write(std::string const &path) const;
+  bool StatJSONFile(uint64_t *mtime, uint64_t *size) const;
+  bool HashJSONFile(std::string *hash) const;
+
+  std::string json_path_;
+  uint64_t json_mtime_;
+  uint64_t json_size_;
+  // raw MD5 of the JSON file
+  std::string json_hash_;
+  // by normalized absolute path
+  StringMap<Entry> entries_;
+  bool modified_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_COMPILATION_DB_SNAPSHOT_H__ */
@@ -0,0 +1,214 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+#include "rfl-scan/compilation_db_snapshot.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+class TestCompilationDatabaseSnapshot : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    SmallString<256> dir;
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("rfl-scan-cdb", dir));
+    dir_.assign(dir.begin(), dir.end());
+    json_path_ = Path("compile_commands.json");
+    snapshot_path_ = Path("compile_commands.cdb");
+    ASSERT_TRUE(WriteFile(json_path_, "[ \"first\" ]"));
+  }
+
+  virtual void TearDown() {
+    sys::fs::remove(json_path_);
+    sys::fs::remove(snapshot_path_);
+    sys::fs::remove(snapshot_path_ + ".lock");
+    sys::fs::remove(dir_);
+  }
+
+  std::string Path(StringRef name) const {
+    SmallString<256> path(dir_);
+    sys::path::append(path, name);
+    return std::string(path.begin(), path.end());
+  }
+
+  static bool WriteFile(std::string const &path, StringRef content) {
+    std::error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::F_None);
+    if (ec)
+      return false;
+    out << content;
+    out.close();
+    return !out.has_error();
+  }
+
+  static CompilationDatabaseSnapshot::Entry MakeEntry(
+      std::string const &source) {
+    CompileCommand cmd;
+    cmd.Directory = "/build";
+    cmd.Filename = source;
+    cmd.CommandLine.push_back("c++");
+    cmd.CommandLine.push_back("-c");
+    cmd.CommandLine.push_back(source);
+    CompilationDatabaseSnapshot::Entry entry;
+    entry.match = kExact_Match;
+    entry.commands.push_back(cmd);
+    return entry;
+  }
+
+  std::string dir_;
+  std::string json_path_;
+  std::string snapshot_path_;
+};
+
+} // namespace
+
+TEST_F(TestCompilationDatabaseSnapshot, LoadSaved) {
+  CompilationDatabaseSnapshot snapshot;
+  EXPECT_FALSE(snapshot.Load(snapshot_path_, json_path_));
+  EXPECT_EQ(0u, snapshot.size());
+  std::string source = Path("a.cc");
+  snapshot.Add(source, MakeEntry(source));
+  ASSERT_TRUE(snapshot.Save(snapshot_path_));
+
+  CompilationDatabaseSnapshot loaded;
+  ASSERT_TRUE(loaded.Load(snapshot_path_, json_path_));
+  CompilationDatabaseSnapshot::Entry const *entry = loaded.Find(source);
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_EQ(kExact_Match, entry->match);
+  ASSERT_EQ(1u, entry->commands.size());
+  EXPECT_EQ("/build", entry->commands[0].Directory);
+  EXPECT_EQ(source, entry->commands[0].Filename);
+  ASSERT_EQ(3u, entry->commands[0].CommandLine.size());
+  EXPECT_EQ("-c", entry->commands[0].CommandLine[1]);
+
+  // snapshot of another JSON file is not used
+  CompilationDatabaseSnapshot other;
+  EXPECT_FALSE(other.Load(snapshot_path_, Path("other.json")));
+  EXPECT_EQ(0u, other.size());
+}
+
+TEST_F(TestCompilationDatabaseSnapshot, LoadRewrittenJSON) {
+  CompilationDatabaseSnapshot snapshot;
+  snapshot.Load(snapshot_path_, json_path_);
+  std::string source = Path("a.cc");
+  snapshot.Add(source, MakeEntry(source));
+  ASSERT_TRUE(snapshot.Save(snapshot_path_));
+
+  // same size and modification time, but other content
+  struct stat st;
+  ASSERT_EQ(0, stat(json_path_.c_str(), &st));
+  ASSERT_TRUE(WriteFile(json_path_, "[ \"other\" ]"));
+  struct timespec times[2];
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+#if defined(__APPLE__)
+  times[1] = st.st_mtimespec;
+#else
+  times[1] = st.st_mtim;
+#endif
+  ASSERT_EQ(0, utimensat(AT_FDCWD, json_path_.c_str(), times, 0));
+
+  CompilationDatabaseSnapshot loaded;
+  EXPECT_FALSE(loaded.Load(snapshot_path_, json_path_));
+  EXPECT_TRUE(loaded.Find(source) == nullptr);
+  EXPECT_TRUE(loaded.is_modified());
+}
+
+TEST_F(TestCompilationDatabaseSnapshot, LoadTouchedJSON) {
+  CompilationDatabaseSnapshot snapshot;
+  snapshot.Load(snapshot_path_, json_path_);
+  std::string source = Path("a.cc");
+  snapshot.Add(source, MakeEntry(source));
+  ASSERT_TRUE(snapshot.Save(snapshot_path_));
+
+  // regenerated with the same content
+  ASSERT_TRUE(WriteFile(json_path_, "[ \"first\" ]"));
+  struct timespec times[2];
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_sec = time(nullptr) + 10;
+  times[1].tv_nsec = 0;
+  ASSERT_EQ(0, utimensat(AT_FDCWD, json_path_.c_str(), times, 0));
+
+  CompilationDatabaseSnapshot loaded;
+  ASSERT_TRUE(loaded.Load(snapshot_path_, json_path_));
+  EXPECT_TRUE(loaded.Find(source) != nullptr);
+  // saved again with the new time
+  EXPECT_TRUE(loaded.is_modified());
+}
+
+TEST_F(TestCompilationDatabaseSnapshot, Covers) {
+  CompilationDatabaseSnapshot snapshot;
+  snapshot.Load(snapshot_path_, json_path_);
+  std::string a = Path("a.cc");
+  std::string b = Path("b.h");
+  snapshot.Add(a, MakeEntry(a));
+
+  std::vector<std::string> sources;
+  EXPECT_TRUE(snapshot.Covers(sources));
+  sources.push_back(a);
+  EXPECT_TRUE(snapshot.Covers(sources));
+  // found by normalized path
+  sources.push_back(Path("sub/../a.cc"));
+  EXPECT_TRUE(snapshot.Covers(sources));
+  sources.push_back(b);
+  EXPECT_FALSE(snapshot.Covers(sources));
+
+  snapshot.Add(b, MakeEntry(a));
+  EXPECT_TRUE(snapshot.Covers(sources));
+}
+
+TEST_F(TestCompilationDatabaseSnapshot, MergeSaved) {
+  // processes of a parallel build load the same snapshot
+  CompilationDatabaseSnapshot first;
+  CompilationDatabaseSnapshot second;
+  first.Load(snapshot_path_, json_path_);
+  second.Load(snapshot_path_, json_path_);
+
+  std::string a = Path("a.cc");
+  std::string b = Path("b.cc");
+  first.Add(a, MakeEntry(a));
+  ASSERT_TRUE(first.Save(snapshot_path_));
+  CompilationDatabaseSnapshot::Entry entry = MakeEntry(b);
+  entry.match = kStem_Match;
+  second.Add(b, entry);
+  // entry of this process wins over the saved one
+  second.Add(a, entry);
+  ASSERT_TRUE(second.Save(snapshot_path_));
+
+  CompilationDatabaseSnapshot loaded;
+  ASSERT_TRUE(loaded.Load(snapshot_path_, json_path_));
+  EXPECT_EQ(2u, loaded.size());
+  ASSERT_TRUE(loaded.Find(a) != nullptr);
+  EXPECT_EQ(kStem_Match, loaded.Find(a)->match);
+  ASSERT_TRUE(loaded.Find(b) != nullptr);
+
+  // entries saved for other content of the JSON file are dropped
+  ASSERT_TRUE(WriteFile(json_path_, "[ \"changed\" ]"));
+  CompilationDatabaseSnapshot changed;
+  EXPECT_FALSE(changed.Load(snapshot_path_, json_path_));
+  std::string c = Path("c.cc");
+  changed.Add(c, MakeEntry(c));
+  ASSERT_TRUE(changed.Save(snapshot_path_));
+  ASSERT_TRUE(loaded.Load(snapshot_path_, json_path_));
+  EXPECT_EQ(1u, loaded.size());
+  EXPECT_TRUE(loaded.Find(c) != nullptr);
+}
+
+} // namespace scan
+} // namespace rfl
@@ -0,0 +1,117 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+#include "rfl-scan/compilation_db.h"
+
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+// Database of fixed commands, files are relative to their directory
+// unless absolute.
+class TestDatabase : public CompilationDatabase {
+public:
+  void Add(std::string const &directory, std::string const &file) {
+    CompileCommand cmd;
+    cmd.Directory = directory;
+    cmd.Filename = file;
+    cmd.CommandLine.push_back("c++");
+    cmd.CommandLine.push_back("-c");
+    cmd.CommandLine.push_back(file);
+    commands_.push_back(cmd);
+  }
+
+  virtual std::vector<CompileCommand> getCompileCommands(
+      StringRef FilePath) const {
+    std::vector<CompileCommand> cmds;
+    for (CompileCommand const &cmd : commands_) {
+      if (cmd.Filename == FilePath)
+        cmds.push_back(cmd);
+    }
+    return cmds;
+  }
+  virtual std::vector<std::string> getAllFiles() const {
+    std::vector<std::string> files;
+    for (CompileCommand const &cmd : commands_) {
+      files.push_back(cmd.Filename);
+    }
+    return files;
+  }
+  virtual std::vector<CompileCommand> getAllCompileCommands() const {
+    return commands_;
+  }
+
+private:
+  std::vector<CompileCommand> commands_;
+};
+
+} // namespace
+
+TEST(TestCompileCommandIndex, FindByStem) {
+  TestDatabase cdb;
+  cdb.Add("/src", "/src/a/foo.cpp");
+  cdb.Add("/src", "/src/a/foo.cc");
+  cdb.Add("/src", "/src/a/bar.c");
+  cdb.Add("/src/b", "baz.cxx");
+  cdb.Add("/src", "/src/a/qux.h");
+  CompileCommandIndex index(cdb);
+  EXPECT_EQ(5u, index.size());
+
+  // .cc is preferred over .cpp listed before it
+  CompileCommand const *cmd = index.FindByStem("/src/a/foo.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/a/foo.cc", cmd->Filename);
+  cmd = index.FindByStem("/src/a/bar.hpp");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/a/bar.c", cmd->Filename);
+  // relative to directory of the command, the path is normalized
+  cmd = index.FindByStem("/src/b/../b/baz.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("baz.cxx", cmd->Filename);
+
+  // commands of headers are not used for other files
+  EXPECT_TRUE(index.FindByStem("/src/a/qux.hh") == nullptr);
+  EXPECT_TRUE(index.FindByStem("/src/b/foo.h") == nullptr);
+  EXPECT_TRUE(index.FindByStem("/src/a/missing.h") == nullptr);
+}
+
+TEST(TestCompileCommandIndex, FindByDirectory) {
+  TestDatabase cdb;
+  cdb.Add("/src", "/src/a/x/one.cc");
+  cdb.Add("/src", "/src/a/two.cc");
+  cdb.Add("/src", "/src/b/three.cc");
+  CompileCommandIndex index(cdb);
+
+  // the first command below the directory represents it
+  CompileCommand const *cmd = index.FindByDirectory("/src/a/header.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/a/x/one.cc", cmd->Filename);
+  cmd = index.FindByDirectory("/src/b/header.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/b/three.cc", cmd->Filename);
+  // the closest parent directory with a command
+  cmd = index.FindByDirectory("/src/b/c/d/header.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/b/three.cc", cmd->Filename);
+  cmd = index.FindByDirectory("/src/header.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/a/x/one.cc", cmd->Filename);
+  // that of the root directory for files elsewhere
+  cmd = index.FindByDirectory("/other/header.h");
+  ASSERT_TRUE(cmd != nullptr);
+  EXPECT_EQ("/src/a/x/one.cc", cmd->Filename);
+
+  TestDatabase empty_cdb;
+  CompileCommandIndex empty_index(empty_cdb);
+  EXPECT_TRUE(empty_index.FindByDirectory("/src/header.h") == nullptr);
+  EXPECT_TRUE(empty_index.FindByStem("/src/header.h") == nullptr);
+}
+
+} // namespace scan
+} // namespace rfl
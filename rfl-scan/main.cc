@@ -17,21 +17,34 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/ADT/SmallString.h"
 
+#include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 
 #include "rfl/reflected.h"
 #include "rfl/generator.h"
 #include "rfl/native_library.h"
+#include "rfl/package_io.h"
+#include "rfl/package_map.h"
+#include "rfl-scan/annotation_cache.h"
 #include "rfl-scan/ast_scan.h"
 #include "rfl-scan/compilation_db.h"
 #include "rfl-scan/proto_ast_scan.h"
+#include "rfl-scan/scan_cache.h"
+#include "rfl-scan/scan_pool.h"
+#include "rfl-scan/scan_server.h"
+#include "rfl-scan/path_util.h"
+#include "rfl-scan/preamble.h"
+#include "rfl-scan/source_filter.h"
+#include "rfl-scan/time_trace.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <set>
 
 #if !defined(_LIBCPP_VERSION)
 #error "libc++ not present"
@@ -68,6 +81,18 @@ static cl::opt<std::string> OutputFile("o",
                                        cl::desc("Output file (required)"),
                                        cl::cat(RflScanCategory));
 
+static cl::opt<std::string> DepFile("depfile",
+                                   cl::desc("Write Makefile style list of "
+                                            "files read by scanning (proto "
+                                            "only)"),
+                                   cl::cat(RflScanCategory));
+
+static cl::opt<std::string> MapFile("map-output",
+                                   cl::desc("Also write memory mappable "
+                                            "package (.rflm) file (proto "
+                                            "only)"),
+                                   cl::cat(RflScanCategory));
+
 static cl::opt<std::string> PackageName("pkg-name",
                                         cl::desc("Package name"),
                                         cl::cat(RflScanCategory));
@@ -87,11 +112,89 @@ static cl::opt<bool> GeneratePlugin("plugin",
 static cl::opt<bool> GenerateProto("proto",
                                     cl::desc("Generate proto"),
                                     cl::cat(RflScanCategory));
+static cl::opt<unsigned> Jobs("j",
+                              cl::desc("Number of translation units scanned "
+                                       "in parallel (proto only)"),
+                              cl::init(1),
+                              cl::cat(RflScanCategory));
+static cl::opt<bool> UnityScan("unity",
+                               cl::desc("Scan all sources as a single "
+                                        "translation unit"),
+                               cl::cat(RflScanCategory));
+static cl::opt<std::string> CacheDir("cache-dir",
+                                    cl::desc("Directory of scanned translation "
+                                             "units cache (proto only)"),
+                                    cl::cat(RflScanCategory));
+static cl::opt<bool> SkipUnannotated("skip-unannotated",
+                                     cl::desc("Do not parse sources without "
+                                              "rfl_ annotations"),
+                                     cl::cat(RflScanCategory));
+static cl::opt<bool> SharePreamble("shared-preamble",
+                                       cl::desc("Precompile #include prefix "
+                                                "shared by sources"),
+                                       cl::cat(RflScanCategory));
+static cl::opt<bool> PruneForeignDecls("prune-foreign-decls",
+                                       cl::desc("Skip top-level declarations "
+                                                "of included headers"),
+                                       cl::init(true),
+                                       cl::cat(RflScanCategory));
+static cl::opt<bool> StreamPackage("stream",
+                                   cl::desc("Write package files as soon as "
+                                            "their translation unit is "
+                                            "scanned (.rfl version 3, proto "
+                                            "only)"),
+                                   cl::init(true),
+                                   cl::cat(RflScanCategory));
+static cl::opt<bool> CompressPackage("compress",
+                                     cl::desc("Write gzip compressed .rfl "
+                                              "(proto only)"),
+                                     cl::init(false),
+                                     cl::cat(RflScanCategory));
+static cl::opt<std::string> TimeTraceFile("time-trace",
+                                         cl::desc("Write Chrome trace of "
+                                                  "scanning phases (proto "
+                                                  "only)"),
+                                         cl::value_desc("file"),
+                                         cl::cat(RflScanCategory));
+static cl::opt<std::string> Serve("serve",
+                                 cl::desc("Serve scan requests on given unix "
+                                          "socket (proto only)"),
+                                 cl::value_desc("socket"),
+                                 cl::cat(RflScanCategory));
 static cl::opt<unsigned> Verbose("verbose",
                                  cl::desc("Verbose level"),
                                  cl::init(0),
                                  cl::cat(RflScanCategory));
 
+static cl::opt<std::string> CdbSnapshot("cdb-snapshot",
+                                       cl::desc("Keep commands of scanned "
+                                                "files from compilation "
+                                                "database of -p in binary "
+                                                "snapshot"),
+                                       cl::value_desc("file"),
+                                       cl::cat(RflScanCategory));
+
+// Options of CommonOptionsParser, which loads the compilation database
+// right away, even when it's not needed
+static cl::opt<std::string> BuildPath("p",
+                                      cl::desc("Build path"),
+                                      cl::Optional,
+                                      cl::cat(RflScanCategory));
+static cl::list<std::string> SourcePaths(cl::Positional,
+                                         cl::desc("<source0> [... <sourceN>]"),
+                                         cl::ZeroOrMore,
+                                         cl::cat(RflScanCategory));
+static cl::list<std::string> ArgsAfter("extra-arg",
+                                       cl::desc("Additional argument to "
+                                                "append to the compiler "
+                                                "command line"),
+                                       cl::cat(RflScanCategory));
+static cl::list<std::string> ArgsBefore("extra-arg-before",
+                                        cl::desc("Additional argument to "
+                                                 "prepend to the compiler "
+                                                 "command line"),
+                                        cl::cat(RflScanCategory));
+
 static cl::opt<std::string> ClangResourceDir(
     "clang-resource-dir",
     cl::desc("Clang resource directory"),
@@ -107,6 +210,30 @@ static std::string StripBasedir(std::string const &filename,
   return filename;
 }
 
+static std::string AbsolutePath(std::string const &path) {
+  SmallString<256> abs_path(path);
+  sys::fs::make_absolute(abs_path);
+  return abs_path.str();
+}
+
+// Returns path of in-memory translation unit that includes all |sources|.
+// It's placed next to the first source, so that relative lookups behave the
+// same as for the source itself.
+static std::string UnitySourcePath(std::vector<std::string> const &sources) {
+  SmallString<256> path(AbsolutePath(sources.front()));
+  sys::path::remove_filename(path);
+  sys::path::append(path, "__rfl_unity__.cc");
+  return path.str();
+}
+
+static std::string UnitySourceContent(std::vector<std::string> const &sources) {
+  std::string content;
+  for (std::string const &source : sources) {
+    content += "#include \"" + AbsolutePath(source) + "\"\n";
+  }
+  return content;
+}
+
 static std::string NormalizedPath(std::string const &path) {
   std::string ret = path;
   if (!sys::path::is_separator(ret[ret.length()-1])) {
@@ -123,96 +250,449 @@ ArgumentsAdjuster GetInsertAdjuster(std::string const &extra) {
   };
 }
 
-int ProtoScanner(ClangTool &tool) {
-  using namespace std;
-  using namespace rfl;
-  using namespace rfl::scan;
+// Identifies scanner build by MD5 of its executable, cached results of other
+// builds are not used. Rebuilt executable may keep size, inode and (second
+// resolution) modification time, so it is the content that is compared.
+static std::string ScannerVersion(std::string const &executable) {
+  std::string version = executable;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+      MemoryBuffer::getFile(executable, -1, false);
+  if (!buffer) {
+    errs() << "Cannot read scanner executable '" << executable << "'\n";
+    return version;
+  }
+  MD5 md5;
+  md5.update(buffer.get()->getBuffer());
+  MD5::MD5Result result;
+  md5.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  version += " ";
+  version += hex.str();
+  return version;
+}
 
-  string basedir = NormalizedPath(Basedir.getValue());
+// Options which scanned translation units depend on, units cached with
+// others (eg. other basedir of package file names) are not used.
+static std::vector<std::string> ScanCacheOptions(
+    rfl::scan::ScanRequest const &request,
+    std::string const &basedir) {
+  std::vector<std::string> options;
+  options.push_back("basedir=" + basedir);
+  options.push_back("pkg-name=" + request.pkg_name);
+  options.push_back("output-dir=" + OutputPath.getValue());
+  return options;
+}
 
-  ScannerContext scan_ctx(basedir, Verbose.getValue());
-
-  // setup package
-  proto::Package &pkg = scan_ctx.package();
-  pkg.set_name(PackageName.getValue());
-  pkg.set_version(PackageVersion.getValue());
+static void SetupPackage(rfl::scan::ScanRequest const &request,
+                         rfl::proto::Package *pkg) {
+  pkg->set_name(request.pkg_name);
+  pkg->set_version(request.pkg_version);
 
   // handle imports
-  for (vector<string>::iterator it = Imports.begin(), e = Imports.end();
-       it != e; ++it) {
+  for (std::string const &import : request.imports) {
     if (Verbose.getValue() > 1) {
-      outs() << "Adding import " << *it << "\n";
+      outs() << "Adding import " << import << "\n";
     }
-    pkg.add_imports(*it);
+    pkg->add_imports(import);
   }
 
   // handle libs
-  for (vector<string>::iterator it = Libs.begin(), e = Libs.end(); it != e;
-       ++it) {
+  for (std::string const &lib : request.libs) {
     if (Verbose.getValue() > 1) {
-      outs() << "Adding library " << *it << "\n";
+      outs() << "Adding library " << lib << "\n";
     }
-    pkg.add_libraries(*it);
+    pkg->add_libraries(lib);
   }
 
   outs().flush();
+}
 
-  unique_ptr<ScannerActionFactory> factory(new ScannerActionFactory(&scan_ctx));
-
-  int ret = tool.run(factory.get());
-  if (ret == 0) {
-    string file = OutputFile.getValue();
-
-    // Make sure that output directory exists
-    //SmallString<256> path(file);
-    //sys::path::remove_filename(path);
-    //if (sys::fs::create_directories(path, true)) {
-    //  outs() << "Unable to create directory\n";
-    //  return false;
-    //}
+// Splits |sources| to ones that need to be scanned and ones without
+// annotations (when enabled).
+static void FilterSources(std::vector<std::string> const &sources,
+                          std::vector<std::string> *scan_sources,
+                          std::vector<std::string> *skipped_sources) {
+  if (!SkipUnannotated.getValue()) {
+    *scan_sources = sources;
+    return;
+  }
 
+  for (std::string const &source : sources) {
+    if (rfl::scan::SourceHasAnnotations(source)) {
+      scan_sources->push_back(source);
+    } else {
+      skipped_sources->push_back(source);
+    }
+  }
+  if (Verbose.getValue()) {
+    outs() << "Skipped " << skipped_sources->size() << " of "
+           << sources.size() << " sources without annotations\n";
     if (Verbose.getValue() > 1) {
-      outs() << "Writing proto file " << file << "\n";
-      outs().flush();
+      for (std::string const &source : *skipped_sources) {
+        outs() << "  " << source << "\n";
+      }
     }
+    outs().flush();
+  }
+}
+
+static int WritePackage(rfl::proto::Package const &pkg,
+                        std::string const &file,
+                        rfl::scan::TimeTrace *trace = nullptr) {
+  using namespace std;
+
+  rfl::scan::TimeTraceScope scope(trace, "Serialize", file);
+
+  // Make sure that output directory exists
+  //SmallString<256> path(file);
+  //sys::path::remove_filename(path);
+  //if (sys::fs::create_directories(path, true)) {
+  //  outs() << "Unable to create directory\n";
+  //  return false;
+  //}
+
+  if (Verbose.getValue() > 1) {
+    outs() << "Writing proto file " << file << "\n";
+    outs().flush();
+  }
+
+  // Prepare output file
+  // TODO Write to temporary file. If output file already exists
+  // check for modifications and if files differ, replace it.
+  ofstream file_out;
+  file_out.open(file, ios_base::binary);
+  if (!file_out.good()) {
+    errs() << "Failed to open file " << file << " : " << strerror(errno)
+           << "\n";
+    file_out.close();
+    return 1;
+  }
 
-    // Prepare output file
-    // TODO Write to temporary file. If output file already exists
-    // check for modifications and if files differ, replace it.
-    ofstream file_out;
-    file_out.open(file, ios_base::binary);
-    if (!file_out.good()) {
-      errs() << "Failed to open file " << file << " : " << strerror(errno)
+  // write header
+  char magic[5] = {'R', 'F', 'L', rfl::kV1_PackageFormat, 0};
+  if (CompressPackage.getValue())
+    magic[3] |= rfl::kCompressed_PackageFlag;
+  file_out << magic;
+
+  // write protobuf to file
+  {
+    google::protobuf::io::OstreamOutputStream proto_out(&file_out);
+    bool written;
+    if (CompressPackage.getValue()) {
+      google::protobuf::io::GzipOutputStream gzip_out(&proto_out);
+      written = pkg.SerializeToZeroCopyStream(&gzip_out) && gzip_out.Close();
+    } else {
+      written = pkg.SerializeToZeroCopyStream(&proto_out);
+    }
+    if (!written) {
+      errs() << "Failed to write file " << file << " " << strerror(errno)
              << "\n";
       file_out.close();
       return 1;
     }
+  }
 
-    // write header
-    char magic[5] = {'R', 'F', 'L', 1, 0};
-    file_out << magic;
+  file_out.flush();
+  file_out.close();
+  return 0;
+}
 
-    // write protobuf to file
-    {
-      google::protobuf::io::OstreamOutputStream proto_out(&file_out);
-      if (!pkg.SerializeToZeroCopyStream(&proto_out)) {
-        errs() << "Failed to write file " << file << " " << strerror(errno)
-               << "\n";
-        file_out.close();
-        return 1;
-      }
+// Writes package header and lets |scan_ctx| write package files to |file|
+// as they are scanned.
+static bool OpenPackageWriter(rfl::PackageWriter *writer,
+                              rfl::scan::ScannerContext *scan_ctx,
+                              std::string const &file) {
+  if (Verbose.getValue() > 1) {
+    outs() << "Writing proto file " << file << "\n";
+    outs().flush();
+  }
+  if (!writer->Open(file, scan_ctx->package(), CompressPackage.getValue())) {
+    errs() << "Failed to open file " << file << " : " << strerror(errno)
+           << "\n";
+    return false;
+  }
+  // package files are written out, header is done
+  scan_ctx->package().Clear();
+  scan_ctx->set_package_writer(writer);
+  return true;
+}
+
+// Writes remaining package files of |scan_ctx|, the output is removed when
+// |ret| tells that scanning failed.
+static int ClosePackageWriter(rfl::PackageWriter *writer,
+                              rfl::scan::ScannerContext *scan_ctx,
+                              int ret,
+                              rfl::scan::TimeTrace *trace = nullptr) {
+  std::string file = writer->path();
+  if (ret == 0) {
+    rfl::scan::TimeTraceScope scope(trace, "Serialize", file);
+    scan_ctx->FlushPackageFiles();
+    if (scan_ctx->write_failed())
+      ret = 1;
+  }
+  if (!writer->Close() && ret == 0) {
+    errs() << "Failed to write file " << file << "\n";
+    ret = 1;
+  }
+  if (ret != 0)
+    sys::fs::remove(file);
+  return ret;
+}
+
+// Converts written package |rfl_file| to .rflm file |map_file|.
+static int WritePackageMapFile(std::string const &rfl_file,
+                               std::string const &map_file,
+                               rfl::scan::TimeTrace *trace = nullptr) {
+  rfl::scan::TimeTraceScope scope(trace, "WritePackageMap", map_file);
+  rfl::proto::Package pkg;
+  if (!rfl::ReadPackage(rfl_file, &pkg) ||
+      !rfl::package_map::WritePackageMap(pkg, map_file)) {
+    errs() << "Failed to write file " << map_file << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+static std::string EscapeDepfilePath(std::string const &path) {
+  std::string ret;
+  for (char c : path) {
+    if (c == ' ' || c == '#') {
+      ret += '\\';
+    } else if (c == '$') {
+      ret += '$';
     }
+    ret += c;
+  }
+  return ret;
+}
 
-    file_out.flush();
-    file_out.close();
+// Writes |dependencies| of |target| to |file| in Makefile syntax, so that
+// the scan is re-run when any of them changes. Files that do not exist on
+// disk (eg. in-memory translation units) are left out.
+static int WriteDepfile(std::string const &file,
+                        std::string const &target,
+                        std::set<std::string> const &dependencies) {
+  std::error_code ec;
+  raw_fd_ostream out(file, ec, sys::fs::F_Text);
+  if (ec) {
+    errs() << "Failed to open file " << file << " : " << ec.message()
+           << "\n";
+    return 1;
+  }
+
+  out << EscapeDepfilePath(AbsolutePath(target)) << ":";
+  for (std::string const &dep : dependencies) {
+    if (!sys::fs::exists(dep))
+      continue;
+    out << " \\\n  " << EscapeDepfilePath(dep);
+  }
+  out << "\n";
+  return 0;
+}
+
+int ProtoScanner(ClangTool &tool,
+                 CompilationDatabase const &cdb,
+                 rfl::scan::ScanRequest const &request,
+                 std::vector<std::string> const &all_path_list,
+                 std::vector<std::string> const &skipped_path_list,
+                 ArgumentsAdjuster const &adjuster,
+                 std::string const &executable) {
+  using namespace std;
+  using namespace rfl;
+  using namespace rfl::scan;
+
+  string basedir = NormalizedPath(request.basedir);
+  vector<string> const &source_path_list = request.sources;
+
+  ScannerContext scan_ctx(basedir, Verbose.getValue());
+  scan_ctx.set_prune_foreign_decls(PruneForeignDecls.getValue());
+  unique_ptr<TimeTrace> trace;
+  if (!TimeTraceFile.getValue().empty()) {
+    trace.reset(new TimeTrace());
+    scan_ctx.set_time_trace(trace.get());
+  }
+
+  // setup package
+  proto::Package &pkg = scan_ctx.package();
+  SetupPackage(request, &pkg);
+  scan_ctx.set_sources(all_path_list, skipped_path_list);
+  PackageWriter writer;
+  if (StreamPackage.getValue() &&
+      !OpenPackageWriter(&writer, &scan_ctx, request.output)) {
+    return 1;
+  }
+
+  int ret;
+  if (UnityScan.getValue()) {
+    // single translation unit, declarations are assigned to package files
+    // of included sources
+    vector<string> unity_sources;
+    for (string const &source : source_path_list) {
+      unity_sources.push_back(AbsolutePath(source));
+    }
+    scan_ctx.set_unity_sources(unity_sources);
+    unique_ptr<ScannerActionFactory> factory(
+        new ScannerActionFactory(&scan_ctx));
+    ret = tool.run(factory.get());
+  } else if (!CacheDir.getValue().empty() ||
+             (Jobs.getValue() > 1 && source_path_list.size() > 1)) {
+    unique_ptr<ScanCache> cache;
+    if (!CacheDir.getValue().empty()) {
+      cache.reset(new ScanCache(AbsolutePath(CacheDir.getValue()),
+                                ScannerVersion(executable)));
+    }
+    ScanPool pool(cdb, adjuster, Jobs.getValue());
+    pool.set_cache(cache.get(), ScanCacheOptions(request, basedir));
+    ret = pool.Run(source_path_list, &scan_ctx);
+    if (cache && Verbose.getValue()) {
+      outs() << "Scan cache: " << cache->hits() << " hits, "
+             << cache->misses() << " misses\n";
+      outs().flush();
+    }
+  } else {
+    unique_ptr<ScannerActionFactory> factory(
+        new ScannerActionFactory(&scan_ctx));
+    ret = tool.run(factory.get());
+  }
+
+  if (Verbose.getValue()) {
+    outs() << "Traversed " << scan_ctx.visited_decls() << " declarations, "
+           << "pruned " << scan_ctx.pruned_decls()
+           << " top-level declarations\n";
+    AnnotationCache *annotations = scan_ctx.annotation_cache();
+    outs() << "Annotation cache: " << annotations->hits() << " hits, "
+           << annotations->misses() << " misses\n";
+    outs().flush();
+  }
+
+  if (ret == 0) {
+    scan_ctx.AddSkippedSources(StringRef());
+    if (writer.is_open()) {
+      ret = ClosePackageWriter(&writer, &scan_ctx, ret, trace.get());
+    } else {
+      ret = WritePackage(pkg, request.output, trace.get());
+    }
+    if (ret == 0 && !request.map_output.empty()) {
+      ret = WritePackageMapFile(request.output, request.map_output,
+                                trace.get());
+    }
+    if (ret == 0 && !request.depfile.empty()) {
+      ret = WriteDepfile(request.depfile, request.output,
+                         scan_ctx.dependencies());
+    }
   } else {
     errs() << "Scanning failed " << ret << "\n";
     errs().flush();
+    if (writer.is_open())
+      ClosePackageWriter(&writer, &scan_ctx, ret);
+  }
+
+  if (trace && !trace->Write(TimeTraceFile.getValue()) && ret == 0) {
+    ret = 1;
   }
 
   return ret;
 }
 
+// Scans packages requested by clients until quit is received.
+// Compilation database and results of scanned translation units (with
+// hashes of their dependencies) are kept between requests, so only
+// modified sources are scanned again. So are shared preambles, until any
+// of their headers is modified. Every translation unit still uses its own
+// FileManager, since it never invalidates its stat cache.
+int ServeScanRequests(CompilationDatabase &default_cdb,
+                      ArgumentsAdjuster const &base_adjuster,
+                      std::string const &executable) {
+  using namespace std;
+  using namespace rfl;
+  using namespace rfl::scan;
+
+  string cache_dir;
+  if (!CacheDir.getValue().empty()) {
+    cache_dir = AbsolutePath(CacheDir.getValue());
+  }
+  string version = ScannerVersion(executable);
+  ScanCache cache(cache_dir, version);
+
+  // the database does not change while serving, so it's indexed once
+  shared_ptr<CompileCommandIndex const> cdb_index =
+      make_shared<CompileCommandIndex>(default_cdb);
+  PreambleMap preambles;
+  ScanServer server(Serve.getValue(), Verbose.getValue());
+  return server.Run([&](ScanRequest const &request, string *error) {
+    string basedir = NormalizedPath(
+        request.basedir.empty() ? Basedir.getValue() : request.basedir);
+    if (request.output.empty()) {
+      *error = "missing output";
+      return false;
+    }
+
+    vector<string> scan_sources;
+    vector<string> skipped_sources;
+    FilterSources(request.sources, &scan_sources, &skipped_sources);
+
+    ScanCompilationDatabase cdb(default_cdb, request.sources, cdb_index);
+    ArgumentsAdjuster adjuster = base_adjuster;
+    SharedPreamble preamble(cdb, base_adjuster, Verbose.getValue());
+    if (SharePreamble.getValue() &&
+        preamble.Build(scan_sources, cache_dir, version, &preambles)) {
+      adjuster = combineAdjusters(adjuster, preamble.GetAdjuster());
+    }
+
+    ScannerContext scan_ctx(basedir, Verbose.getValue());
+    scan_ctx.set_prune_foreign_decls(PruneForeignDecls.getValue());
+    proto::Package &pkg = scan_ctx.package();
+    SetupPackage(request, &pkg);
+    scan_ctx.set_sources(request.sources, skipped_sources);
+    PackageWriter writer;
+    if (StreamPackage.getValue() &&
+        !OpenPackageWriter(&writer, &scan_ctx, request.output)) {
+      *error = "failed to open " + request.output;
+      return false;
+    }
+
+    unsigned hits = cache.hits();
+    unsigned misses = cache.misses();
+    ScanPool pool(cdb, adjuster, Jobs.getValue());
+    pool.set_cache(&cache, ScanCacheOptions(request, basedir));
+    if (pool.Run(scan_sources, &scan_ctx) != 0) {
+      if (writer.is_open())
+        ClosePackageWriter(&writer, &scan_ctx, 1);
+      *error = "scanning failed";
+      return false;
+    }
+    if (Verbose.getValue()) {
+      outs() << "Scan cache: " << cache.hits() - hits << " hits, "
+             << cache.misses() - misses << " misses\n";
+      AnnotationCache *annotations = scan_ctx.annotation_cache();
+      outs() << "Annotation cache: " << annotations->hits() << " hits, "
+             << annotations->misses() << " misses\n";
+      outs().flush();
+    }
+
+    scan_ctx.AddSkippedSources(StringRef());
+    int ret = writer.is_open() ? ClosePackageWriter(&writer, &scan_ctx, 0)
+                               : WritePackage(pkg, request.output);
+    if (ret != 0) {
+      *error = "failed to write " + request.output;
+      return false;
+    }
+    if (!request.map_output.empty() &&
+        WritePackageMapFile(request.output, request.map_output) != 0) {
+      *error = "failed to write " + request.map_output;
+      return false;
+    }
+    if (!request.depfile.empty() &&
+        WriteDepfile(request.depfile, request.output,
+                     scan_ctx.dependencies()) != 0) {
+      *error = "failed to write " + request.depfile;
+      return false;
+    }
+    return true;
+  });
+}
+
 std::string GetExecutablePath(const char *Argv0) {
   // This just needs to be some symbol in the binary; C++ doesn't
   // allow taking the address of ::main however.
@@ -263,6 +743,7 @@ int LegacyScanner(ClangTool &tool,
 
   unique_ptr<scan::ASTScannerContext> scan_ctx(
       new scan::ASTScannerContext(package.get(), basedir, Verbose.getValue()));
+  scan_ctx->set_prune_system_decls(PruneForeignDecls.getValue());
 
   unique_ptr<scan::ASTScanActionFactory> factory(
       new scan::ASTScanActionFactory(scan_ctx.get()));
@@ -322,15 +803,43 @@ int LegacyScanner(ClangTool &tool,
   return ret;
 }
 
+// Loads compilation database of -p or the one above the first source, as
+// CommonOptionsParser does.
+static std::unique_ptr<CompilationDatabase> LoadCompilationDatabase(
+    std::vector<std::string> const &sources) {
+  std::string error;
+  std::unique_ptr<CompilationDatabase> compilations;
+  if (!BuildPath.getValue().empty()) {
+    compilations =
+        CompilationDatabase::autoDetectFromDirectory(BuildPath.getValue(),
+                                                     error);
+  } else if (!sources.empty()) {
+    compilations = CompilationDatabase::autoDetectFromSource(sources.front(),
+                                                             error);
+  } else {
+    error = "No compilation database, use -p or --";
+  }
+  if (!compilations) {
+    errs() << error << "\n";
+    errs().flush();
+  }
+  return compilations;
+}
+
 int main(int argc, char const **argv) {
   sys::PrintStackTraceOnErrorSignal(argv[0]);
 
-  CommonOptionsParser options_parser(argc, argv, RflScanCategory);
+  // flags after -- make fixed compilation database, sources are optional,
+  // these may be given by -input or by clients
+  std::unique_ptr<CompilationDatabase> compilations(
+      FixedCompilationDatabase::loadFromCommandLine(argc, argv));
+  cl::HideUnrelatedOptions(RflScanCategory);
+  cl::ParseCommandLineOptions(argc, argv);
 
   // Fill source paths from input file or command line
   std::vector<std::string> source_path_list;
   if (InputFile.getNumOccurrences() == 0) {
-    source_path_list = options_parser.getSourcePathList();
+    source_path_list = SourcePaths;
   } else {
     ErrorOr<std::unique_ptr<MemoryBuffer>> input_buffer =
         MemoryBuffer::getFile(InputFile.getValue());
@@ -347,9 +856,50 @@ int main(int argc, char const **argv) {
     }
   }
 
-  // Create compile flags DB
-  CompilationDatabase &default_cdb = options_parser.getCompilations();
-  rfl::scan::ScanCompilationDatabase cdb(default_cdb, source_path_list);
+  // Drop sources that can't contain any annotations
+  std::vector<std::string> scan_path_list;
+  std::vector<std::string> skipped_path_list;
+  FilterSources(source_path_list, &scan_path_list, &skipped_path_list);
+
+  // Create compile flags DB, JSON database of -p is parsed only when its
+  // snapshot does not have commands of all sources yet
+  std::shared_ptr<rfl::scan::CompilationDatabaseSnapshot> snapshot;
+  bool use_snapshot = false;
+  if (!compilations && !BuildPath.getValue().empty() &&
+      !CdbSnapshot.getValue().empty() && Serve.getValue().empty()) {
+    SmallString<256> json_path(BuildPath.getValue());
+    sys::path::append(json_path, "compile_commands.json");
+    snapshot = std::make_shared<rfl::scan::CompilationDatabaseSnapshot>();
+    use_snapshot = snapshot->Load(CdbSnapshot.getValue(),
+                                  std::string(json_path.begin(),
+                                              json_path.end())) &&
+                   snapshot->Covers(source_path_list);
+  }
+  std::unique_ptr<rfl::scan::ScanCompilationDatabase> scan_cdb;
+  if (use_snapshot) {
+    scan_cdb.reset(
+        new rfl::scan::ScanCompilationDatabase(snapshot, source_path_list));
+  } else {
+    if (!compilations)
+      compilations = LoadCompilationDatabase(source_path_list);
+    if (!compilations)
+      return 1;
+    scan_cdb.reset(new rfl::scan::ScanCompilationDatabase(*compilations,
+                                                          source_path_list));
+    if (snapshot)
+      scan_cdb->AddToSnapshot(snapshot.get());
+  }
+  if (snapshot && snapshot->is_modified() &&
+      !snapshot->Save(CdbSnapshot.getValue())) {
+    errs() << "Failed to save compilation database snapshot\n";
+    errs().flush();
+  }
+  if (snapshot && Verbose.getValue()) {
+    outs() << "Compilation database snapshot: " << snapshot->size()
+           << " files" << (use_snapshot ? "" : ", updated") << "\n";
+    outs().flush();
+  }
+  rfl::scan::ScanCompilationDatabase &cdb = *scan_cdb;
 
   // Determine path to clang includes
   // TODO compilation define for external/local clang headers
@@ -357,12 +907,12 @@ int main(int argc, char const **argv) {
   //sys::path::append(resource_dir, "lib", "clang", CLANG_VERSION_STRING);
 
   // Set internal / extra compilation flags
+  std::string RflScanExecutable = GetExecutablePath(argv[0]);
   CommandLineArguments extra_args;
   extra_args.push_back("-resource-dir");
   if (!ClangResourceDir.getValue().empty()) {
     extra_args.push_back(ClangResourceDir.getValue());
   } else {
-    std::string RflScanExecutable = GetExecutablePath(argv[0]);
     StringRef Dir = llvm::sys::path::parent_path(RflScanExecutable);
     SmallString<128> P(llvm::sys::path::parent_path(Dir));
     StringRef ClangLibdirSuffix(CLANG_LIBDIR_SUFFIX);
@@ -388,15 +938,79 @@ int main(int argc, char const **argv) {
     outs().flush();
   }
 
+  ArgumentsAdjuster adjuster = combineAdjusters(
+      getInsertArgumentAdjuster(ArgsBefore, ArgumentInsertPosition::BEGIN),
+      getInsertArgumentAdjuster(ArgsAfter, ArgumentInsertPosition::END));
+  adjuster = combineAdjusters(
+      adjuster,
+      getInsertArgumentAdjuster(extra_args, ArgumentInsertPosition::BEGIN));
+
+  if (!Serve.getValue().empty()) {
+    return ServeScanRequests(*compilations, adjuster, RflScanExecutable);
+  }
+
+  // Parse common headers once, unity translation unit parses them once anyway
+  rfl::scan::SharedPreamble preamble(cdb, adjuster, Verbose.getValue());
+  if (SharePreamble.getValue() && !UnityScan.getValue()) {
+    // executable is hashed only when the PCH may come from the cache
+    std::string cache_dir;
+    std::string version;
+    if (!CacheDir.getValue().empty()) {
+      cache_dir = AbsolutePath(CacheDir.getValue());
+      version = ScannerVersion(RflScanExecutable);
+    }
+    if (preamble.Build(scan_path_list, cache_dir, version)) {
+      adjuster = combineAdjusters(adjuster, preamble.GetAdjuster());
+    }
+  }
+
+  // In unity mode all sources are included by a single in-memory translation
+  // unit, so that common headers are parsed only once
+  std::vector<std::string> tool_sources = scan_path_list;
+  std::string unity_file;
+  std::string unity_content;
+  if (UnityScan.getValue() && !scan_path_list.empty()) {
+    unity_file = UnitySourcePath(scan_path_list);
+    unity_content = UnitySourceContent(scan_path_list);
+    tool_sources.assign(1, unity_file);
+    if (Verbose.getValue() > 1) {
+      outs() << "Unity translation unit " << unity_file << ":\n"
+             << unity_content;
+      outs().flush();
+    }
+  }
+
   // Create ClangTool
-  ClangTool tool(cdb, source_path_list);
+  ClangTool tool(cdb, tool_sources);
   tool.clearArgumentsAdjusters();
-  tool.appendArgumentsAdjuster(
-      getInsertArgumentAdjuster(extra_args, ArgumentInsertPosition::BEGIN));
+  tool.appendArgumentsAdjuster(adjuster);
+  if (!unity_file.empty()) {
+    tool.mapVirtualFile(unity_file, unity_content);
+  }
 
   if (GenerateProto.getValue()) {
-    return ProtoScanner(tool);
+    rfl::scan::ScanRequest request;
+    request.basedir = Basedir.getValue();
+    request.pkg_name = PackageName.getValue();
+    request.pkg_version = PackageVersion.getValue();
+    request.output = OutputFile.getValue();
+    request.depfile = DepFile.getValue();
+    request.map_output = MapFile.getValue();
+    request.imports.assign(Imports.begin(), Imports.end());
+    request.libs.assign(Libs.begin(), Libs.end());
+    request.sources = scan_path_list;
+    return ProtoScanner(tool, cdb, request, source_path_list,
+                        skipped_path_list, adjuster, RflScanExecutable);
   } else {
+    if (Jobs.getValue() > 1 && Verbose.getValue()) {
+      outs() << "Legacy scanner does not support parallel scanning\n";
+      outs().flush();
+    }
+    if (!DepFile.getValue().empty()) {
+      errs() << "Legacy scanner does not support -depfile\n";
+      errs().flush();
+    }
+    // package files are created for all sources, including skipped ones
     return LegacyScanner(tool, source_path_list);
   }
 }
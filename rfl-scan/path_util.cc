@@ -0,0 +1,67 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/path_util.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+namespace rfl {
+namespace scan {
+
+std::string PathRelativeToBaseDir(StringRef filename, StringRef basedir) {
+  SmallString<256> path(filename.begin(), filename.end());
+  sys::fs::make_absolute(path);
+  SmallVector<StringRef,16> components;
+  SmallVector<StringRef, 16>::iterator comp_it = components.begin();
+  for (sys::path::const_iterator path_it = sys::path::begin(path);
+       path_it != sys::path::end(path); ++path_it) {
+    StringRef component = *path_it;
+    if (component.size() > 0 && component[0] == '.') {
+        if (component.size() == 2 && comp_it > components.begin()){
+          --comp_it;
+        }
+    } else {
+      if (!component.empty())
+        components.insert(comp_it++, component);
+    }
+  }
+  components.resize(comp_it - components.begin());
+
+  SmallString<256> full_path;
+  SmallVector<StringRef, 16>::const_iterator it = components.begin();
+  if (it != components.end()) {
+    ++it;
+  }
+  for (; it != components.end(); ++it) {
+    StringRef comp = *it;
+    full_path.append(sys::path::get_separator());
+    full_path.append(comp.begin(), comp.end());
+  }
+
+  StringRef path_str = full_path.str();
+  if (path_str.size() > basedir.size() && path_str.startswith(basedir)) {
+    path_str = path_str.substr(basedir.size(), path_str.size());
+  }
+  return path_str.str();
+}
+
+std::string PathCache::RelativeToBaseDir(StringRef filename) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StringMap<std::string>::const_iterator it = paths_.find(filename);
+    if (it != paths_.end())
+      return it->second;
+  }
+
+  std::string path = PathRelativeToBaseDir(filename, basedir_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  paths_[filename] = path;
+  return path;
+}
+
+} // namespace scan
+} // namespace rfl
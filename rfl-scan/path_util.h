@@ -0,0 +1,43 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_PATH_UTIL_H__
+#define __RFL_SCAN_PATH_UTIL_H__
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <mutex>
+#include <string>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+
+// Returns absolute, normalized |filename| with |basedir| prefix removed.
+std::string PathRelativeToBaseDir(StringRef filename, StringRef basedir);
+
+// Memoized PathRelativeToBaseDir() of a single basedir, shared by all
+// translation units of a scan.
+class PathCache {
+public:
+  explicit PathCache(std::string const &basedir) : basedir_(basedir) {}
+
+  std::string const &basedir() const { return basedir_; }
+
+  // |filename| has to be absolute, relative ones depend on working
+  // directory, which differs between translation units.
+  std::string RelativeToBaseDir(StringRef filename);
+
+private:
+  std::string basedir_;
+  std::mutex mutex_;
+  StringMap<std::string> paths_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_PATH_UTIL_H__ */
@@ -0,0 +1,423 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/preamble.h"
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/Tooling.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <tuple>
+
+namespace rfl {
+namespace scan {
+
+using namespace clang;
+
+namespace {
+
+std::string NormalizedAbsolutePath(StringRef directory, StringRef path) {
+  SmallString<256> abs_path(path);
+  if (!sys::path::is_absolute(abs_path)) {
+    abs_path = directory;
+    sys::path::append(abs_path, path);
+  }
+  sys::fs::make_absolute(abs_path);
+  sys::path::remove_dots(abs_path, true);
+  return abs_path.str();
+}
+
+// Removes arguments that differ between sources compiled with the same
+// flags, ie. program name, input, output and language of the input.
+CommandLineArguments NormalizeCommand(CommandLineArguments const &args,
+                                      StringRef directory,
+                                      StringRef file) {
+  std::string abs_file = NormalizedAbsolutePath(directory, file);
+  CommandLineArguments ret;
+  for (size_t i = 1; i < args.size(); ++i) {
+    StringRef arg(args[i]);
+    if (arg == "-o" || arg == "-x" || arg == "-include-pch") {
+      ++i;
+    } else if (arg == "-c" || arg == "-fsyntax-only") {
+      continue;
+    } else if (!arg.startswith("-") &&
+               NormalizedAbsolutePath(directory, arg) == abs_file) {
+      continue;
+    } else {
+      ret.push_back(args[i]);
+    }
+  }
+  return ret;
+}
+
+class PreambleAction : public GeneratePCHAction {
+public:
+  PreambleAction(std::string const &output, std::set<std::string> *files)
+      : output_(output), files_(files) {}
+
+protected:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    CI.getFrontendOpts().OutputFile = output_;
+    return GeneratePCHAction::CreateASTConsumer(CI, InFile);
+  }
+
+  void EndSourceFileAction() override {
+    SourceManager &src_manager = getCompilerInstance().getSourceManager();
+    for (SourceManager::fileinfo_iterator it = src_manager.fileinfo_begin();
+         it != src_manager.fileinfo_end(); ++it) {
+      files_->insert(NormalizedAbsolutePath(StringRef(), it->first->getName()));
+    }
+    GeneratePCHAction::EndSourceFileAction();
+  }
+
+private:
+  std::string output_;
+  std::set<std::string> *files_;
+};
+
+class PreambleActionFactory : public FrontendActionFactory {
+public:
+  PreambleActionFactory(std::string const &output,
+                        std::set<std::string> *files)
+      : output_(output), files_(files) {}
+
+  clang::FrontendAction *create() override {
+    return new PreambleAction(output_, files_);
+  }
+
+private:
+  std::string output_;
+  std::set<std::string> *files_;
+};
+
+char const kPreambleFile[] = "__rfl_preamble__.h";
+
+// Returns PCH stored in cache when it's up to date.
+std::shared_ptr<PreamblePch> LoadCachedPch(std::string const &pch_path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+      MemoryBuffer::getFile(pch_path + ".files");
+  if (!buffer)
+    return nullptr;
+
+  std::shared_ptr<PreamblePch> pch =
+      std::make_shared<PreamblePch>(pch_path, false);
+  std::set<std::string> *files = pch->mutable_files();
+  for (line_iterator it(*buffer.get()); !it.is_at_end(); ++it) {
+    files->insert(*it);
+  }
+  if (!pch->IsUpToDate())
+    return nullptr;
+  return pch;
+}
+
+}  // namespace
+
+std::vector<std::string> ParseIncludePrefix(StringRef content) {
+  std::vector<std::string> includes;
+  std::string guard;
+  bool in_comment = false;
+  while (!content.empty()) {
+    StringRef line;
+    std::tie(line, content) = content.split('\n');
+    line = line.trim();
+
+    if (in_comment) {
+      size_t end = line.find("*/");
+      if (end == StringRef::npos)
+        continue;
+      in_comment = false;
+      line = line.substr(end + 2).trim();
+    }
+    if (line.startswith("/*")) {
+      size_t end = line.find("*/", 2);
+      if (end == StringRef::npos) {
+        in_comment = true;
+        continue;
+      }
+      line = line.substr(end + 2).trim();
+    }
+    if (line.empty() || line.startswith("//"))
+      continue;
+    if (!line.startswith("#"))
+      break;
+
+    StringRef directive = line.substr(1).ltrim();
+    StringRef name = directive.substr(0, directive.find_first_of(" \t<\""));
+    StringRef operand = directive.substr(name.size()).trim();
+    size_t comment = operand.find("//");
+    if (comment != StringRef::npos)
+      operand = operand.substr(0, comment).rtrim();
+
+    if (name == "pragma" && operand == "once")
+      continue;
+    if (name == "ifndef" && includes.empty() && guard.empty()) {
+      guard = operand.str();
+      continue;
+    }
+    if (name == "define" && !guard.empty() && operand == guard) {
+      continue;
+    }
+    if (name != "include" || operand.size() < 2 ||
+        !((operand.front() == '<' && operand.back() == '>') ||
+          (operand.front() == '"' && operand.back() == '"'))) {
+      break;
+    }
+    includes.push_back(operand.str());
+  }
+  return includes;
+}
+
+PreamblePch::~PreamblePch() {
+  if (temporary_) {
+    sys::fs::remove(path_);
+  }
+}
+
+bool PreamblePch::IsUpToDate() const {
+  sys::fs::file_status pch_status;
+  if (sys::fs::status(path_, pch_status))
+    return false;
+
+  for (std::string const &file : files_) {
+    sys::fs::file_status status;
+    if (sys::fs::status(file, status) ||
+        pch_status.getLastModificationTime() <
+            status.getLastModificationTime()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+SharedPreamble::SharedPreamble(CompilationDatabase const &cdb,
+                               ArgumentsAdjuster const &adjuster,
+                               unsigned verbose)
+    : compilation_db_(cdb),
+      adjuster_(adjuster),
+      verbose_(verbose) {
+}
+
+bool SharedPreamble::Build(std::vector<std::string> const &sources,
+                           std::string const &cache_dir,
+                           std::string const &version,
+                           PreambleMap *built) {
+  if (sources.size() < 2)
+    return false;
+
+  // use flags of first source, other sources must match them
+  if (!GetCommand(sources.front(), &directory_, &command_))
+    return false;
+
+  bool first = true;
+  std::string source_dir;
+  sources_.clear();
+  for (std::string const &source : sources) {
+    std::string directory;
+    CommandLineArguments command;
+    if (!GetCommand(source, &directory, &command) || directory != directory_ ||
+        command != command_) {
+      continue;
+    }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(source);
+    if (!buffer)
+      continue;
+
+    std::vector<std::string> includes =
+        ParseIncludePrefix(buffer.get()->getBuffer());
+    std::string abs_source = NormalizedAbsolutePath(directory, source);
+    std::string dir = sys::path::parent_path(abs_source);
+    if (first) {
+      includes_ = includes;
+      source_dir = dir;
+      first = false;
+    } else {
+      size_t common = 0;
+      while (common < includes_.size() && common < includes.size() &&
+             includes_[common] == includes[common]) {
+        ++common;
+      }
+      // quoted includes are searched relative to the including file first,
+      // so these can be shared only by sources in the same directory
+      if (dir != source_dir) {
+        for (size_t i = 0; i < common; ++i) {
+          if (includes_[i][0] == '"') {
+            common = i;
+            break;
+          }
+        }
+      }
+      includes_.resize(common);
+    }
+    sources_.insert(abs_source);
+  }
+
+  if (includes_.empty() || sources_.size() < 2)
+    return false;
+
+  std::string content;
+  for (std::string const &include : includes_) {
+    content += "#include " + include + "\n";
+  }
+
+  MD5 hash;
+  hash.update(StringRef(version.c_str(), version.size() + 1));
+  hash.update(StringRef(directory_.c_str(), directory_.size() + 1));
+  hash.update(StringRef(source_dir.c_str(), source_dir.size() + 1));
+  for (std::string const &arg : command_) {
+    hash.update(StringRef(arg.c_str(), arg.size() + 1));
+  }
+  hash.update(content);
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+
+  if (built) {
+    PreambleMap::const_iterator it = built->find(hex.str());
+    if (it != built->end() && it->second->IsUpToDate()) {
+      if (verbose_) {
+        outs() << "Using preamble " << it->second->path() << "\n";
+      }
+      SetPch(it->second);
+      return true;
+    }
+  }
+
+  std::shared_ptr<PreamblePch> pch;
+  if (cache_dir.empty()) {
+    SmallString<256> temp_path;
+    if (sys::fs::createTemporaryFile("rfl-preamble", "pch", temp_path))
+      return false;
+    pch = std::make_shared<PreamblePch>(temp_path.str(), true);
+  } else {
+    SmallString<256> path(cache_dir);
+    sys::path::append(path, "preamble-" + hex.str() + ".pch");
+    pch = LoadCachedPch(path.str());
+    if (pch) {
+      if (verbose_) {
+        outs() << "Using cached preamble " << pch->path() << "\n";
+      }
+      SetPch(pch);
+      if (built)
+        (*built)[hex.str()] = pch;
+      return true;
+    }
+    if (sys::fs::create_directories(cache_dir))
+      return false;
+    pch = std::make_shared<PreamblePch>(path.str(), false);
+  }
+
+  if (verbose_) {
+    outs() << "Building preamble of " << includes_.size()
+           << " includes shared by " << sources_.size() << " sources\n";
+    if (verbose_ > 1) {
+      outs() << content;
+    }
+    outs().flush();
+  }
+
+  SmallString<256> preamble_file(source_dir);
+  sys::path::append(preamble_file, kPreambleFile);
+
+  CommandLineArguments args;
+  args.push_back("-x");
+  args.push_back("c++-header");
+  args.insert(args.end(), command_.begin(), command_.end());
+  FixedCompilationDatabase db(directory_, args);
+  ClangTool tool(db, std::vector<std::string>(1, preamble_file.str()));
+  tool.mapVirtualFile(preamble_file, content);
+
+  // write to temporary file first, concurrent scans may share cache
+  std::string output = pch->path();
+  if (!cache_dir.empty()) {
+    SmallString<256> temp_path;
+    if (sys::fs::createUniqueFile(pch->path() + "-%%%%%%.tmp", temp_path))
+      return false;
+    output = temp_path.str();
+  }
+
+  std::set<std::string> *files = pch->mutable_files();
+  PreambleActionFactory factory(output, files);
+  if (tool.run(&factory) != 0) {
+    errs() << "Failed to build preamble, scanning without it\n";
+    sys::fs::remove(output);
+    return false;
+  }
+  files->erase(preamble_file.str());
+
+  if (!cache_dir.empty()) {
+    std::string files_path = pch->path() + ".files";
+    std::error_code ec;
+    {
+      raw_fd_ostream out(files_path + ".tmp", ec, sys::fs::F_Text);
+      if (!ec) {
+        for (std::string const &file : *files) {
+          out << file << "\n";
+        }
+      }
+    }
+    if (ec || sys::fs::rename(output, pch->path()) ||
+        sys::fs::rename(files_path + ".tmp", files_path)) {
+      sys::fs::remove(output);
+      return false;
+    }
+  }
+  SetPch(pch);
+  if (built)
+    (*built)[hex.str()] = pch;
+  return true;
+}
+
+ArgumentsAdjuster SharedPreamble::GetAdjuster() const {
+  return [this](CommandLineArguments const &args, StringRef file) {
+    if (!Applies(args, file))
+      return args;
+    CommandLineArguments ret(args);
+    ret.insert(ret.begin() + 1, pch_path_);
+    ret.insert(ret.begin() + 1, "-include-pch");
+    return ret;
+  };
+}
+
+bool SharedPreamble::Applies(CommandLineArguments const &args,
+                             StringRef file) const {
+  if (pch_path_.empty() || args.empty())
+    return false;
+  // accepted sources are compiled with the flags of the preamble, headers
+  // in the PCH would be skipped by their include guards
+  std::string abs_file = NormalizedAbsolutePath(directory_, file);
+  return sources_.count(abs_file) && !pch_->files().count(abs_file);
+}
+
+bool SharedPreamble::GetCommand(std::string const &source,
+                                std::string *directory,
+                                CommandLineArguments *command) const {
+  std::vector<CompileCommand> commands =
+      compilation_db_.getCompileCommands(source);
+  if (commands.size() != 1)
+    return false;
+  *directory = commands.front().Directory;
+  *command = NormalizeCommand(adjuster_(commands.front().CommandLine, source),
+                              *directory, source);
+  return true;
+}
+
+void SharedPreamble::SetPch(std::shared_ptr<PreamblePch> const &pch) {
+  pch_ = pch;
+  pch_path_ = pch->path();
+}
+
+} // namespace scan
+} // namespace rfl
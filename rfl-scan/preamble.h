@@ -0,0 +1,102 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_PREAMBLE_H__
+#define __RFL_SCAN_PREAMBLE_H__
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+using namespace clang::tooling;
+
+// Returns leading #include directives of |content|. Comments, include guard
+// and #pragma once are skipped, any other code ends the prefix.
+std::vector<std::string> ParseIncludePrefix(StringRef content);
+
+// PCH file of a preamble with headers it contains. Temporary file is removed
+// along with the last reference.
+class PreamblePch {
+public:
+  PreamblePch(std::string const &path, bool temporary)
+      : path_(path), temporary_(temporary) {}
+  ~PreamblePch();
+
+  std::string const &path() const { return path_; }
+
+  std::set<std::string> const &files() const { return files_; }
+  std::set<std::string> *mutable_files() { return &files_; }
+
+  // Returns false when the PCH is missing or any of its headers was modified
+  // after it was built.
+  bool IsUpToDate() const;
+
+private:
+  std::string path_;
+  bool temporary_;
+  std::set<std::string> files_;
+};
+
+// PCHs built by a long running process (see -serve), by hash of flags and
+// includes of their preambles.
+typedef std::map<std::string, std::shared_ptr<PreamblePch>> PreambleMap;
+
+// Precompiled header built from #include prefix shared by package sources.
+// Sources compiled with the same flags are then scanned with -include-pch,
+// so that common headers are parsed only once.
+class SharedPreamble {
+public:
+  SharedPreamble(CompilationDatabase const &cdb,
+                 ArgumentsAdjuster const &adjuster,
+                 unsigned verbose);
+
+  // Builds preamble of |sources|. When |cache_dir| is set, the PCH is stored
+  // there and reused by next invocations until any of its headers changes,
+  // otherwise temporary file is used. |version| identifies the scanner.
+  // PCHs in |built| are reused the same way, newly built ones are added.
+  // Returns false when sources have no common prefix or building failed.
+  bool Build(std::vector<std::string> const &sources,
+             std::string const &cache_dir,
+             std::string const &version,
+             PreambleMap *built = nullptr);
+
+  // Returns adjuster that adds the preamble to commands of sources accepted
+  // by Build(). The preamble must outlive the adjuster.
+  ArgumentsAdjuster GetAdjuster() const;
+
+  std::vector<std::string> const &includes() const { return includes_; }
+  std::string const &pch_path() const { return pch_path_; }
+
+private:
+  bool Applies(CommandLineArguments const &args, StringRef file) const;
+  bool GetCommand(std::string const &source,
+                  std::string *directory,
+                  CommandLineArguments *command) const;
+  void SetPch(std::shared_ptr<PreamblePch> const &pch);
+
+  CompilationDatabase const &compilation_db_;
+  ArgumentsAdjuster adjuster_;
+  unsigned verbose_;
+  std::vector<std::string> includes_;
+  std::string directory_;
+  CommandLineArguments command_;
+  std::string pch_path_;
+  std::shared_ptr<PreamblePch> pch_;
+  // normalized sources sharing the preamble, compiled with |command_|
+  std::set<std::string> sources_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_PREAMBLE_H__ */
@@ -4,8 +4,10 @@
 
 #include "proto_ast_scan.h"
 
+#include "rfl/package_types.h"
 #include "rfl/reflected.h"
 #include "rfl-scan/annotation_parser.h"
+#include "rfl-scan/path_util.h"
 
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/AST/RecordLayout.h"
@@ -27,90 +29,290 @@ namespace scan {
 
 namespace {
 
-struct AnnoInserter {
-  AnnoInserter(proto::Annotation *anno) : anno_(anno) {}
+// Adds time spent in the scope to |total|. Nested scopes sharing |depth| are
+// counted once.
+class ScopedTimeAccumulator {
+public:
+  ScopedTimeAccumulator(bool enabled,
+                        TimeTrace::Clock::duration *total,
+                        unsigned *depth)
+      : total_(total), depth_(enabled ? depth : nullptr) {
+    if (depth_ && (*depth_)++ == 0)
+      start_ = TimeTrace::Clock::now();
+  }
+  ~ScopedTimeAccumulator() {
+    if (depth_ && --*depth_ == 0)
+      *total_ += TimeTrace::Clock::now() - start_;
+  }
+
+private:
+  TimeTrace::Clock::duration *total_;
+  unsigned *depth_;
+  TimeTrace::Clock::time_point start_;
+};
 
-  void operator()(std::string const &key, std::string const &value) const {
-    proto::Annotation_Entry *entry = anno_->add_entries();
-    entry->set_key(key);
-    entry->set_value(value);
+static void ShiftClassOrder(proto::Class *klass, unsigned offset) {
+  klass->set_order(klass->order() + offset);
+  for (int i = 0; i < klass->classes_size(); ++i) {
+    ShiftClassOrder(klass->mutable_classes(i), offset);
   }
+}
 
-  proto::Annotation *anno_;
-};
+static void ShiftClassOrder(proto::Namespace *ns, unsigned offset) {
+  for (int i = 0; i < ns->classes_size(); ++i) {
+    ShiftClassOrder(ns->mutable_classes(i), offset);
+  }
+  for (int i = 0; i < ns->namespaces_size(); ++i) {
+    ShiftClassOrder(ns->mutable_namespaces(i), offset);
+  }
+}
+
+} // namespace
 
-struct AnnoDebugPrinter {
-  void operator()(std::string const &key, std::string const &value) const {
-    outs() << "  " << key << " : " << value << "\n";
+std::unique_ptr<ScannerContext> ScannerContext::CreateFragment() const {
+  std::unique_ptr<ScannerContext> fragment =
+      make_unique<ScannerContext>(basedir_, verbose_);
+  fragment->set_prune_foreign_decls(prune_foreign_decls_);
+  fragment->set_time_trace(time_trace_);
+  fragment->set_path_cache(path_cache_);
+  fragment->annotation_cache_ = annotation_cache_;
+  return fragment;
+}
+
+void ScannerContext::set_sources(std::vector<std::string> const &sources,
+                                 std::vector<std::string> const &skipped) {
+  std::set<std::string> skipped_set(skipped.begin(), skipped.end());
+  sources_.clear();
+  for (std::string const &source : sources) {
+    sources_.push_back(std::make_pair(PathRelativeToBaseDir(source, ""),
+                                      skipped_set.count(source) != 0));
   }
-};
+  next_source_ = 0;
+}
 
-static std::string PathRelativeToBaseDir(SourceLocation const &source_loc,
-                                         SourceManager const &src_manager,
-                                         StringRef const &basedir) {
-
-  PresumedLoc presumed_loc = src_manager.getPresumedLoc(source_loc, false);
-  StringRef hfile(presumed_loc.getFilename());
-  SmallString<256> path(hfile.begin(), hfile.end());
-  sys::fs::make_absolute(path);
-  SmallVector<StringRef,16> components;
-  SmallVector<StringRef, 16>::iterator comp_it = components.begin();
-  for (sys::path::const_iterator path_it = sys::path::begin(path);
-       path_it != sys::path::end(path); ++path_it) {
-    StringRef component = *path_it;
-    if (component.size() > 0 && component[0] == '.') {
-        if (component.size() == 2 && comp_it > components.begin()){
-          --comp_it;
-        }
-    } else {
-      if (!component.empty())
-        components.insert(comp_it++, component);
+void ScannerContext::AddSkippedSources(StringRef source) {
+  size_t end = sources_.size();
+  if (!source.empty()) {
+    std::string path = PathRelativeToBaseDir(source, "");
+    for (end = next_source_; end < sources_.size(); ++end) {
+      if (!sources_[end].second && sources_[end].first == path)
+        break;
     }
+    if (end == sources_.size())
+      return;
+    // the scanned source itself is done too
+    ++end;
+  }
+  for (; next_source_ < end; ++next_source_) {
+    if (!sources_[next_source_].second)
+      continue;
+    proto::PackageFile *pkg_file = package_.add_package_files();
+    pkg_file->set_name(
+        PathRelativeToBaseDir(sources_[next_source_].first, basedir_));
   }
-  components.resize(comp_it - components.begin());
+}
 
-  SmallString<256> full_path;
-  SmallVector<StringRef, 16>::const_iterator it = components.begin();
-  if (it != components.end()) {
-    ++it;
-  }
-  for (; it != components.end(); ++it) {
-    StringRef comp = *it;
-    full_path.append(sys::path::get_separator());
-    full_path.append(comp.begin(), comp.end());
+void ScannerContext::Merge(ScannerContext *fragment) {
+  unsigned offset = class_count();
+  proto::Package *pkg = &fragment->package();
+
+  // messages are moved, fragment packages are usually as large as the
+  // result and copying them doubles peak memory
+  int file_count = pkg->package_files_size();
+  std::vector<proto::PackageFile *> files(file_count);
+  if (file_count > 0)
+    pkg->mutable_package_files()->ExtractSubrange(0, file_count, &files[0]);
+  package_.mutable_package_files()->Reserve(package_.package_files_size() +
+                                            file_count);
+
+  // fragment types are added to this table, type indices of its files
+  // are fixed up accordingly
+  std::vector<uint32> type_indices(pkg->types_size());
+  for (int i = 0; i < pkg->types_size(); ++i) {
+    type_indices[i] = AddType(pkg->types(i));
+  }
+  for (proto::PackageFile *file : files) {
+    if (!type_indices.empty())
+      RemapTypeIndices(type_indices, file);
+    for (int j = 0; j < file->classes_size(); ++j) {
+      ShiftClassOrder(file->mutable_classes(j), offset);
+    }
+    for (int j = 0; j < file->namespaces_size(); ++j) {
+      ShiftClassOrder(file->mutable_namespaces(j), offset);
+    }
+    package_.mutable_package_files()->AddAllocated(file);
   }
 
-  StringRef path_str = full_path.str();
-  if (path_str.size() > basedir.size() && path_str.startswith(basedir)) {
-    path_str = path_str.substr(basedir.size(), path_str.size());
+  int provided_count = pkg->provided_classes_size();
+  std::vector<std::string *> classes(provided_count);
+  if (provided_count > 0) {
+    pkg->mutable_provided_classes()->ExtractSubrange(0, provided_count,
+                                                     &classes[0]);
+  }
+  for (std::string *name : classes) {
+    package_.mutable_provided_classes()->AddAllocated(name);
   }
-  return path_str.str();
+
+  dependencies_.insert(fragment->dependencies().begin(),
+                       fragment->dependencies().end());
+  AddDeclStats(fragment->visited_decls(), fragment->pruned_decls());
+  set_class_count(offset + fragment->class_count());
 }
 
-} // namespace
+void ScannerContext::FlushPackageFiles() {
+  if (!package_writer_ || package_.package_files_size() == 0)
+    return;
+  proto::Package record;
+  // types stay in the table to be found by later translation units, only
+  // the ones added since the last record are written
+  for (int i = flushed_types_; i < package_.types_size(); ++i) {
+    record.add_types()->CopyFrom(package_.types(i));
+  }
+  flushed_types_ = package_.types_size();
+  record.mutable_package_files()->Swap(package_.mutable_package_files());
+  record.mutable_provided_classes()->Swap(
+      package_.mutable_provided_classes());
+  if (!package_writer_->WriteRecord(record) && !write_failed_) {
+    errs() << "Failed to write file " << package_writer_->path() << "\n";
+    write_failed_ = true;
+  }
+}
 
 Scanner::Scanner(ScannerContext *scan_ctx, raw_ostream *out)
     : scanner_context_(scan_ctx),
       context_(nullptr),
       out_(out ? *out : outs()),
-      current_file_(nullptr) {}
+      current_file_(nullptr),
+      visited_decls_(0),
+      annotation_time_(0),
+      read_type_time_(0),
+      read_type_depth_(0),
+      annotation_parser_(annotation_allocator_) {}
+
+void Scanner::Initialize(ASTContext &Context) {
+  if (time_trace())
+    frontend_start_ = TimeTrace::Clock::now();
+}
 
 void Scanner::HandleTranslationUnit(ASTContext &Context) {
   TranslationUnitDecl *D = Context.getTranslationUnitDecl();
   context_ = &Context;
 
-  FileID main_id = src_manager().getMainFileID();
-  current_file_location_ = src_manager().getLocForStartOfFile(main_id);
-  std::string file_location =
-      PathRelativeToBaseDir(current_file_location_, src_manager(), basedir());
-  current_file_ = package().add_package_files();
-  current_file_->set_name(file_location);
+  owned_files_.clear();
+  relative_paths_.clear();
+  // translation units scanned in parallel have their working directory set
+  // by file manager, the process one is shared
+  working_dir_ = src_manager().getFileManager().getFileSystemOpts().WorkingDir;
+  if (working_dir_.empty())
+    sys::fs::current_path(working_dir_);
+  std::vector<std::string> const &unity_sources =
+      scanner_context_->unity_sources();
+  if (unity_sources.empty()) {
+    FileID main_id = src_manager().getMainFileID();
+    StringRef main_name = src_manager().getFileEntryForID(main_id)->getName();
+    SmallString<256> main_path(main_name);
+    if (!sys::path::is_absolute(main_path)) {
+      main_path = working_dir_;
+      sys::path::append(main_path, main_name);
+    }
+    scanner_context_->AddSkippedSources(main_path);
+    AddOwnedFile(main_id);
+  } else {
+    FileManager &file_manager = src_manager().getFileManager();
+    for (std::string const &source : unity_sources) {
+      FileEntry const *entry = file_manager.getFile(source);
+      FileID file_id = entry ? src_manager().translateFile(entry) : FileID();
+      if (file_id.isInvalid()) {
+        errs() << "Source " << source << " not found in translation unit\n";
+        continue;
+      }
+      scanner_context_->AddSkippedSources(source);
+      AddOwnedFile(file_id);
+    }
+  }
+  current_file_ = nullptr;
+
+  // preprocessing, parsing and semantic analysis are interleaved, so these
+  // are reported as a single phase
+  TimeTrace *trace = time_trace();
+  std::string main_file;
+  TimeTrace::Clock::time_point traverse_start;
+  if (trace) {
+    main_file = src_manager()
+                    .getFileEntryForID(src_manager().getMainFileID())
+                    ->getName();
+    traverse_start = TimeTrace::Clock::now();
+    trace->AddEvent("Frontend", main_file, frontend_start_,
+                    traverse_start - frontend_start_);
+    annotation_time_ = TimeTrace::Clock::duration(0);
+    read_type_time_ = TimeTrace::Clock::duration(0);
+  }
+
+  visited_decls_ = 0;
+  unsigned pruned_decls = 0;
+  if (scanner_context_->prune_foreign_decls()) {
+    // declarations of other files can't be reflected, so included headers
+    // are not traversed at all
+    for (Decl *decl : D->decls()) {
+      if (!FileForLocation(decl->getLocation())) {
+        ++pruned_decls;
+        continue;
+      }
+      TraverseDecl(decl);
+    }
+  } else {
+    TraverseDecl(D);
+  }
+  scanner_context_->AddDeclStats(visited_decls_, pruned_decls);
+
+  if (trace) {
+    // annotation parsing and type reading are spread over the traversal,
+    // their totals are reported as sub-events starting with it
+    trace->AddEvent("Traverse", main_file, traverse_start,
+                    TimeTrace::Clock::now() - traverse_start);
+    trace->AddEvent("Annotations", main_file, traverse_start,
+                    annotation_time_);
+    trace->AddEvent("ReadType", main_file, traverse_start, read_type_time_);
+  }
+
+  AddDependencies();
+  scanner_context_->FlushPackageFiles();
+}
+
+bool Scanner::TraverseDecl(Decl *D) {
+  ++visited_decls_;
+  return Base::TraverseDecl(D);
+}
+
+void Scanner::AddDependencies() {
+  // all files known to file manager, including inputs of precompiled headers
+  SmallVector<FileEntry const *, 64> files;
+  src_manager().getFileManager().GetUniqueIDMapping(files);
+  for (FileEntry const *file : files) {
+    if (!file)
+      continue;
+    SmallString<256> path(file->getName());
+    if (!sys::path::is_absolute(path)) {
+      path = working_dir_;
+      sys::path::append(path, file->getName());
+    }
+    sys::path::remove_dots(path, true);
+    scanner_context_->AddDependency(path.str());
+  }
+}
+
+void Scanner::AddOwnedFile(FileID file_id) {
+  SourceLocation location = src_manager().getLocForStartOfFile(file_id);
+  proto::PackageFile *file = package().add_package_files();
+  file->set_name(RelativePath(location));
+  OwnedFile owned = {location, src_manager().getLocForEndOfFile(file_id),
+                     file};
+  owned_files_.push_back(owned);
   if (verbose()) {
-    outs() << "Translation unit: ";
-    current_file_location_.print(outs(), src_manager());
-    outs() << "\n";
+    out_ << "Translation unit: ";
+    location.print(out_, src_manager());
+    out_ << "\n";
   }
-  Base::TraverseDecl(D);
 }
 
 SourceManager const &Scanner::src_manager() const {
@@ -119,8 +321,8 @@ SourceManager const &Scanner::src_manager() const {
 
 void Scanner::LogDecl(NamedDecl *D) const {
   if (verbose()) {
-    D->getLocation().print(outs(), src_manager());
-    outs() << " : ";
+    D->getLocation().print(out_, src_manager());
+    out_ << " : ";
     PrintingPolicy policy(context_->getLangOpts());
     policy.SuppressUnwrittenScope = true;
     if (verbose() < 3) {
@@ -130,9 +332,9 @@ void Scanner::LogDecl(NamedDecl *D) const {
     if (verbose() < 2) {
       policy.SuppressScope = true;
     }
-    D->print(outs(), policy);
-    outs() << "\n";
-    outs().flush();
+    D->print(out_, policy);
+    out_ << "\n";
+    out_.flush();
   }
 }
 
@@ -156,35 +358,48 @@ bool Scanner::ReadAnnotation(NamedDecl *D, proto::Annotation *anno) {
 
   SourceLocation location = attribute->getLocation();
   if (verbose() > 2) {
-    location.print(outs(), src_manager());
-    outs() << " | annotation: '" << attribute_text << "'\n";
-    outs().flush();
-  }
-
-  std::string err_msg;
-  std::unique_ptr<AnnotationParser> parser =
-    AnnotationParser::loadFromBuffer(attribute_text, err_msg);
-  if (parser == nullptr) {
+    location.print(out_, src_manager());
+    out_ << " | annotation: '" << attribute_text << "'\n";
+    out_.flush();
+  }
+
+  unsigned depth = 0;
+  ScopedTimeAccumulator timer(time_trace() != nullptr, &annotation_time_,
+                              &depth);
+  AnnotationCache *cache = scanner_context_->annotation_cache();
+  std::shared_ptr<ParsedAnnotation const> parsed =
+      cache->Lookup(attribute_text);
+  if (!parsed) {
+    // values are copied right away, the allocator holds only this annotation
+    annotation_allocator_.Reset();
+    bool valid = annotation_parser_.Parse(attribute_text);
+    parsed = cache->Insert(attribute_text, annotation_parser_, valid);
+  }
+  if (!parsed->valid) {
     location.print(errs(), src_manager());
     errs() << " Failed to parse annotation: '" << attribute_text << "'\n";
     return false;
   }
 
   if (anno != nullptr) {
-    anno->set_kind(parser->kind());
-    parser->Enumerate(AnnoInserter(anno));
+    anno->CopyFrom(parsed->proto);
   }
 
   if (verbose() > 2) {
-    parser->Enumerate(AnnoDebugPrinter());
+    for (ParsedAnnotation::Entry const &entry : parsed->entries) {
+      out_ << "  " << entry.key << " : " << entry.value << "\n";
+    }
   }
   return true;
 }
 
 bool Scanner::TraverseNamespaceDecl(NamespaceDecl *D) {
   // skip declarations not in this translation unit
-  if (!IsCurrentFileLocation(D->getLocation()))
+  proto::PackageFile *file = FileForLocation(D->getLocation());
+  if (!file)
     return true;
+  if (!CurrentNamespace())
+    current_file_ = file;
 
   if (!Base::TraverseNamespaceDecl(D))
     return false;
@@ -207,21 +422,52 @@ bool Scanner::VisitNamespaceDecl(NamespaceDecl *D) {
   return true;
 }
 
-bool Scanner::IsCurrentFileLocation(SourceLocation loc) const {
-  FileID current_file_id = src_manager().getFileID(current_file_location_);
-  // if location is not a macro compare FileIDs
-  if (!loc.isMacroID() && src_manager().getFileID(loc) == current_file_id)
-    return true;
+proto::PackageFile *Scanner::FileForLocation(SourceLocation loc) const {
+  if (loc.isInvalid())
+    return nullptr;
+  // macro locations are resolved to their expansion location
+  if (loc.isMacroID())
+    loc = src_manager().getExpansionLoc(loc);
+  // text of included files is not part of the includer's range, so plain
+  // offset comparison is enough
+  for (OwnedFile const &owned : owned_files_) {
+    if (!(loc < owned.begin) && !(owned.end < loc))
+      return owned.file;
+  }
+  return nullptr;
+}
 
-  // otherwise check the expansion location
-  SourceLocation expansion = src_manager().getExpansionLoc(loc);
-  if (src_manager().getFileID(expansion) == current_file_id)
-    return true;
-  return false;
+std::string Scanner::RelativePath(SourceLocation loc) {
+  PathCache *cache = scanner_context_->path_cache();
+  if (!cache) {
+    PresumedLoc presumed_loc = src_manager().getPresumedLoc(loc, false);
+    return PathRelativeToBaseDir(presumed_loc.getFilename(), basedir());
+  }
+
+  FileID file_id = src_manager().getFileID(src_manager().getExpansionLoc(loc));
+  DenseMap<FileID, std::string>::const_iterator it =
+      relative_paths_.find(file_id);
+  if (it != relative_paths_.end())
+    return it->second;
+
+  PresumedLoc presumed_loc = src_manager().getPresumedLoc(loc, false);
+  SmallString<256> filename(presumed_loc.getFilename());
+  if (!sys::path::is_absolute(filename)) {
+    filename = working_dir_;
+    sys::path::append(filename, presumed_loc.getFilename());
+  }
+  std::string path = cache->RelativeToBaseDir(filename);
+  relative_paths_[file_id] = path;
+  return path;
+}
+
+bool Scanner::IsCurrentFileLocation(SourceLocation loc) const {
+  return FileForLocation(loc) != nullptr;
 }
 
 bool Scanner::TraverseCXXRecordDecl(CXXRecordDecl *D) {
-  if (!IsCurrentFileLocation(D->getLocation()) ||
+  proto::PackageFile *file = FileForLocation(D->getLocation());
+  if (!file ||
       D->isThisDeclarationADefinition() == VarDecl::DeclarationOnly) {
     return true;
   }
@@ -230,6 +476,9 @@ bool Scanner::TraverseCXXRecordDecl(CXXRecordDecl *D) {
     return true;
   }
 
+  if (!CurrentNamespace() && !CurrentClass())
+    current_file_ = file;
+
   if (!Base::TraverseCXXRecordDecl(D))
     return false;
 
@@ -248,7 +497,7 @@ bool Scanner::VisitCXXRecordDecl(CXXRecordDecl *D) {
   }
 
   LogDecl(D);
-  outs().flush();
+  out_.flush();
 
   proto::Class *parent = CurrentClass();
   proto::Namespace *ns = nullptr;
@@ -282,19 +531,17 @@ bool Scanner::VisitCXXRecordDecl(CXXRecordDecl *D) {
       os << *decl;
       os.flush();
 
-      proto::TypeRef base_class;
+      proto::TypeRef *base_class = klass->mutable_base_class();
       SourceLocation base_class_location = decl->getSourceRange().getBegin();
-      std::string header_file =
-          PathRelativeToBaseDir(base_class_location, src_manager(), basedir());
-      base_class.set_type_name(decl->getQualifiedNameAsString());
-      base_class.set_kind(proto::TypeRef_Kind_CLASS);
-      base_class.set_source_file(header_file);
-      klass->mutable_base_class()->CopyFrom(base_class);
+      base_class->Clear();
+      base_class->set_type_name(decl->getQualifiedNameAsString());
+      base_class->set_kind(proto::TypeRef_Kind_CLASS);
+      base_class->set_source_file(RelativePath(base_class_location));
     }
   }
   klass->set_name(D->getDeclName().getAsString());
   klass->set_order(class_count());
-  klass->mutable_annotation()->CopyFrom(anno);
+  klass->mutable_annotation()->Swap(&anno);
   set_class_count(class_count() + 1);
   class_queue_.push_front(klass);
   package().add_provided_classes(D->getQualifiedNameAsString());
@@ -337,9 +584,11 @@ bool Scanner::VisitFieldDecl(FieldDecl *D) {
 
   proto::Field *field = klass->add_fields();
   field->set_name(field_name);
-  ReadType(D->getType(), field->mutable_type_ref(), field->mutable_type_qualifier());
+  proto::TypeRef type_ref;
+  ReadType(D->getType(), &type_ref, field->mutable_type_qualifier());
+  field->set_type_index(scanner_context_->AddType(type_ref));
   field->set_offset(offset);
-  field->mutable_annotation()->CopyFrom(anno);
+  field->mutable_annotation()->Swap(&anno);
   return true;
 }
 
@@ -361,13 +610,12 @@ bool Scanner::VisitFunctionDecl(FunctionDecl *D) {
   }
 
   proto::Function *func = ns->add_functions();
-  func->mutable_annotation()->CopyFrom(anno);
+  func->mutable_annotation()->Swap(&anno);
   func->set_name(func_name);
 
   proto::Argument *ret_val = func->mutable_return_value();
   ret_val->set_name("return");
-  ReadType(D->getReturnType(), ret_val->mutable_type_ref(),
-           ret_val->mutable_type_qualifier());
+  ReadArgumentType(D->getReturnType(), ret_val);
 
   for (FunctionDecl::param_iterator it = D->param_begin();
        it != D->param_end(); ++it) {
@@ -377,8 +625,7 @@ bool Scanner::VisitFunctionDecl(FunctionDecl *D) {
 
     llvm::StringRef param_name = param->getName().str();
     arg->set_name(param_name.data());
-    ReadType(param->getType(), arg->mutable_type_ref(),
-             arg->mutable_type_qualifier());
+    ReadArgumentType(param->getType(), arg);
   }
   return true;
 }
@@ -403,14 +650,13 @@ bool Scanner::VisitCXXMethodDecl(CXXMethodDecl *D) {
   }
 
   proto::Method *method = klass->add_methods();
-  method->mutable_annotation()->CopyFrom(anno);
+  method->mutable_annotation()->Swap(&anno);
   method->set_name(method_name);
   method->set_static_method(D->isStatic());
 
   proto::Argument *ret_val = method->mutable_return_value();
   ret_val->set_name("return");
-  ReadType(D->getReturnType(), ret_val->mutable_type_ref(),
-           ret_val->mutable_type_qualifier());
+  ReadArgumentType(D->getReturnType(), ret_val);
 
   for (CXXMethodDecl::param_iterator it = D->param_begin();
        it != D->param_end(); ++it) {
@@ -420,8 +666,7 @@ bool Scanner::VisitCXXMethodDecl(CXXMethodDecl *D) {
 
     llvm::StringRef param_name = param->getName().str();
     arg->set_name(param_name.data());
-    ReadType(param->getType(), arg->mutable_type_ref(),
-             arg->mutable_type_qualifier());
+    ReadArgumentType(param->getType(), arg);
   }
 
   return true;
@@ -451,21 +696,31 @@ bool Scanner::VisitTypedefDecl(TypedefDecl *D) {
   }
 
   td->set_name(td_name);
-  td->mutable_annotation()->CopyFrom(anno);
+  td->mutable_annotation()->Swap(&anno);
 
-  if (!ReadType(D->getUnderlyingType(), td->mutable_type_ref(),
+  proto::TypeRef type_ref;
+  if (!ReadType(D->getUnderlyingType(), &type_ref,
                 td->mutable_type_qualifier())) {
     errs() << "Failed to read underlying type for " << td_name << "\n";
     // FIXME delete invalid td
     return true;
   }
+  td->set_type_index(scanner_context_->AddType(type_ref));
 
   return true;
 }
 
+void Scanner::ReadArgumentType(QualType qt, proto::Argument *arg) {
+  proto::TypeRef type_ref;
+  ReadType(qt, &type_ref, arg->mutable_type_qualifier());
+  arg->set_type_index(scanner_context_->AddType(type_ref));
+}
+
 bool Scanner::ReadType(QualType qt,
                        proto::TypeRef *tr,
                        proto::TypeQualifier *tq) {
+  ScopedTimeAccumulator timer(time_trace() != nullptr, &read_type_time_,
+                              &read_type_depth_);
   clang::Type const *t = qt.getTypePtrOrNull();
   if (t) {
     tq->set_is_pointer(t->isPointerType());
@@ -481,8 +736,8 @@ bool Scanner::ReadType(QualType qt,
   llvm::raw_string_ostream os(type_name);
 
   if (verbose() > 1) {
-    llvm::outs() << t->getTypeClassName() << "\n";
-    llvm::outs().flush();
+    out_ << t->getTypeClassName() << "\n";
+    out_.flush();
   }
 
   if (BuiltinType::classof(t)) {
@@ -513,8 +768,7 @@ bool Scanner::ReadType(QualType qt,
     tr->set_kind(proto::TypeRef_Kind_CLASS);
 
     SourceLocation location = RD->getSourceRange().getBegin();
-    tr->set_source_file(
-        PathRelativeToBaseDir(location, src_manager(), basedir()));
+    tr->set_source_file(RelativePath(location));
   } else if (ElaboratedType::classof(t)) {
     return ReadType(t->getAs<ElaboratedType>()->getNamedType(), tr,tq);
   } else if (EnumType::classof(t)) {
@@ -525,8 +779,7 @@ bool Scanner::ReadType(QualType qt,
     tr->set_kind(proto::TypeRef_Kind_ENUM);
 
     SourceLocation location = ED->getSourceRange().getBegin();
-    tr->set_source_file(
-        PathRelativeToBaseDir(location, src_manager(), basedir()));
+    tr->set_source_file(RelativePath(location));
   } else if (clang::PointerType::classof(t)) {
     PrintingPolicy policy(context_->getLangOpts());
     policy.SuppressTagKeyword = true;
@@ -548,8 +801,11 @@ bool Scanner::ReadType(QualType qt,
 
 bool Scanner::VisitEnumDecl(EnumDecl *D) {
   // skip declarations not in this translation unit
-  if (!IsCurrentFileLocation(D->getLocation()))
+  proto::PackageFile *file = FileForLocation(D->getLocation());
+  if (!file)
     return true;
+  if (!CurrentNamespace() && !CurrentClass())
+    current_file_ = file;
 
   proto::Annotation anno;
   if (!ReadAnnotation(D, &anno)) {
@@ -574,7 +830,7 @@ bool Scanner::VisitEnumDecl(EnumDecl *D) {
 
   enm->set_name(D->getName().str());
   enm->set_type(D->getIntegerType().getLocalUnqualifiedType().getAsString());
-  enm->mutable_annotation()->CopyFrom(anno);
+  enm->mutable_annotation()->Swap(&anno);
 
   for (EnumDecl::enumerator_iterator it = D->enumerator_begin();
        it != D->enumerator_end(); ++it) {
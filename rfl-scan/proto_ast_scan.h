@@ -5,14 +5,27 @@
 #ifndef __RFL_SCAN_PROTO_AST_SCAN_H__
 #define __RFL_SCAN_PROTO_AST_SCAN_H__
 
+#include "rfl/package_io.h"
+#include "rfl/package_types.h"
 #include "rfl/reflected.pb.h"
+#include "rfl-scan/annotation_cache.h"
+#include "rfl-scan/annotation_parser.h"
+#include "rfl-scan/path_util.h"
+#include "rfl-scan/time_trace.h"
 
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Tooling/Tooling.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+
 #include <deque>
+#include <memory>
+#include <set>
+#include <vector>
 
 namespace rfl {
 
@@ -26,7 +39,20 @@ using namespace clang;
 class ScannerContext {
 public:
   ScannerContext(std::string const &basedir, unsigned verbose = 0)
-      : basedir_(basedir), verbose_(verbose), class_count_(0) {}
+      : basedir_(basedir),
+        verbose_(verbose),
+        class_count_(0),
+        prune_foreign_decls_(true),
+        time_trace_(nullptr),
+        log_(nullptr),
+        package_writer_(nullptr),
+        write_failed_(false),
+        flushed_types_(0),
+        next_source_(0),
+        visited_decls_(0),
+        pruned_decls_(0),
+        path_cache_(std::make_shared<PathCache>(basedir)),
+        annotation_cache_(std::make_shared<AnnotationCache>()) {}
 
   proto::Package const &package() const { return package_; }
   proto::Package &package() { return package_; }
@@ -37,11 +63,110 @@ public:
   unsigned class_count() const { return class_count_; }
   void set_class_count(unsigned count) { class_count_ = count; }
 
+  // Sources included by a unity translation unit. When set, declarations are
+  // assigned to package files of these sources instead of the main file.
+  std::vector<std::string> const &unity_sources() const {
+    return unity_sources_;
+  }
+  void set_unity_sources(std::vector<std::string> const &sources) {
+    unity_sources_ = sources;
+  }
+
+  // Sources of the package in their order. |skipped| ones are not scanned,
+  // but still have their (empty) package files, added before package files
+  // of the next scanned source by AddSkippedSources().
+  void set_sources(std::vector<std::string> const &sources,
+                   std::vector<std::string> const &skipped);
+  // Adds package files of skipped sources preceding scanned |source| that
+  // were not added yet, those of all remaining ones when |source| is empty.
+  // Does nothing when |source| is not a scanned source of the package.
+  void AddSkippedSources(StringRef source);
+
+  // When set, top-level declarations outside of scanned sources (ie. all
+  // included headers) are skipped without traversing them.
+  bool prune_foreign_decls() const { return prune_foreign_decls_; }
+  void set_prune_foreign_decls(bool prune) { prune_foreign_decls_ = prune; }
+
+  // Cache of paths relative to basedir, shared with fragments. Paths are
+  // not cached when null.
+  PathCache *path_cache() const { return path_cache_.get(); }
+  void set_path_cache(std::shared_ptr<PathCache> const &cache) {
+    path_cache_ = cache;
+  }
+
+  // Parsed annotations, shared with fragments
+  AnnotationCache *annotation_cache() const { return annotation_cache_.get(); }
+
+  // Trace of scanning phases, null when not tracing. Not owned.
+  TimeTrace *time_trace() const { return time_trace_; }
+  void set_time_trace(TimeTrace *trace) { time_trace_ = trace; }
+
+  // Stream of verbose output, outs() unless set. Fragments scanned on worker
+  // threads log to their own buffers, see ScanPool. Not owned.
+  raw_ostream &log() const { return log_ ? *log_ : outs(); }
+  void set_log(raw_ostream *log) { log_ = log; }
+
+  // When set, package files are written out after every translation unit
+  // instead of being kept in package() until the end. Not owned.
+  PackageWriter *package_writer() const { return package_writer_; }
+  void set_package_writer(PackageWriter *writer) { package_writer_ = writer; }
+
+  // Returns index of |type| in the type table of package(), fields,
+  // arguments and typedefs refer to their types by it.
+  uint32 AddType(proto::TypeRef const &type) {
+    return type_table_.Add(type, &package_);
+  }
+
+  // Writes package files and provided classes collected so far, along with
+  // types added since the last record, as a record of the package writer
+  // and removes them from package(). Does nothing without writer.
+  void FlushPackageFiles();
+  bool write_failed() const { return write_failed_; }
+
+  // Statistics of traversed and pruned declarations
+  unsigned visited_decls() const { return visited_decls_; }
+  unsigned pruned_decls() const { return pruned_decls_; }
+  void AddDeclStats(unsigned visited, unsigned pruned) {
+    visited_decls_ += visited;
+    pruned_decls_ += pruned;
+  }
+
+  // Files read while scanning, with absolute paths.
+  std::set<std::string> const &dependencies() const { return dependencies_; }
+  void AddDependency(std::string const &path) { dependencies_.insert(path); }
+
+  // Creates an empty context with the same configuration. Fragments are used
+  // to scan translation units independently, see Merge().
+  std::unique_ptr<ScannerContext> CreateFragment() const;
+
+  // Moves package files and provided classes scanned by |fragment| to this
+  // package, and appends its dependencies. Types of the fragment are added
+  // to the type table, type indices of its files are fixed up.
+  // Class order is shifted by current class count so that the result is the
+  // same as if the fragment was scanned directly by this context.
+  void Merge(ScannerContext *fragment);
+
 private:
   proto::Package package_;
   std::string basedir_;
   unsigned verbose_;
   unsigned class_count_;
+  std::vector<std::string> unity_sources_;
+  std::set<std::string> dependencies_;
+  bool prune_foreign_decls_;
+  TimeTrace *time_trace_;
+  raw_ostream *log_;
+  PackageWriter *package_writer_;
+  bool write_failed_;
+  TypeTable type_table_;
+  int flushed_types_;
+  // absolute paths of sources, skipped or not
+  std::vector<std::pair<std::string, bool>> sources_;
+  size_t next_source_;
+  unsigned visited_decls_;
+  unsigned pruned_decls_;
+  std::shared_ptr<PathCache> path_cache_;
+  std::shared_ptr<AnnotationCache> annotation_cache_;
 };
 
 class Scanner : public ASTConsumer, public RecursiveASTVisitor<Scanner> {
@@ -51,11 +176,14 @@ public:
   Scanner(ScannerContext *scan_ctx, raw_ostream *out = nullptr);
 
   // ASTConsumer overrides
+  void Initialize(ASTContext &Context) override;
   void HandleTranslationUnit(ASTContext &Context) override;
 
   // RecursiveASTVisitor template overrides
   bool shouldWalkTypesOfTypeLocs() const { return false; }
 
+  bool TraverseDecl(Decl *D);
+
   bool TraverseCXXRecordDecl(CXXRecordDecl *D);
   bool VisitCXXRecordDecl(CXXRecordDecl *D);
   bool VisitNamespaceDecl(NamespaceDecl *D);
@@ -68,6 +196,17 @@ public:
   bool VisitTypedefDecl(TypedefDecl *D);
 
 private:
+  // Source range of a scanned file and its package file
+  struct OwnedFile {
+    SourceLocation begin;
+    SourceLocation end;
+    proto::PackageFile *file;
+  };
+
+  void AddOwnedFile(FileID file_id);
+  void AddDependencies();
+  proto::PackageFile *FileForLocation(SourceLocation loc) const;
+  std::string RelativePath(SourceLocation loc);
   bool IsCurrentFileLocation(SourceLocation loc) const;
   bool HasAnnotation(NamedDecl *D) const;
 
@@ -75,10 +214,12 @@ private:
   void LogDecl(NamedDecl *D) const;
 
   bool ReadType(QualType qt, proto::TypeRef *tr, proto::TypeQualifier *tq);
+  void ReadArgumentType(QualType qt, proto::Argument *arg);
 
   proto::Package &package() const { return scanner_context_->package(); }
   std::string const &basedir() const { return scanner_context_->basedir(); }
   unsigned verbose() const { return scanner_context_->verbose(); }
+  TimeTrace *time_trace() const { return scanner_context_->time_trace(); }
   SourceManager const &src_manager() const;
 
   unsigned class_count() const { return scanner_context_->class_count(); }
@@ -100,23 +241,45 @@ private:
   proto::PackageFile *current_file_;
   std::deque<proto::Namespace *> namespace_queue_;
   std::deque<proto::Class *> class_queue_;
-  SourceLocation current_file_location_;
+  SmallVector<OwnedFile, 4> owned_files_;
+  DenseMap<FileID, std::string> relative_paths_;
+  SmallString<256> working_dir_;
+  unsigned visited_decls_;
+  // time spent by phases of this translation unit, when tracing
+  TimeTrace::Clock::time_point frontend_start_;
+  TimeTrace::Clock::duration annotation_time_;
+  TimeTrace::Clock::duration read_type_time_;
+  unsigned read_type_depth_;
+  BumpPtrAllocator annotation_allocator_;
+  AnnotationParser annotation_parser_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 class ScannerAction : public ASTFrontendAction {
 public:
-  ScannerAction(ScannerContext *scan_ctx) : scanner_context_(scan_ctx) {}
+  ScannerAction(ScannerContext *scan_ctx) : scanner_context_(scan_ctx) {
+    if (scan_ctx->time_trace())
+      start_ = TimeTrace::Clock::now();
+  }
 
 protected:
+  void EndSourceFileAction() override {
+    if (TimeTrace *trace = scanner_context_->time_trace()) {
+      trace->AddEvent("Source", getCurrentFile(), start_,
+                      TimeTrace::Clock::now() - start_);
+    }
+  }
+
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
                                                  StringRef InFile) override {
-    return make_unique<Scanner>(scanner_context_, &outs());
+    return make_unique<Scanner>(scanner_context_,
+                                &scanner_context_->log());
   }
 
 private:
   ScannerContext *scanner_context_;
+  TimeTrace::Clock::time_point start_;
 };
 
 class ScannerActionFactory : public tooling::FrontendActionFactory {
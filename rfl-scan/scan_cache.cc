@@ -0,0 +1,217 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/scan_cache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <tuple>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+// Bump whenever format of entries or scanner output changes
+char const kCacheFormat[] = "rfl-scan-cache 1";
+
+std::string HashString(MD5 &hash) {
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+// Files are hashed again only when they are modified, which matters for
+// long running scanners.
+bool IsSameFile(sys::fs::file_status const &a, sys::fs::file_status const &b) {
+  return a.getUniqueID() == b.getUniqueID() && a.getSize() == b.getSize() &&
+         a.getLastModificationTime() == b.getLastModificationTime();
+}
+
+}  // namespace
+
+ScanCache::ScanCache(std::string const &directory, std::string const &version)
+    : directory_(directory), version_(version), hits_(0), misses_(0) {
+}
+
+std::string ScanCache::GetKey(std::string const &source,
+                              std::vector<std::string> const &options,
+                              std::vector<CompileCommand> const &commands) {
+  std::string source_hash;
+  if (!HashFile(source, &source_hash))
+    return std::string();
+
+  MD5 hash;
+  hash.update(kCacheFormat);
+  hash.update(StringRef(version_.c_str(), version_.size() + 1));
+  hash.update(StringRef(source.c_str(), source.size() + 1));
+  hash.update(source_hash);
+  for (std::string const &option : options) {
+    hash.update(StringRef(option.c_str(), option.size() + 1));
+  }
+  for (CompileCommand const &command : commands) {
+    hash.update(StringRef(command.Directory.c_str(),
+                          command.Directory.size() + 1));
+    for (std::string const &arg : command.CommandLine) {
+      hash.update(StringRef(arg.c_str(), arg.size() + 1));
+    }
+  }
+  return HashString(hash);
+}
+
+// Entry layout:
+//   rfl-scan-cache <format>\n
+//   <class count>\n
+//   <dependency count>\n
+//   <md5> <path>\n  (for every dependency)
+//   <serialized proto::Package>
+bool ScanCache::Lookup(std::string const &key, ScannerContext *fragment) {
+  std::unique_ptr<MemoryBuffer> entry;
+  if (directory_.empty()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, std::string>::const_iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      entry = MemoryBuffer::getMemBufferCopy(it->second);
+    }
+  } else {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(EntryPath(key));
+    if (buffer) {
+      entry = std::move(buffer.get());
+    }
+  }
+
+  if (!entry || !ReadEntry(entry->getBuffer(), fragment)) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  return true;
+}
+
+bool ScanCache::ReadEntry(StringRef entry, ScannerContext *fragment) {
+  StringRef rest = entry;
+  StringRef line;
+  unsigned class_count = 0;
+  unsigned dep_count = 0;
+  std::tie(line, rest) = rest.split('\n');
+  if (line != kCacheFormat)
+    return false;
+  std::tie(line, rest) = rest.split('\n');
+  if (line.getAsInteger(10, class_count))
+    return false;
+  std::tie(line, rest) = rest.split('\n');
+  if (line.getAsInteger(10, dep_count))
+    return false;
+
+  std::vector<std::string> deps;
+  for (unsigned i = 0; i < dep_count; ++i) {
+    std::tie(line, rest) = rest.split('\n');
+    StringRef recorded_hash;
+    StringRef path;
+    std::tie(recorded_hash, path) = line.split(' ');
+    std::string current_hash;
+    if (!HashFile(path, &current_hash) || recorded_hash != current_hash)
+      return false;
+    deps.push_back(path);
+  }
+
+  if (!fragment->package().ParseFromArray(rest.data(), (int)rest.size()))
+    return false;
+  fragment->set_class_count(class_count);
+  for (std::string const &dep : deps) {
+    fragment->AddDependency(dep);
+  }
+  return true;
+}
+
+void ScanCache::Store(std::string const &key, ScannerContext const &fragment) {
+  std::string content;
+  raw_string_ostream os(content);
+  os << kCacheFormat << "\n"
+     << fragment.class_count() << "\n"
+     << fragment.dependencies().size() << "\n";
+  for (std::string const &dep : fragment.dependencies()) {
+    std::string hash;
+    if (!HashFile(dep, &hash)) {
+      // can't validate this entry later
+      return;
+    }
+    os << hash << " " << dep << "\n";
+  }
+  os.flush();
+  if (!fragment.package().AppendToString(&content))
+    return;
+
+  if (directory_.empty()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key].swap(content);
+    return;
+  }
+
+  std::string entry_path = EntryPath(key);
+  if (sys::fs::create_directories(sys::path::parent_path(entry_path)))
+    return;
+
+  // write to temporary file first, so that concurrent scans never see
+  // partially written entries
+  int fd;
+  SmallString<256> temp_path;
+  if (sys::fs::createUniqueFile(entry_path + "-%%%%%%.tmp", fd, temp_path)) {
+    return;
+  }
+  {
+    raw_fd_ostream out(fd, true);
+    out << content;
+  }
+  if (sys::fs::rename(temp_path, entry_path)) {
+    sys::fs::remove(temp_path);
+  }
+}
+
+bool ScanCache::HashFile(std::string const &path, std::string *hash) {
+  sys::fs::file_status status;
+  if (sys::fs::status(path, status))
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, FileHash>::const_iterator it =
+        file_hashes_.find(path);
+    if (it != file_hashes_.end() && IsSameFile(it->second.status, status)) {
+      *hash = it->second.hash;
+      return true;
+    }
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return false;
+  MD5 md5;
+  md5.update(buffer.get()->getBuffer());
+  *hash = HashString(md5);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  FileHash &file_hash = file_hashes_[path];
+  file_hash.status = status;
+  file_hash.hash = *hash;
+  return true;
+}
+
+std::string ScanCache::EntryPath(std::string const &key) const {
+  SmallString<256> path(directory_);
+  sys::path::append(path, key.substr(0, 2), key + ".rflc");
+  return path.str();
+}
+
+} // namespace scan
+} // namespace rfl
@@ -0,0 +1,72 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_SCAN_CACHE_H__
+#define __RFL_SCAN_SCAN_CACHE_H__
+
+#include "rfl-scan/proto_ast_scan.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+using namespace clang::tooling;
+
+// Persistent cache of scanned translation units.
+// Entries are addressed by a hash of the main file, its compile commands,
+// options of the scan and the scanner version. Every entry records hashes of
+// all files opened while scanning, and it's used only when none of them has
+// changed.
+class ScanCache {
+public:
+  // Entries are kept in memory when |directory| is empty.
+  ScanCache(std::string const &directory, std::string const &version);
+
+  // Returns key of translation unit |source| compiled by |commands| or an
+  // empty string when the source cannot be read. |options| are all options
+  // that change scanned results of the unit (eg. basedir, which package
+  // file names are relative to).
+  std::string GetKey(std::string const &source,
+                     std::vector<std::string> const &options,
+                     std::vector<CompileCommand> const &commands);
+
+  // Fills empty |fragment| with results cached for |key|.
+  bool Lookup(std::string const &key, ScannerContext *fragment);
+  void Store(std::string const &key, ScannerContext const &fragment);
+
+  unsigned hits() const { return hits_; }
+  unsigned misses() const { return misses_; }
+
+private:
+  struct FileHash {
+    sys::fs::file_status status;
+    std::string hash;
+  };
+
+  bool ReadEntry(StringRef entry, ScannerContext *fragment);
+  bool HashFile(std::string const &path, std::string *hash);
+  std::string EntryPath(std::string const &key) const;
+
+  std::string directory_;
+  std::string version_;
+  std::mutex mutex_;
+  std::map<std::string, FileHash> file_hashes_;
+  std::map<std::string, std::string> entries_;
+  std::atomic<unsigned> hits_;
+  std::atomic<unsigned> misses_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_SCAN_CACHE_H__ */
@@ -0,0 +1,162 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/scan_pool.h"
+#include "rfl-scan/scan_cache.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Tooling/Tooling.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+// The driver looks for builtin headers relative to the executable, as it
+// does for ClangTool.
+std::string MainExecutable() {
+  static int static_symbol;
+  return sys::fs::getMainExecutable("clang_tool", &static_symbol);
+}
+
+}  // namespace
+
+ScanPool::ScanPool(CompilationDatabase const &cdb,
+                   ArgumentsAdjuster const &adjuster,
+                   unsigned jobs)
+    : compilation_db_(cdb), adjuster_(adjuster), jobs_(std::max(jobs, 1u)),
+      cache_(nullptr) {
+}
+
+int ScanPool::Run(std::vector<std::string> const &sources,
+                  ScannerContext *scan_ctx) {
+  size_t const count = sources.size();
+  // working directory of the process stays the same while scanning, see
+  // ScanSource(), relative sources are resolved against it up front
+  std::vector<std::string> abs_sources(count);
+  for (size_t i = 0; i < count; ++i) {
+    SmallString<256> path(sources[i]);
+    sys::fs::make_absolute(path);
+    abs_sources[i] = path.str();
+  }
+  std::vector<std::unique_ptr<ScannerContext>> fragments(count);
+  std::vector<std::string> logs(count);
+  std::vector<int> results(count, 0);
+  std::vector<bool> done(count, false);
+  std::atomic<size_t> next(0);
+  std::mutex merge_mutex;
+  size_t merged = 0;
+  int ret = 0;
+
+  // Merges the finished prefix of fragments, so that the package writer of
+  // |scan_ctx| gets package files while other sources are still scanned.
+  auto finish = [&](size_t index) {
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    done[index] = true;
+    for (; merged < count && done[merged]; ++merged) {
+      scan_ctx->log() << logs[merged];
+      scan_ctx->log().flush();
+      logs[merged].clear();
+      if (results[merged] != 0) {
+        ret = results[merged];
+      } else {
+        scan_ctx->AddSkippedSources(abs_sources[merged]);
+        scan_ctx->Merge(fragments[merged].get());
+        scan_ctx->FlushPackageFiles();
+      }
+      fragments[merged].reset();
+    }
+  };
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      // verbose output of workers is buffered and written in order of
+      // sources along with their fragments
+      raw_string_ostream log(logs[i]);
+      fragments[i] = scan_ctx->CreateFragment();
+      fragments[i]->set_log(&log);
+      results[i] = ScanSource(abs_sources[i], fragments[i].get());
+      fragments[i]->set_log(nullptr);
+      log.flush();
+      finish(i);
+    }
+  };
+
+  size_t jobs = std::min<size_t>(jobs_, count);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < jobs; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return ret;
+}
+
+// Runs the tool the way ClangTool::run() does, except that it never
+// switches working directory of the process (which is shared by workers).
+// Directory of the compile command is the working directory of its file
+// manager and of the compiler (-working-directory) instead.
+int ScanPool::ScanSource(std::string const &source, ScannerContext *fragment) {
+  std::vector<CompileCommand> commands =
+      compilation_db_.getCompileCommands(source);
+  if (commands.empty()) {
+    errs() << "Skipping " << source << ". Compile command not found.\n";
+    return 0;
+  }
+  for (CompileCommand &command : commands) {
+    command.CommandLine = adjuster_(command.CommandLine, command.Filename);
+  }
+
+  std::string key;
+  if (cache_) {
+    TimeTraceScope scope(fragment->time_trace(), "CacheLookup", source);
+    key = cache_->GetKey(source, cache_options_, commands);
+    if (!key.empty() && cache_->Lookup(key, fragment)) {
+      if (fragment->verbose()) {
+        fragment->log() << "Cached translation unit: " << source << "\n";
+      }
+      return 0;
+    }
+  }
+
+  ScannerActionFactory factory(fragment);
+  int ret = 0;
+  for (CompileCommand &command : commands) {
+    std::vector<std::string> &args = command.CommandLine;
+    if (args.empty())
+      continue;
+    args[0] = MainExecutable();
+    args.insert(args.begin() + 1, command.Directory);
+    args.insert(args.begin() + 1, "-working-directory");
+
+    FileSystemOptions options;
+    options.WorkingDir = command.Directory;
+    IntrusiveRefCntPtr<FileManager> files(new FileManager(options));
+    ToolInvocation invocation(std::move(args), &factory, files.get());
+    if (!invocation.run()) {
+      errs() << "Error while processing " << source << ".\n";
+      ret = 1;
+    }
+  }
+  if (ret == 0 && !key.empty()) {
+    cache_->Store(key, *fragment);
+  }
+  return ret;
+}
+
+} // namespace scan
+} // namespace rfl
@@ -0,0 +1,58 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_SCAN_POOL_H__
+#define __RFL_SCAN_SCAN_POOL_H__
+
+#include "rfl-scan/proto_ast_scan.h"
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+class ScanCache;
+
+using namespace clang::tooling;
+
+// Scans translation units on a pool of worker threads.
+// Every translation unit is scanned by its own tool invocation into a
+// fragment ScannerContext. Fragments and their verbose output are merged
+// into the target context in the order of sources as soon as all preceding
+// ones are done, so the resulting package does not depend on scheduling.
+// Unlike ClangTool, workers never change working directory of the process.
+class ScanPool {
+public:
+  ScanPool(CompilationDatabase const &cdb,
+           ArgumentsAdjuster const &adjuster,
+           unsigned jobs);
+
+  int Run(std::vector<std::string> const &sources, ScannerContext *scan_ctx);
+
+  // Translation units found in |cache| are not scanned again, scanned ones
+  // are stored. Units are cached per |options| of the scan, see
+  // ScanCache::GetKey(). Not owned.
+  void set_cache(ScanCache *cache, std::vector<std::string> const &options) {
+    cache_ = cache;
+    cache_options_ = options;
+  }
+
+private:
+  int ScanSource(std::string const &source, ScannerContext *fragment);
+
+  CompilationDatabase const &compilation_db_;
+  ArgumentsAdjuster adjuster_;
+  unsigned jobs_;
+  ScanCache *cache_;
+  std::vector<std::string> cache_options_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_SCAN_POOL_H__ */
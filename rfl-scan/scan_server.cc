@@ -0,0 +1,192 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/scan_server.h"
+
+#include "rfl/types.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if OS_POSIX
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <tuple>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+
+namespace {
+
+bool ParseRequestLine(StringRef line, ScanRequest *request) {
+  StringRef field;
+  StringRef value;
+  std::tie(field, value) = line.split(' ');
+  if (field == "basedir") {
+    request->basedir = value;
+  } else if (field == "pkg-name") {
+    request->pkg_name = value;
+  } else if (field == "pkg-version") {
+    request->pkg_version = value;
+  } else if (field == "output") {
+    request->output = value;
+  } else if (field == "depfile") {
+    request->depfile = value;
+  } else if (field == "map-output") {
+    request->map_output = value;
+  } else if (field == "import") {
+    request->imports.push_back(value);
+  } else if (field == "lib") {
+    request->libs.push_back(value);
+  } else if (field == "source") {
+    request->sources.push_back(value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+ScanServer::ScanServer(std::string const &socket_path, unsigned verbose)
+    : socket_path_(socket_path), verbose_(verbose), socket_(-1) {
+}
+
+#if OS_POSIX
+
+ScanServer::~ScanServer() {
+  if (socket_ != -1) {
+    close(socket_);
+    unlink(socket_path_.c_str());
+  }
+}
+
+int ScanServer::Run(Handler const &handler) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    errs() << "Socket path too long " << socket_path_ << "\n";
+    return 1;
+  }
+  strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+  socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ == -1) {
+    errs() << "Failed to create socket : " << strerror(errno) << "\n";
+    return 1;
+  }
+  // remove stale socket of previous server
+  unlink(socket_path_.c_str());
+  if (bind(socket_, (sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(socket_, 16) == -1) {
+    errs() << "Failed to listen on " << socket_path_ << " : "
+           << strerror(errno) << "\n";
+    return 1;
+  }
+  // clients may go away before reading reply
+  signal(SIGPIPE, SIG_IGN);
+
+  if (verbose_) {
+    outs() << "Listening on " << socket_path_ << "\n";
+    outs().flush();
+  }
+
+  for (;;) {
+    int fd = accept(socket_, nullptr, nullptr);
+    if (fd == -1) {
+      if (errno == EINTR)
+        continue;
+      errs() << "Failed to accept connection : " << strerror(errno) << "\n";
+      return 1;
+    }
+    bool quit = HandleConnection(fd, handler);
+    close(fd);
+    if (quit)
+      break;
+  }
+  return 0;
+}
+
+bool ScanServer::HandleConnection(int fd, Handler const &handler) {
+  ScanRequest request;
+  std::string buffer;
+  std::string error;
+  bool complete = false;
+  char chunk[4096];
+  while (!complete) {
+    ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count == -1 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;
+    buffer.append(chunk, count);
+
+    size_t eol;
+    while (!complete && (eol = buffer.find('\n')) != std::string::npos) {
+      StringRef line = StringRef(buffer.data(), eol).rtrim();
+      if (line == "quit")
+        return true;
+      if (line == "end") {
+        complete = true;
+      } else if (!line.empty() && !ParseRequestLine(line, &request) &&
+                 error.empty()) {
+        error = "unknown request field '" + line.str() + "'";
+      }
+      buffer.erase(0, eol + 1);
+    }
+  }
+
+  if (!complete)
+    return false;
+
+  if (error.empty()) {
+    if (verbose_) {
+      outs() << "Scanning package " << request.pkg_name << " ("
+             << request.sources.size() << " sources)\n";
+      outs().flush();
+    }
+    if (!handler(request, &error) && error.empty()) {
+      error = "scanning failed";
+    }
+  }
+
+  std::string reply = error.empty() ? "ok\n" : "error " + error + "\n";
+  for (size_t written = 0; written < reply.size();) {
+    ssize_t count = write(fd, reply.data() + written, reply.size() - written);
+    if (count == -1 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;
+    written += count;
+  }
+  return false;
+}
+
+#else
+
+ScanServer::~ScanServer() {
+}
+
+int ScanServer::Run(Handler const &handler) {
+  errs() << "Server mode is not supported on this platform\n";
+  return 1;
+}
+
+bool ScanServer::HandleConnection(int fd, Handler const &handler) {
+  return false;
+}
+
+#endif
+
+} // namespace scan
+} // namespace rfl
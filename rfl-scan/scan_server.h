@@ -0,0 +1,56 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_SCAN_SERVER_H__
+#define __RFL_SCAN_SCAN_SERVER_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+// Package to be scanned, as given on command line or by a client.
+struct ScanRequest {
+  std::string basedir;
+  std::string pkg_name;
+  std::string pkg_version;
+  std::string output;
+  std::string depfile;
+  std::string map_output;
+  std::vector<std::string> imports;
+  std::vector<std::string> libs;
+  std::vector<std::string> sources;
+};
+
+// Serves scan requests on a local (unix domain) socket.
+//
+// Request is a sequence of lines "<field> <value>", where field is one of
+// basedir, pkg-name, pkg-version, output, depfile, map-output, import, lib
+// or source, terminated by line "end". Line "quit" stops the server. Paths are expected
+// to be absolute. Server replies "ok" or "error <message>" and closes
+// connection.
+class ScanServer {
+public:
+  typedef std::function<bool(ScanRequest const &, std::string *)> Handler;
+
+  ScanServer(std::string const &socket_path, unsigned verbose = 0);
+  ~ScanServer();
+
+  // Handles requests until quit is received. Returns non-zero on failure.
+  int Run(Handler const &handler);
+
+private:
+  bool HandleConnection(int fd, Handler const &handler);
+
+  std::string socket_path_;
+  unsigned verbose_;
+  int socket_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_SCAN_SERVER_H__ */
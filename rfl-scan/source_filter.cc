@@ -0,0 +1,69 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/source_filter.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace rfl {
+namespace scan {
+
+namespace {
+
+// Macros defined by rfl/annotations.h, without the rfl_ prefix
+char const *const kAnnotationMacros[] = {
+  "primitive", "class", "enum", "property", "field", "method", "arg",
+};
+
+bool IsIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Returns true when |content| contains identifier made of |prefix| followed
+// by one of |suffixes|, or |prefix| alone when there are no suffixes.
+bool ContainsIdentifier(StringRef content,
+                        StringRef prefix,
+                        char const *const *suffixes,
+                        size_t suffix_count) {
+  for (size_t pos = content.find(prefix); pos != StringRef::npos;
+       pos = content.find(prefix, pos + 1)) {
+    if (pos > 0 && IsIdentifierChar(content[pos - 1]))
+      continue;
+    StringRef rest = content.substr(pos + prefix.size());
+    if (suffix_count == 0) {
+      if (rest.empty() || !IsIdentifierChar(rest[0]))
+        return true;
+      continue;
+    }
+    for (size_t i = 0; i < suffix_count; ++i) {
+      StringRef suffix(suffixes[i]);
+      if (rest.startswith(suffix) &&
+          (rest.size() == suffix.size() ||
+           !IsIdentifierChar(rest[suffix.size()]))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool HasAnnotations(StringRef content) {
+  size_t const macro_count =
+      sizeof(kAnnotationMacros) / sizeof(kAnnotationMacros[0]);
+  return ContainsIdentifier(content, "rfl_", kAnnotationMacros, macro_count) ||
+         ContainsIdentifier(content, "annotate", nullptr, 0);
+}
+
+bool SourceHasAnnotations(std::string const &path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return true;
+  return HasAnnotations(buffer.get()->getBuffer());
+}
+
+} // namespace scan
+} // namespace rfl
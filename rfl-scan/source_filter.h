@@ -0,0 +1,29 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_SOURCE_FILTER_H__
+#define __RFL_SCAN_SOURCE_FILTER_H__
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+
+// Returns true when |content| may contain an annotation, ie. one of rfl_*
+// macros from rfl/annotations.h or an annotate attribute.
+// It's a plain text search, occurences in comments or strings count too.
+bool HasAnnotations(StringRef content);
+
+// Returns true when source file |path| may contain an annotation. Files that
+// cannot be read are reported as annotated, so that the scanner handles them.
+bool SourceHasAnnotations(std::string const &path);
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_SOURCE_FILTER_H__ */
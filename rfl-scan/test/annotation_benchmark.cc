@@ -0,0 +1,153 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Parses annotation strings of example/test_annotations.h in a loop, once
+// with a single reused parser and once with a new parser per annotation.
+//
+//   annotation_benchmark [iterations] [header]
+
+#include "rfl-scan/annotation_parser.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace rfl::scan;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct ValueCounter {
+  explicit ValueCounter(size_t *size) : size_(size) {}
+  void operator()(StringRef key,
+                  StringRef value,
+                  AnnotationParser::ValueType type) const {
+    *size_ += value.size();
+  }
+  size_t *size_;
+};
+
+// Returns annotation strings as produced by rfl/annotations.h macros, i.e.
+// 'kind:{arguments}' with whitespace of arguments collapsed.
+std::vector<std::string> ExtractAnnotations(StringRef source) {
+  std::vector<std::string> annotations;
+  size_t pos = 0;
+  while ((pos = source.find("rfl_", pos)) != StringRef::npos) {
+    if (pos > 0 && (isalnum(source[pos - 1]) || source[pos - 1] == '_')) {
+      pos += 4;
+      continue;
+    }
+    size_t open = source.find('(', pos);
+    StringRef kind = source.slice(pos + 4, open);
+    if (open == StringRef::npos || kind.empty() ||
+        kind.find_first_of(" \t\n") != StringRef::npos) {
+      pos += 4;
+      continue;
+    }
+
+    std::string annotation = kind.str() + ":{";
+    unsigned depth = 1;
+    bool in_string = false;
+    bool space = false;
+    size_t i = open + 1;
+    for (; i < source.size() && depth > 0; ++i) {
+      char c = source[i];
+      if (in_string) {
+        annotation += c;
+        if (c == '\\' && i + 1 < source.size())
+          annotation += source[++i];
+        else if (c == '"')
+          in_string = false;
+        continue;
+      }
+      if (c == '(') {
+        ++depth;
+      } else if (c == ')' && --depth == 0) {
+        break;
+      } else if (c == '"') {
+        in_string = true;
+      }
+      if (isspace(c)) {
+        space = true;
+        continue;
+      }
+      if (space && annotation.back() != '{')
+        annotation += ' ';
+      space = false;
+      annotation += c;
+    }
+    annotation += '}';
+    annotations.push_back(annotation);
+    pos = i;
+  }
+  return annotations;
+}
+
+double ParseNanoseconds(std::vector<std::string> const &annotations,
+                        unsigned iterations,
+                        bool reuse) {
+  BumpPtrAllocator allocator;
+  AnnotationParser parser(allocator);
+  size_t entries = 0;
+  Clock::time_point start = Clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    for (std::string const &annotation : annotations) {
+      if (reuse) {
+        allocator.Reset();
+        if (!parser.Parse(annotation))
+          exit(1);
+        parser.Enumerate(ValueCounter(&entries));
+      } else {
+        BumpPtrAllocator local_allocator;
+        AnnotationParser local_parser(local_allocator);
+        if (!local_parser.Parse(annotation))
+          exit(1);
+        local_parser.Enumerate(ValueCounter(&entries));
+      }
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  if (entries == 0)
+    outs() << "No annotation entries\n";
+  return elapsed.count() / (iterations * annotations.size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  std::string header =
+      argc > 2 ? argv[2] : RFL_SRC_DIR "/example/test_annotations.h";
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+      MemoryBuffer::getFile(header);
+  if (std::error_code ec = buffer.getError()) {
+    errs() << "Failed to open file " << header << " : " << ec.message()
+           << "\n";
+    return 1;
+  }
+  std::vector<std::string> annotations =
+      ExtractAnnotations((*buffer)->getBuffer());
+  if (annotations.empty()) {
+    errs() << "No annotations in " << header << "\n";
+    return 1;
+  }
+
+  double fresh = ParseNanoseconds(annotations, iterations, false);
+  double reused = ParseNanoseconds(annotations, iterations, true);
+
+  outs() << annotations.size() << " annotations, " << iterations
+         << " iterations\n";
+  outs() << format("  new parser:    %8.1f ns/annotation\n", fresh);
+  outs() << format("  reused parser: %8.1f ns/annotation\n", reused);
+  return 0;
+}
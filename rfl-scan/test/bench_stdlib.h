@@ -0,0 +1,49 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_TEST_BENCH_STDLIB_H__
+#define __RFL_SCAN_TEST_BENCH_STDLIB_H__
+
+// Few reflected declarations next to a large part of the standard library,
+// used to measure traversal of included headers.
+
+#include "rfl/annotations.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bench {
+
+enum rfl_enum() Mode {
+  kModeFast,
+  kModeSlow,
+};
+
+class rfl_class() Record {
+public:
+  Record() : mode_(kModeFast), count_(0) {}
+
+  rfl_method()
+  int count() const { return count_; }
+
+private:
+  rfl_field()
+  Mode mode_;
+
+  rfl_field()
+  int count_;
+
+  std::map<std::string, std::vector<int>> values_;
+};
+
+} // namespace bench
+
+#endif /* __RFL_SCAN_TEST_BENCH_STDLIB_H__ */
@@ -0,0 +1,228 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Writes synthetic compile_commands.json, then looks up commands of
+// headers with and without a matching source through ScanCompilationDatabase
+// with index given, with index built on the first header without a source,
+// and the way it used to, probing the database for every source extension
+// and falling back to every other scanned file. Headers with a source only
+// are looked up without the index as well. Then compares loading the
+// database to loading snapshot of commands of the headers.
+//
+//   compilation_db_benchmark <dir> [entries] [headers]
+
+#include "rfl-scan/compilation_db.h"
+
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang::tooling;
+using namespace rfl::scan;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+unsigned const kSourcesPerDirectory = 100;
+char const *const kHeaderExtensions[] = {".h", ".hh", ".hpp", ".h++"};
+char const *const kSourceExtensions[] = {".cc", ".cpp", ".cxx", ".c++",
+                                         ".c"};
+
+std::string SourcePath(StringRef dir, unsigned i, StringRef ext) {
+  SmallString<256> path(dir);
+  sys::path::append(path, "src" + std::to_string(i / kSourcesPerDirectory),
+                    "file" + std::to_string(i) + ext.str());
+  return std::string(path.begin(), path.end());
+}
+
+bool WriteDatabase(StringRef dir, unsigned entries) {
+  SmallString<256> path(dir);
+  sys::path::append(path, "compile_commands.json");
+  std::error_code ec;
+  raw_fd_ostream out(path, ec, sys::fs::F_Text);
+  if (ec)
+    return false;
+  out << "[\n";
+  for (unsigned i = 0; i < entries; ++i) {
+    std::string file = SourcePath(dir, i, ".cc");
+    out << "{ \"directory\": \"" << dir << "\",\n"
+        << "  \"command\": \"/usr/bin/c++ -DBENCH=" << i
+        << " -Iinclude -std=c++11 -c " << file << "\",\n"
+        << "  \"file\": \"" << file << "\" }" << (i + 1 < entries ? "," : "")
+        << "\n";
+  }
+  out << "]\n";
+  return !out.has_error();
+}
+
+// Lookup as ScanCompilationDatabase did before it had the index.
+std::vector<CompileCommand> LegacyCompileCommands(
+    CompilationDatabase const &cdb,
+    std::vector<std::string> const &sources,
+    StringRef file) {
+  std::vector<CompileCommand> result = cdb.getCompileCommands(file);
+  if (!result.empty())
+    return result;
+  StringRef ext = sys::path::extension(file);
+  for (char const *hdr_ext : kHeaderExtensions) {
+    if (ext != hdr_ext)
+      continue;
+    for (char const *src_ext : kSourceExtensions) {
+      SmallString<1024> src_file(file);
+      sys::path::replace_extension(src_file, src_ext);
+      result = cdb.getCompileCommands(src_file);
+      if (!result.empty())
+        return result;
+    }
+    break;
+  }
+  for (std::string const &src : sources) {
+    if (src == file)
+      continue;
+    result = cdb.getCompileCommands(src);
+    if (!result.empty())
+      return result;
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char const **argv) {
+  if (argc < 2) {
+    errs() << "usage: " << argv[0] << " <dir> [entries] [headers]\n";
+    return 1;
+  }
+  std::string dir = argv[1];
+  unsigned entries = argc > 2 ? atoi(argv[2]) : 20000;
+  unsigned headers = argc > 3 ? atoi(argv[3]) : 2000;
+  if (entries == 0 || headers == 0 || !WriteDatabase(dir, entries)) {
+    errs() << "Failed to write database\n";
+    return 1;
+  }
+
+  SmallString<256> db_path(dir);
+  sys::path::append(db_path, "compile_commands.json");
+  std::string error;
+  Clock::time_point start = Clock::now();
+  std::unique_ptr<JSONCompilationDatabase> json_db =
+      JSONCompilationDatabase::loadFromFile(db_path, error);
+  if (!json_db) {
+    errs() << error << "\n";
+    return 1;
+  }
+  Milliseconds load = Clock::now() - start;
+
+  // half of the headers have a source, the other half are the only file
+  // of their directory, scanned sources are the headers only
+  std::vector<std::string> sources;
+  std::vector<std::string> paired_sources;
+  for (unsigned i = 0; i < headers; ++i) {
+    if (i % 2 == 0) {
+      sources.push_back(SourcePath(dir, (i * 7919) % entries, ".h"));
+      paired_sources.push_back(sources.back());
+    } else {
+      SmallString<256> path(dir);
+      sys::path::append(path, "include" + std::to_string(i),
+                        "header" + std::to_string(i) + ".h");
+      sources.push_back(std::string(path.begin(), path.end()));
+    }
+  }
+
+  start = Clock::now();
+  std::shared_ptr<CompileCommandIndex const> cdb_index =
+      std::make_shared<CompileCommandIndex>(*json_db);
+  Milliseconds index = Clock::now() - start;
+
+  start = Clock::now();
+  ScanCompilationDatabase cdb(*json_db, sources, cdb_index);
+  size_t found = 0;
+  for (std::string const &source : sources) {
+    found += !cdb.getCompileCommands(source).empty();
+  }
+  Milliseconds indexed = Clock::now() - start;
+
+  start = Clock::now();
+  ScanCompilationDatabase lazy_cdb(*json_db, sources);
+  size_t lazy_found = 0;
+  for (std::string const &source : sources) {
+    lazy_found += !lazy_cdb.getCompileCommands(source).empty();
+  }
+  Milliseconds lazy = Clock::now() - start;
+
+  start = Clock::now();
+  ScanCompilationDatabase paired_cdb(*json_db, paired_sources);
+  size_t paired_found = 0;
+  for (std::string const &source : paired_sources) {
+    paired_found += !paired_cdb.getCompileCommands(source).empty();
+  }
+  Milliseconds paired = Clock::now() - start;
+
+  start = Clock::now();
+  size_t legacy_found = 0;
+  for (std::string const &source : sources) {
+    legacy_found +=
+        !LegacyCompileCommands(*json_db, sources, source).empty();
+  }
+  Milliseconds legacy = Clock::now() - start;
+
+  SmallString<256> path(dir);
+  sys::path::append(path, "rfl-scan.cdb");
+  std::string snapshot_path(path.begin(), path.end());
+  std::string json_path(db_path.begin(), db_path.end());
+  {
+    CompilationDatabaseSnapshot snapshot;
+    snapshot.Load(snapshot_path, json_path);
+    cdb.AddToSnapshot(&snapshot);
+    if (!snapshot.Save(snapshot_path))
+      return 1;
+  }
+  start = Clock::now();
+  std::shared_ptr<CompilationDatabaseSnapshot> snapshot =
+      std::make_shared<CompilationDatabaseSnapshot>();
+  if (!snapshot->Load(snapshot_path, json_path) ||
+      !snapshot->Covers(sources)) {
+    errs() << "Failed to load snapshot\n";
+    return 1;
+  }
+  ScanCompilationDatabase snapshot_cdb(snapshot, sources);
+  size_t snapshot_found = 0;
+  for (std::string const &source : sources) {
+    snapshot_found += !snapshot_cdb.getCompileCommands(source).empty();
+  }
+  Milliseconds snapshot_load = Clock::now() - start;
+  uint64_t json_size = 0;
+  uint64_t snapshot_size = 0;
+  sys::fs::file_size(db_path, json_size);
+  sys::fs::file_size(snapshot_path, snapshot_size);
+
+  outs() << entries << " entries, " << headers << " headers, database load "
+         << format("%.3f", load.count()) << " ms\n"
+         << "  indexed: " << format("%10.3f", indexed.count())
+         << " ms (+" << format("%.3f", index.count()) << " ms index), "
+         << found << " found\n"
+         << "  lazy:    " << format("%10.3f", lazy.count()) << " ms, "
+         << lazy_found << " found\n"
+         << "  paired:  " << format("%10.3f", paired.count()) << " ms, "
+         << paired_found << " of " << paired_sources.size()
+         << " found without index\n"
+         << "  legacy:  " << format("%10.3f", legacy.count()) << " ms, "
+         << legacy_found << " found\n"
+         << "  snapshot:" << format("%10.3f", snapshot_load.count())
+         << " ms load and lookups, " << snapshot_found << " found, "
+         << snapshot_size << " bytes (database " << json_size << ")\n";
+  return 0;
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Builds a synthetic package the way Scanner does, with one fragment per
+// package file, merges the fragments and serializes the result. Mode 'copy'
+// copies annotations and merged fragments, as the scanner used to, mode
+// 'move' swaps and moves them. Peak RSS is per process, so every mode runs
+// in its own process.
+//
+//   package_benchmark copy|move [classes] [files]
+
+#include "rfl-scan/proto_ast_scan.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace rfl;
+using namespace rfl::scan;
+
+namespace {
+
+unsigned const kFieldsPerClass = 10;
+
+void ReadAnnotation(unsigned index, proto::Annotation *anno) {
+  anno->set_kind("property");
+  proto::Annotation_Entry *entry = anno->add_entries();
+  entry->set_key("kind");
+  entry->set_value("number");
+  entry = anno->add_entries();
+  entry->set_key("name");
+  entry->set_value("Property " + std::to_string(index));
+  entry = anno->add_entries();
+  entry->set_type(proto::Annotation_Entry_Type_INT);
+  entry->set_key("max");
+  entry->set_int_value(index);
+}
+
+void SetAnnotation(proto::Annotation *anno,
+                   proto::Annotation *target,
+                   bool move) {
+  if (move) {
+    target->Swap(anno);
+  } else {
+    target->CopyFrom(*anno);
+  }
+}
+
+void ScanFragment(unsigned file_index,
+                  unsigned classes,
+                  bool move,
+                  ScannerContext *fragment) {
+  std::string file_name = "bench/file" + std::to_string(file_index) + ".h";
+  proto::PackageFile *file = fragment->package().add_package_files();
+  file->set_name(file_name);
+  proto::Namespace *ns = file->add_namespaces();
+  ns->set_name("bench");
+
+  for (unsigned i = 0; i < classes; ++i) {
+    std::string class_name = "Class" + std::to_string(file_index) + "_" +
+                             std::to_string(i);
+    proto::Annotation anno;
+    ReadAnnotation(i, &anno);
+    proto::Class *klass = ns->add_classes();
+    klass->set_name(class_name);
+    klass->set_order(fragment->class_count());
+    SetAnnotation(&anno, klass->mutable_annotation(), move);
+    fragment->set_class_count(fragment->class_count() + 1);
+    fragment->package().add_provided_classes("bench::" + class_name);
+
+    for (unsigned j = 0; j < kFieldsPerClass; ++j) {
+      proto::Annotation field_anno;
+      ReadAnnotation(j, &field_anno);
+      proto::Field *field = klass->add_fields();
+      field->set_name("field" + std::to_string(j) + "_");
+      field->mutable_type_ref()->set_kind(proto::TypeRef_Kind_SYSTEM);
+      field->mutable_type_ref()->set_type_name("float");
+      field->mutable_type_ref()->set_source_file(file_name);
+      field->mutable_type_qualifier()->set_is_pod(true);
+      field->set_offset(j * 4);
+      SetAnnotation(&field_anno, field->mutable_annotation(), move);
+    }
+  }
+}
+
+// Merge as done before fragments were moved.
+void CopyMerge(ScannerContext const &fragment, ScannerContext *scan_ctx) {
+  proto::Package const &pkg = fragment.package();
+  for (int i = 0; i < pkg.package_files_size(); ++i) {
+    scan_ctx->package().add_package_files()->CopyFrom(pkg.package_files(i));
+  }
+  for (int i = 0; i < pkg.provided_classes_size(); ++i) {
+    scan_ctx->package().add_provided_classes(pkg.provided_classes(i));
+  }
+  scan_ctx->set_class_count(scan_ctx->class_count() + fragment.class_count());
+}
+
+long PeakRSSKilobytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2 || (StringRef(argv[1]) != "copy" &&
+                   StringRef(argv[1]) != "move")) {
+    errs() << "usage: " << argv[0] << " copy|move [classes] [files]\n";
+    return 1;
+  }
+  bool move = StringRef(argv[1]) == "move";
+  unsigned classes = argc > 2 ? atoi(argv[2]) : 5000;
+  unsigned files = argc > 3 ? atoi(argv[3]) : 100;
+  if (files == 0 || classes < files) {
+    errs() << "Expected at least one class per file\n";
+    return 1;
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+
+  ScannerContext scan_ctx("");
+  std::vector<std::unique_ptr<ScannerContext>> fragments;
+  for (unsigned i = 0; i < files; ++i) {
+    fragments.push_back(scan_ctx.CreateFragment());
+    ScanFragment(i, classes / files, move, fragments.back().get());
+  }
+  for (std::unique_ptr<ScannerContext> &fragment : fragments) {
+    if (move) {
+      scan_ctx.Merge(fragment.get());
+    } else {
+      CopyMerge(*fragment, &scan_ctx);
+    }
+    fragment.reset();
+  }
+
+  std::string output;
+  scan_ctx.package().SerializeToString(&output);
+
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  outs() << argv[1] << ": " << scan_ctx.class_count() << " classes, "
+         << output.size() << " bytes, "
+         << format("%.1f ms, ", elapsed.count()) << PeakRSSKilobytes()
+         << " KB peak RSS\n";
+  return 0;
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures time spent in Scanner::ReadType for a class with many fields of
+// record and enum types declared in included headers, with and without
+// the path cache.
+//
+//   scan_benchmark [fields] [iterations]
+
+#include "rfl-scan/proto_ast_scan.h"
+#include "rfl-scan/time_trace.h"
+
+#include "clang/Tooling/Tooling.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+using namespace rfl::scan;
+
+namespace {
+
+unsigned const kHeaderCount = 8;
+
+bool WriteFile(StringRef path, std::string const &content) {
+  std::error_code ec;
+  raw_fd_ostream out(path, ec, sys::fs::F_Text);
+  if (ec) {
+    errs() << "Failed to open file " << path << " : " << ec.message() << "\n";
+    return false;
+  }
+  out << content;
+  return true;
+}
+
+// Writes kHeaderCount headers declaring field types and returns source of
+// class using them.
+bool GenerateSources(StringRef dir, unsigned fields, std::string *code) {
+  raw_string_ostream source(*code);
+  source << "#include \"rfl/annotations.h\"\n";
+  for (unsigned h = 0; h < kHeaderCount; ++h) {
+    std::string header;
+    raw_string_ostream out(header);
+    out << "namespace bench {\n";
+    for (unsigned i = h; i < fields; i += kHeaderCount) {
+      out << "struct Record" << i << " { int value; };\n";
+      out << "enum Enum" << i << " { kEnum" << i << " };\n";
+    }
+    out << "} // namespace bench\n";
+    out.flush();
+
+    SmallString<128> path(dir);
+    sys::path::append(path, "types" + std::to_string(h) + ".h");
+    if (!WriteFile(path, header))
+      return false;
+    source << "#include \"" << path << "\"\n";
+  }
+
+  source << "namespace bench {\nclass rfl_class() Benchmark {\n";
+  for (unsigned i = 0; i < fields; ++i) {
+    source << "  rfl_field() Record" << i << " record" << i << "_;\n";
+    source << "  rfl_field() Enum" << i << " enum" << i << "_;\n";
+  }
+  source << "};\n} // namespace bench\n";
+  source.flush();
+  return true;
+}
+
+double ScanMilliseconds(std::string const &code,
+                        std::vector<std::string> const &args,
+                        StringRef basedir,
+                        unsigned iterations,
+                        bool path_cache) {
+  TimeTrace trace;
+  std::shared_ptr<PathCache> cache;
+  if (path_cache)
+    cache = std::make_shared<PathCache>(basedir);
+  for (unsigned i = 0; i < iterations; ++i) {
+    ScannerContext ctx(basedir);
+    ctx.set_time_trace(&trace);
+    ctx.set_path_cache(cache);
+    if (!tooling::runToolOnCodeWithArgs(new ScannerAction(&ctx), code, args,
+                                        "benchmark.cc")) {
+      errs() << "Scan failed\n";
+      exit(1);
+    }
+  }
+  return std::chrono::duration<double, std::milli>(trace.Total("ReadType"))
+             .count() /
+         iterations;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned fields = argc > 1 ? atoi(argv[1]) : 500;
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  SmallString<128> dir;
+  if (std::error_code ec = sys::fs::createUniqueDirectory("rfl-bench", dir)) {
+    errs() << "Failed to create directory : " << ec.message() << "\n";
+    return 1;
+  }
+
+  std::string code;
+  if (!GenerateSources(dir, fields, &code))
+    return 1;
+
+  std::vector<std::string> args;
+  args.push_back("-std=c++11");
+  args.push_back("-D__RFL_SCAN__");
+  args.push_back("-I" RFL_SRC_DIR);
+
+  double uncached = ScanMilliseconds(code, args, dir, iterations, false);
+  double cached = ScanMilliseconds(code, args, dir, iterations, true);
+
+  outs() << "ReadType of " << fields * 2 << " fields, " << iterations
+         << " iterations\n";
+  outs() << format("  without path cache: %8.3f ms\n", uncached);
+  outs() << format("  with path cache:    %8.3f ms\n", cached);
+
+  for (unsigned h = 0; h < kHeaderCount; ++h) {
+    SmallString<128> path(dir);
+    sys::path::append(path, "types" + std::to_string(h) + ".h");
+    sys::fs::remove(path);
+  }
+  sys::fs::remove(dir);
+  return 0;
+}
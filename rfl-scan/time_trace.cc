@@ -0,0 +1,119 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl-scan/time_trace.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+namespace rfl {
+namespace scan {
+
+using namespace llvm;
+
+namespace {
+
+void WriteJSONString(raw_ostream &out, StringRef str) {
+  out << '"';
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      case '\t':
+        out << "\\t";
+        break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          out << format("\\u%04x", (unsigned)c);
+        } else {
+          out << c;
+        }
+    }
+  }
+  out << '"';
+}
+
+int64_t Microseconds(TimeTrace::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+}  // namespace
+
+TimeTrace::TimeTrace() : start_(Clock::now()) {
+}
+
+void TimeTrace::AddEvent(char const *name,
+                         std::string const &detail,
+                         Clock::time_point start,
+                         Clock::duration duration) {
+  Event event;
+  event.name = name;
+  event.detail = detail;
+  event.start = Microseconds(start - start_);
+  event.duration = Microseconds(duration);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  event.thread = ThreadIndex(std::this_thread::get_id());
+  events_.push_back(event);
+}
+
+unsigned TimeTrace::ThreadIndex(std::thread::id id) {
+  std::vector<std::thread::id>::iterator it =
+      std::find(threads_.begin(), threads_.end(), id);
+  if (it != threads_.end())
+    return (unsigned)(it - threads_.begin());
+  threads_.push_back(id);
+  return (unsigned)threads_.size() - 1;
+}
+
+TimeTrace::Clock::duration TimeTrace::Total(char const *name) const {
+  int64_t total = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Event const &event : events_) {
+    if (StringRef(event.name) == name)
+      total += event.duration;
+  }
+  return std::chrono::microseconds(total);
+}
+
+bool TimeTrace::Write(std::string const &path) const {
+  std::error_code ec;
+  raw_fd_ostream out(path, ec, sys::fs::F_Text);
+  if (ec) {
+    errs() << "Failed to open file " << path << " : " << ec.message() << "\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "{\"traceEvents\":[\n";
+  for (size_t i = 0; i < events_.size(); ++i) {
+    Event const &event = events_[i];
+    out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+        << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+        << ",\"name\":";
+    WriteJSONString(out, event.name);
+    if (!event.detail.empty()) {
+      out << ",\"args\":{\"detail\":";
+      WriteJSONString(out, event.detail);
+      out << "}";
+    }
+    out << (i + 1 < events_.size() ? "},\n" : "}\n");
+  }
+  out << "]}\n";
+  return true;
+}
+
+} // namespace scan
+} // namespace rfl
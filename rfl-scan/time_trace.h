@@ -0,0 +1,82 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_SCAN_TIME_TRACE_H__
+#define __RFL_SCAN_TIME_TRACE_H__
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rfl {
+namespace scan {
+
+// Collects timed events of scanning and writes them in Chrome trace event
+// format (chrome://tracing). Events may be added from multiple threads.
+class TimeTrace {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  TimeTrace();
+
+  void AddEvent(char const *name,
+                std::string const &detail,
+                Clock::time_point start,
+                Clock::duration duration);
+
+  bool Write(std::string const &path) const;
+
+  // Sum of durations of all events named |name|.
+  Clock::duration Total(char const *name) const;
+
+private:
+  struct Event {
+    char const *name;
+    std::string detail;
+    int64_t start;
+    int64_t duration;
+    unsigned thread;
+  };
+
+  unsigned ThreadIndex(std::thread::id id);
+
+  Clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  std::vector<std::thread::id> threads_;
+};
+
+// Adds event lasting for the scope lifetime, does nothing without trace.
+class TimeTraceScope {
+public:
+  TimeTraceScope(TimeTrace *trace,
+                 char const *name,
+                 std::string const &detail = std::string())
+      : trace_(trace), name_(name) {
+    if (trace_) {
+      detail_ = detail;
+      start_ = TimeTrace::Clock::now();
+    }
+  }
+  ~TimeTraceScope() {
+    if (trace_) {
+      trace_->AddEvent(name_, detail_, start_,
+                       TimeTrace::Clock::now() - start_);
+    }
+  }
+
+private:
+  TimeTrace *trace_;
+  char const *name_;
+  std::string detail_;
+  TimeTrace::Clock::time_point start_;
+};
+
+} // namespace scan
+} // namespace rfl
+
+#endif /* __RFL_SCAN_TIME_TRACE_H__ */
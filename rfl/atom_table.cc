@@ -0,0 +1,99 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/atom_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace rfl {
+
+namespace {
+
+size_t const kAtomBlockSize = 16 * 1024;
+
+char const kEmptyAtom[] = "";
+
+}  // namespace
+
+Atom::Atom() : str_(kEmptyAtom), table_(nullptr) {
+}
+
+Atom::Atom(char const *str) : str_(kEmptyAtom), table_(nullptr) {
+  if (!str || str[0] == '\0')
+    return;
+  // never destroyed, atoms of nodes may outlive static destructors
+  static AtomTable *shared_table = new AtomTable();
+  static std::mutex *shared_mutex = new std::mutex();
+  std::lock_guard<std::mutex> lock(*shared_mutex);
+  *this = shared_table->Intern(str);
+}
+
+bool Atom::EqualChars(Atom const &x) const {
+  return strcmp(str_, x.str_) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t AtomTable::Hash::operator()(char const *str) const {
+  // FNV-1a
+  uint64 hash = 14695981039346656037ULL;
+  for (; *str; ++str) {
+    hash ^= static_cast<uint8>(*str);
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(hash);
+}
+
+bool AtomTable::Equal::operator()(char const *a, char const *b) const {
+  return strcmp(a, b) == 0;
+}
+
+AtomTable::AtomTable() : ptr_(nullptr), end_(nullptr), bytes_used_(0) {
+}
+
+AtomTable::~AtomTable() {
+  for (char *block : blocks_) {
+    free(block);
+  }
+}
+
+Atom AtomTable::Intern(char const *str) {
+  if (!str || str[0] == '\0')
+    return Atom();
+  auto it = atoms_.find(str);
+  if (it != atoms_.end())
+    return Atom(*it, this);
+
+  size_t size = strlen(str) + 1;
+  if (static_cast<size_t>(end_ - ptr_) < size) {
+    size_t block_size = std::max(kAtomBlockSize, size);
+    blocks_.push_back(static_cast<char *>(malloc(block_size)));
+    ptr_ = blocks_.back();
+    end_ = ptr_ + block_size;
+  }
+  char *atom = ptr_;
+  memcpy(atom, str, size);
+  ptr_ += size;
+  bytes_used_ += size;
+  atoms_.insert(atom);
+  return Atom(atom, this);
+}
+
+bool AtomTable::Find(char const *str, Atom *atom) const {
+  if (!str || str[0] == '\0') {
+    *atom = Atom();
+    return true;
+  }
+  auto it = atoms_.find(str);
+  if (it == atoms_.end())
+    return false;
+  *atom = Atom(*it, this);
+  return true;
+}
+
+} // namespace rfl
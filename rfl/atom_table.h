@@ -0,0 +1,87 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_ATOM_TABLE_H__
+#define __RFL_ATOM_TABLE_H__
+
+#include "rfl/rfl_export.h"
+#include "rfl/types.h"
+
+#include <stddef.h>
+
+#include <unordered_set>
+#include <vector>
+
+namespace rfl {
+
+class AtomTable;
+
+// Interned string. Atoms of the same table are equal when their pointers
+// are, so names are compared without looking at their characters. Atoms of
+// different tables are compared by their characters.
+class RFL_EXPORT Atom {
+public:
+  // Empty string, the same in all tables.
+  Atom();
+  // Interns |str| in the shared table, null is the empty string. Names of
+  // nodes created outside of PackageArena are interned this way. The shared
+  // table is never freed and locked on every call, use Intern() of the
+  // package table where there is one.
+  explicit Atom(char const *str);
+
+  char const *c_str() const { return str_; }
+  bool empty() const { return str_[0] == '\0'; }
+
+  bool operator==(Atom const &x) const {
+    return str_ == x.str_ || (table_ != x.table_ && EqualChars(x));
+  }
+  bool operator!=(Atom const &x) const { return !(*this == x); }
+
+private:
+  friend class AtomTable;
+  Atom(char const *str, AtomTable const *table) : str_(str), table_(table) {}
+
+  bool EqualChars(Atom const &x) const;
+
+  char const *str_;
+  // null for the empty string
+  AtomTable const *table_;
+};
+
+// Strings stored once in blocks that never move. Not thread safe, except
+// for the shared table used by Atom(char const *).
+class RFL_EXPORT AtomTable {
+public:
+  AtomTable();
+  ~AtomTable();
+
+  Atom Intern(char const *str);
+  // Returns false when |str| was never interned.
+  bool Find(char const *str, Atom *atom) const;
+
+  // Number of atoms and bytes of their strings.
+  size_t size() const { return atoms_.size(); }
+  size_t bytes_used() const { return bytes_used_; }
+
+private:
+  struct Hash {
+    size_t operator()(char const *str) const;
+  };
+  struct Equal {
+    bool operator()(char const *a, char const *b) const;
+  };
+
+  AtomTable(AtomTable const &);
+  AtomTable &operator=(AtomTable const &);
+
+  std::unordered_set<char const *, Hash, Equal> atoms_;
+  std::vector<char *> blocks_;
+  char *ptr_;
+  char *end_;
+  size_t bytes_used_;
+};
+
+} // namespace rfl
+
+#endif /* __RFL_ATOM_TABLE_H__ */
@@ -0,0 +1,503 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/package_io.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "google/protobuf/wire_format_lite_inl.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace rfl {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::FileOutputStream;
+using google::protobuf::io::GzipInputStream;
+using google::protobuf::io::GzipOutputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+using google::protobuf::io::ZeroCopyOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+char const kMagic[3] = {'R', 'F', 'L'};
+char const kIndexMagic[4] = {'R', 'F', 'L', 'I'};
+int const kHeaderSize = sizeof(kMagic) + 1;
+
+// Field numbers of proto::Package and proto::PackageFile.
+int const kPackageFiles_Field = 5;
+int const kTypes_Field = 7;
+int const kPackageFileName_Field = 1;
+
+uint64 HashData(char const *data, int size) {
+  uint64 hash = 14695981039346656037ULL;
+  for (int i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool ReadPackageFileName(char const *data, int size, std::string *name) {
+  CodedInputStream in(reinterpret_cast<uint8 const *>(data), size);
+  in.SetTotalBytesLimit(INT_MAX, -1);
+  name->clear();
+  while (uint32 tag = in.ReadTag()) {
+    if (WireFormatLite::GetTagFieldNumber(tag) == kPackageFileName_Field &&
+        WireFormatLite::GetTagWireType(tag) ==
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      return WireFormatLite::ReadString(&in, name);
+    }
+    if (!WireFormatLite::SkipField(&in, tag, NULL))
+      return false;
+  }
+  return in.ConsumedEntireMessage();
+}
+
+// Reads |size| bytes at |offset| of file |fd| into |out|.
+bool ReadAt(int fd, uint64 offset, uint32 size, std::string *out) {
+  if (lseek(fd, offset, SEEK_SET) != static_cast<off_t>(offset))
+    return false;
+  out->resize(size);
+  uint32 done = 0;
+  while (done < size) {
+    int count = read(fd, &(*out)[done], size - done);
+    if (count <= 0)
+      return false;
+    done += count;
+  }
+  return true;
+}
+
+// Reads format version of .rfl file |fd|, along with the compression flag,
+// and for version 3 where its index is. The index has to end right before
+// the footer.
+bool ReadVersion(int fd,
+                 int *version,
+                 uint64 *index_offset,
+                 uint32 *index_size) {
+  std::string buffer;
+  if (!ReadAt(fd, 0, kHeaderSize, &buffer) ||
+      memcmp(buffer.data(), kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+  *version = static_cast<uint8>(buffer[3]);
+  int format = *version & ~kCompressed_PackageFlag;
+  if (format == kV1_PackageFormat || format == kV2_PackageFormat)
+    return true;
+  if (*version != kV3_PackageFormat)
+    return false;
+  off_t end = lseek(fd, 0, SEEK_END);
+  if (end < kHeaderSize + kPackageFooterSize ||
+      !ReadAt(fd, end - kPackageFooterSize, kPackageFooterSize, &buffer) ||
+      !ReadPackageFooter(buffer.data(), index_offset, index_size)) {
+    return false;
+  }
+  return *index_offset >= static_cast<uint64>(kHeaderSize) &&
+         *index_offset + *index_size ==
+             static_cast<uint64>(end - kPackageFooterSize);
+}
+
+}  // namespace
+
+bool AddRecordToIndex(char const *data,
+                      int size,
+                      uint64 offset,
+                      proto::PackageIndex *index) {
+  CodedInputStream in(reinterpret_cast<uint8 const *>(data), size);
+  in.SetTotalBytesLimit(INT_MAX, -1);
+  for (;;) {
+    int start = in.CurrentPosition();
+    uint32 tag = in.ReadTag();
+    if (tag == 0)
+      break;
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    bool is_string = WireFormatLite::GetTagWireType(tag) ==
+                     WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+    if (field == kPackageFiles_Field && is_string) {
+      uint32 length;
+      if (!in.ReadVarint32(&length) ||
+          length > static_cast<uint32>(size - in.CurrentPosition())) {
+        return false;
+      }
+      char const *file_data = data + in.CurrentPosition();
+      proto::PackageIndex::File *file = index->add_files();
+      if (!ReadPackageFileName(file_data, length, file->mutable_name()))
+        return false;
+      file->set_offset(offset + in.CurrentPosition());
+      file->set_size(length);
+      file->set_hash(HashData(file_data, length));
+      in.Skip(length);
+      continue;
+    }
+    if (!WireFormatLite::SkipField(&in, tag, NULL))
+      return false;
+    if (field == kTypes_Field && is_string) {
+      // consecutive types make a single section
+      int length = in.CurrentPosition() - start;
+      int last = index->types_size() - 1;
+      if (last >= 0 && index->types(last).offset() +
+                               index->types(last).size() ==
+                           offset + start) {
+        proto::PackageSection *section = index->mutable_types(last);
+        section->set_size(section->size() + length);
+      } else {
+        proto::PackageSection *section = index->add_types();
+        section->set_offset(offset + start);
+        section->set_size(length);
+      }
+    }
+  }
+  return in.ConsumedEntireMessage() && in.CurrentPosition() == size;
+}
+
+void WritePackageIndex(proto::PackageIndex const &index,
+                       uint64 offset,
+                       CodedOutputStream *out) {
+  uint32 size = index.ByteSize();
+  index.SerializeWithCachedSizes(out);
+  out->WriteLittleEndian64(offset);
+  out->WriteLittleEndian32(size);
+  out->WriteRaw(kIndexMagic, sizeof(kIndexMagic));
+}
+
+bool ReadPackageFooter(char const *footer,
+                       uint64 *index_offset,
+                       uint32 *index_size) {
+  CodedInputStream in(reinterpret_cast<uint8 const *>(footer),
+                      kPackageFooterSize);
+  return in.ReadLittleEndian64(index_offset) &&
+         in.ReadLittleEndian32(index_size) &&
+         memcmp(footer + kPackageFooterSize - sizeof(kIndexMagic),
+                kIndexMagic, sizeof(kIndexMagic)) == 0;
+}
+
+bool DecompressPackage(std::string *data) {
+  if (data->size() < static_cast<size_t>(kHeaderSize) ||
+      !(static_cast<uint8>((*data)[3]) & kCompressed_PackageFlag)) {
+    return true;
+  }
+  std::string plain(data->data(), kHeaderSize);
+  plain[3] = (*data)[3] & ~kCompressed_PackageFlag;
+  ArrayInputStream compressed(data->data() + kHeaderSize,
+                              data->size() - kHeaderSize);
+  GzipInputStream in(&compressed);
+  void const *chunk;
+  int size;
+  while (in.Next(&chunk, &size)) {
+    plain.append(static_cast<char const *>(chunk), size);
+  }
+  // stream errors end the stream as well
+  if (in.ZlibErrorMessage() != nullptr)
+    return false;
+  data->swap(plain);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PackageWriter::PackageWriter() : fd_(-1), failed_(false) {
+}
+
+PackageWriter::~PackageWriter() {
+  Close();
+}
+
+bool PackageWriter::Open(std::string const &path,
+                         proto::Package const &header,
+                         bool compress) {
+  Close();
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if (fd_ < 0)
+    return false;
+  stream_.reset(new FileOutputStream(fd_));
+  path_ = path;
+  index_.Clear();
+  failed_ = false;
+
+  {
+    CodedOutputStream out(stream_.get());
+    out.WriteRaw(kMagic, sizeof(kMagic));
+    uint8 version = compress ? kV2_PackageFormat | kCompressed_PackageFlag
+                             : kV3_PackageFormat;
+    out.WriteRaw(&version, 1);
+    if (out.HadError())
+      return false;
+  }
+  if (compress)
+    gzip_stream_.reset(new GzipOutputStream(stream_.get()));
+  return WriteRecord(header);
+}
+
+bool PackageWriter::WriteRecord(proto::Package const &record) {
+  if (!stream_)
+    return false;
+  // serialized first to find package files and types for the index
+  buffer_.clear();
+  if (!record.AppendToString(&buffer_) || buffer_.size() > INT_MAX) {
+    failed_ = true;
+    return false;
+  }
+  {
+    uint64 position = stream_->ByteCount();
+    CodedOutputStream out(output());
+    out.WriteVarint32(buffer_.size());
+    uint64 offset = position + out.ByteCount();
+    if (gzip_stream_) {
+      // compressed files have no index
+    } else if (!index_.has_header()) {
+      index_.mutable_header()->set_offset(offset);
+      index_.mutable_header()->set_size(buffer_.size());
+    } else if (!AddRecordToIndex(buffer_.data(), buffer_.size(), offset,
+                                 &index_)) {
+      failed_ = true;
+      return false;
+    }
+    out.WriteRaw(buffer_.data(), buffer_.size());
+    if (out.HadError()) {
+      failed_ = true;
+      return false;
+    }
+  }
+  // records are not kept in memory until the file is closed, compressed
+  // ones are in the deflate buffer at most
+  return gzip_stream_ || stream_->Flush();
+}
+
+bool PackageWriter::Close() {
+  if (!stream_)
+    return true;
+  bool ret = !failed_;
+  if (gzip_stream_) {
+    ret = gzip_stream_->Close() && ret;
+    gzip_stream_.reset();
+  } else if (ret) {
+    uint64 offset = stream_->ByteCount();
+    CodedOutputStream out(stream_.get());
+    WritePackageIndex(index_, offset, &out);
+    ret = !out.HadError();
+  }
+  ret = stream_->Flush() && ret;
+  stream_.reset();
+  ret = close(fd_) == 0 && ret;
+  fd_ = -1;
+  return ret;
+}
+
+ZeroCopyOutputStream *PackageWriter::output() const {
+  if (gzip_stream_)
+    return gzip_stream_.get();
+  return stream_.get();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PackageReader::PackageReader()
+    : version_(0), records_end_(0), error_(false), done_(true) {
+}
+
+PackageReader::~PackageReader() {
+  Close();
+}
+
+bool PackageReader::Open(std::string const &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0)
+    return false;
+  int version;
+  uint64 index_offset = 0;
+  uint32 index_size;
+  if (!ReadVersion(fd, &version, &index_offset, &index_size) ||
+      lseek(fd, kHeaderSize, SEEK_SET) != kHeaderSize) {
+    close(fd);
+    return false;
+  }
+  stream_.reset(new FileInputStream(fd));
+  stream_->SetCloseOnDelete(true);
+  if (version & kCompressed_PackageFlag)
+    gzip_stream_.reset(new GzipInputStream(stream_.get()));
+  version_ = version & ~kCompressed_PackageFlag;
+  // records of version 3 are followed by the index
+  records_end_ = version == kV3_PackageFormat ? index_offset - kHeaderSize
+                                              : ~static_cast<uint64>(0);
+  error_ = false;
+  done_ = false;
+  return true;
+}
+
+void PackageReader::Close() {
+  gzip_stream_.reset();
+  stream_.reset();
+  version_ = 0;
+  done_ = true;
+}
+
+bool PackageReader::ReadRecord(proto::Package *record) {
+  if (!stream_ || done_)
+    return false;
+
+  record->Clear();
+  // position relative to the first record, the stream is not read yet
+  uint64 position = input()->ByteCount();
+  CodedInputStream in(input());
+  in.SetTotalBytesLimit(INT_MAX, -1);
+  if (version_ == kV1_PackageFormat) {
+    done_ = true;
+    if (!record->ParseFromCodedStream(&in) || !in.ConsumedEntireMessage())
+      error_ = true;
+    return !error_;
+  }
+
+  void const *data;
+  int available;
+  if (position >= records_end_ ||
+      !in.GetDirectBufferPointer(&data, &available)) {
+    done_ = true;
+    error_ = gzip_stream_ && gzip_stream_->ZlibErrorMessage() != nullptr;
+    return false;
+  }
+  uint32 size;
+  if (!in.ReadVarint32(&size) ||
+      size > records_end_ - position - in.CurrentPosition()) {
+    done_ = true;
+    error_ = true;
+    return false;
+  }
+  CodedInputStream::Limit limit = in.PushLimit(size);
+  if (!record->ParseFromCodedStream(&in) || !in.ConsumedEntireMessage() ||
+      in.BytesUntilLimit() != 0) {
+    done_ = true;
+    error_ = true;
+    return false;
+  }
+  in.PopLimit(limit);
+  return true;
+}
+
+ZeroCopyInputStream *PackageReader::input() const {
+  if (gzip_stream_)
+    return gzip_stream_.get();
+  return stream_.get();
+}
+
+bool ReadPackage(std::string const &path, proto::Package *pkg) {
+  PackageReader reader;
+  if (!reader.Open(path))
+    return false;
+  pkg->Clear();
+  proto::Package record;
+  while (reader.ReadRecord(&record)) {
+    pkg->MergeFrom(record);
+  }
+  return !reader.has_error();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PackageIndexReader::PackageIndexReader() : fd_(-1) {
+}
+
+PackageIndexReader::~PackageIndexReader() {
+  Close();
+}
+
+bool PackageIndexReader::Open(std::string const &path) {
+  Close();
+  fd_ = open(path.c_str(), O_RDONLY | O_BINARY);
+  if (fd_ < 0)
+    return false;
+  int version;
+  uint64 index_offset;
+  uint32 index_size;
+  if (!ReadVersion(fd_, &version, &index_offset, &index_size) ||
+      version != kV3_PackageFormat ||
+      !ReadSection(index_offset, index_size) ||
+      !index_.ParseFromString(buffer_)) {
+    Close();
+    return false;
+  }
+
+  // sections have to be within records
+  bool valid = index_.header().offset() + index_.header().size() <=
+               index_offset;
+  for (int i = 0; i < index_.files_size(); ++i) {
+    proto::PackageIndex::File const &file = index_.files(i);
+    valid = valid && file.offset() + file.size() <= index_offset;
+  }
+  for (int i = 0; i < index_.types_size(); ++i) {
+    proto::PackageSection const &section = index_.types(i);
+    valid = valid && section.offset() + section.size() <= index_offset;
+  }
+  if (!valid)
+    Close();
+  return valid;
+}
+
+void PackageIndexReader::Close() {
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+  index_.Clear();
+}
+
+int PackageIndexReader::FindFile(std::string const &name) const {
+  for (int i = 0; i < index_.files_size(); ++i) {
+    if (index_.files(i).name() == name)
+      return i;
+  }
+  return -1;
+}
+
+bool PackageIndexReader::ReadHeader(proto::Package *header) {
+  return ReadSection(index_.header().offset(), index_.header().size()) &&
+         header->ParseFromString(buffer_);
+}
+
+bool PackageIndexReader::ReadTypes(proto::Package *pkg) {
+  pkg->clear_types();
+  for (int i = 0; i < index_.types_size(); ++i) {
+    proto::PackageSection const &section = index_.types(i);
+    if (!ReadSection(section.offset(), section.size()))
+      return false;
+    CodedInputStream in(reinterpret_cast<uint8 const *>(buffer_.data()),
+                        buffer_.size());
+    in.SetTotalBytesLimit(INT_MAX, -1);
+    if (!pkg->MergeFromCodedStream(&in))
+      return false;
+  }
+  return true;
+}
+
+bool PackageIndexReader::ReadPackageFile(int i, proto::PackageFile *file) {
+  if (i < 0 || i >= index_.files_size())
+    return false;
+  proto::PackageIndex::File const &entry = index_.files(i);
+  return ReadSection(entry.offset(), entry.size()) &&
+         file->ParseFromString(buffer_);
+}
+
+bool PackageIndexReader::ReadSection(uint64 offset, uint32 size) {
+  return fd_ >= 0 && ReadAt(fd_, offset, size, &buffer_);
+}
+
+} // namespace rfl
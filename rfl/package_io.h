@@ -0,0 +1,174 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_PACKAGE_IO_H__
+#define __RFL_PACKAGE_IO_H__
+
+#include "rfl/rfl_export.h"
+#include "rfl/reflected.pb.h"
+#include "rfl/types.h"
+
+#include <memory>
+#include <string>
+
+namespace google {
+namespace protobuf {
+namespace io {
+class CodedOutputStream;
+class FileInputStream;
+class FileOutputStream;
+class GzipInputStream;
+class GzipOutputStream;
+class ZeroCopyInputStream;
+class ZeroCopyOutputStream;
+} // namespace io
+} // namespace protobuf
+} // namespace google
+
+namespace rfl {
+
+// .rfl files start with 'RFL' followed by a format version byte.
+//
+// Version 1 is a single serialized proto::Package.
+//
+// Version 2 is a stream of proto::Package records, each prefixed by its
+// varint encoded size. The first record holds the package header (name,
+// version, imports and libraries), every following one the package files
+// and provided classes of a single translation unit. The package is the
+// merge of all records, so records can be consumed one by one.
+//
+// Version 3 is version 2 followed by a serialized proto::PackageIndex and
+// a footer of kPackageFooterSize bytes: little endian 64 bit offset and 32
+// bit size of the index, and 'RFLI'. The index tells where the header
+// record, every encoded package file and the type table are, so that
+// readers can seek to the package files they need, and hashes of package
+// files, so that they can be compared without decoding.
+//
+// Version byte with kCompressed_PackageFlag set tells that the rest of the
+// file is gzip compressed. Only versions 1 and 2 are compressed, the index
+// would need the file to be decompressed to be of use anyway.
+enum PackageFormat {
+  kV1_PackageFormat = 1,
+  kV2_PackageFormat = 2,
+  kV3_PackageFormat = 3,
+};
+
+uint8 const kCompressed_PackageFlag = 0x80;
+int const kPackageFooterSize = 16;
+
+// Adds package files and types of encoded record |data| found at |offset|
+// of the file to |index|.
+RFL_EXPORT bool AddRecordToIndex(char const *data,
+                                 int size,
+                                 uint64 offset,
+                                 proto::PackageIndex *index);
+// Writes |index| found at |offset| of the file followed by the footer.
+RFL_EXPORT void WritePackageIndex(
+    proto::PackageIndex const &index,
+    uint64 offset,
+    google::protobuf::io::CodedOutputStream *out);
+// Reads offset and size of the index from |footer| of kPackageFooterSize
+// bytes.
+RFL_EXPORT bool ReadPackageFooter(char const *footer,
+                                  uint64 *index_offset,
+                                  uint32 *index_size);
+// Replaces compressed .rfl file content |data| by its uncompressed form,
+// leaves uncompressed content as it is.
+RFL_EXPORT bool DecompressPackage(std::string *data);
+
+// Writes version 3 .rfl files record by record, the index is written on
+// Close(). Compressed files are version 2.
+class RFL_EXPORT PackageWriter {
+public:
+  PackageWriter();
+  ~PackageWriter();
+
+  // Creates |path| and writes |header| as the first record.
+  bool Open(std::string const &path,
+            proto::Package const &header,
+            bool compress = false);
+  bool WriteRecord(proto::Package const &record);
+  bool Close();
+
+  bool is_open() const { return stream_ != nullptr; }
+  bool is_compressed() const { return gzip_stream_ != nullptr; }
+  std::string const &path() const { return path_; }
+
+private:
+  google::protobuf::io::ZeroCopyOutputStream *output() const;
+
+  int fd_;
+  std::unique_ptr<google::protobuf::io::FileOutputStream> stream_;
+  std::unique_ptr<google::protobuf::io::GzipOutputStream> gzip_stream_;
+  std::string path_;
+  std::string buffer_;
+  proto::PackageIndex index_;
+  bool failed_;
+};
+
+// Reads .rfl files of all versions record by record, a version 1 file is
+// read as a single record.
+class RFL_EXPORT PackageReader {
+public:
+  PackageReader();
+  ~PackageReader();
+
+  bool Open(std::string const &path);
+  void Close();
+
+  int version() const { return version_; }
+  bool is_compressed() const { return gzip_stream_ != nullptr; }
+
+  // Reads next record into |record|. Returns false at the end of file or on
+  // error, which is told by has_error().
+  bool ReadRecord(proto::Package *record);
+  bool has_error() const { return error_; }
+
+private:
+  google::protobuf::io::ZeroCopyInputStream *input() const;
+
+  std::unique_ptr<google::protobuf::io::FileInputStream> stream_;
+  std::unique_ptr<google::protobuf::io::GzipInputStream> gzip_stream_;
+  int version_;
+  // end of records, the index of version 3
+  uint64 records_end_;
+  bool error_;
+  bool done_;
+};
+
+// Reads header, types and single package files of version 3 .rfl files
+// through the index, without reading the rest.
+class RFL_EXPORT PackageIndexReader {
+public:
+  PackageIndexReader();
+  ~PackageIndexReader();
+
+  // Reads the index, fails for other format versions.
+  bool Open(std::string const &path);
+  void Close();
+
+  proto::PackageIndex const &index() const { return index_; }
+  // Returns position of package file |name| in index().files() or -1.
+  int FindFile(std::string const &name) const;
+
+  bool ReadHeader(proto::Package *header);
+  // Reads the type table into |pkg|, for GetTypeRef() of package files
+  // read by ReadPackageFile().
+  bool ReadTypes(proto::Package *pkg);
+  bool ReadPackageFile(int i, proto::PackageFile *file);
+
+private:
+  bool ReadSection(uint64 offset, uint32 size);
+
+  int fd_;
+  proto::PackageIndex index_;
+  std::string buffer_;
+};
+
+// Reads whole package of .rfl file |path| into |pkg|.
+RFL_EXPORT bool ReadPackage(std::string const &path, proto::Package *pkg);
+
+} // namespace rfl
+
+#endif /* __RFL_PACKAGE_IO_H__ */
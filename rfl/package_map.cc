@@ -0,0 +1,508 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/package_map.h"
+
+#include "rfl/package_types.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <unordered_map>
+#include <vector>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace rfl {
+namespace package_map {
+
+namespace {
+
+using google::protobuf::RepeatedPtrField;
+
+size_t const kAlignment = 8;
+
+size_t const kRecordSize[kTable_Count] = {
+    1,                             // kStrings_Table
+    sizeof(uint32),                // kImports_Table
+    sizeof(uint32),                // kLibraries_Table
+    sizeof(FileRecord),            // kFiles_Table
+    sizeof(NamespaceRecord),       // kNamespaces_Table
+    sizeof(ClassRecord),           // kClasses_Table
+    sizeof(FieldRecord),           // kFields_Table
+    sizeof(MethodRecord),          // kMethods_Table
+    sizeof(FunctionRecord),        // kFunctions_Table
+    sizeof(ArgumentRecord),        // kArguments_Table
+    sizeof(EnumRecord),            // kEnums_Table
+    sizeof(EnumItemRecord),        // kEnumItems_Table
+    sizeof(TypedefRecord),         // kTypedefs_Table
+    sizeof(AnnotationRecord),      // kAnnotations_Table
+    sizeof(AnnotationEntryRecord), // kAnnotationEntries_Table
+};
+
+uint32 GetQualifierFlags(proto::TypeQualifier const &qualifier) {
+  uint32 flags = 0;
+  if (qualifier.is_pointer())
+    flags |= kPointer_Qualifier;
+  if (qualifier.is_ref())
+    flags |= kRef_Qualifier;
+  if (qualifier.is_pod())
+    flags |= kPod_Qualifier;
+  if (qualifier.is_array())
+    flags |= kArray_Qualifier;
+  if (qualifier.is_const())
+    flags |= kConst_Qualifier;
+  if (qualifier.is_volatile())
+    flags |= kVolatile_Qualifier;
+  if (qualifier.is_restrict())
+    flags |= kRestrict_Qualifier;
+  return flags;
+}
+
+// Flattens proto::Package into tables. Children of a record are reserved
+// as a contiguous range of their table before they are filled, so nested
+// classes and namespaces end up after their siblings.
+class Builder {
+public:
+  // offset 0 is the empty string
+  Builder() : pkg_(nullptr), file_(nullptr) {
+    strings_.append(kAlignment, '\0');
+  }
+
+  void Build(proto::Package const &pkg, std::string *out);
+
+private:
+  uint32 AddString(std::string const &str);
+  uint32 AddAnnotation(bool has_annotation, proto::Annotation const &anno);
+  uint32 AddArgument(proto::Argument const &arg);
+  void SetTypeRef(proto::TypeRef const &type_ref, TypeRefRecord *record);
+
+  template <class R, class M>
+  Range AddChildren(RepeatedPtrField<M> const &items, std::vector<R> *table) {
+    Range range = {static_cast<uint32>(table->size()),
+                   static_cast<uint32>(items.size())};
+    table->resize(table->size() + items.size());
+    for (int i = 0; i < items.size(); ++i) {
+      // filling may grow |table|, so the record is copied in afterwards
+      R record;
+      memset(&record, 0, sizeof(record));
+      Fill(items.Get(i), &record);
+      (*table)[range.first + i] = record;
+    }
+    return range;
+  }
+
+  void Fill(proto::Annotation::Entry const &entry,
+            AnnotationEntryRecord *record);
+  void Fill(proto::Enum::Item const &item, EnumItemRecord *record);
+  void Fill(proto::Enum const &enm, EnumRecord *record);
+  void Fill(proto::Argument const &arg, ArgumentRecord *record);
+  void Fill(proto::Typedef const &tdef, TypedefRecord *record);
+  void Fill(proto::Field const &field, FieldRecord *record);
+  void Fill(proto::Method const &method, MethodRecord *record);
+  void Fill(proto::Function const &function, FunctionRecord *record);
+  void Fill(proto::Class const &klass, ClassRecord *record);
+  void Fill(proto::Namespace const &ns, NamespaceRecord *record);
+  void Fill(proto::PackageFile const &file, FileRecord *record);
+
+  template <class T>
+  void AppendTable(Table table, std::vector<T> const &records, Header *header,
+                   std::string *out) {
+    AppendTable(table, records.data(), records.size(), header, out);
+  }
+  void AppendTable(Table table, void const *data, size_t count,
+                   Header *header, std::string *out);
+
+  // package and file being filled, types are looked up in them
+  proto::Package const *pkg_;
+  proto::PackageFile const *file_;
+  std::string strings_;
+  std::unordered_map<std::string, uint32> string_refs_;
+  std::vector<uint32> imports_;
+  std::vector<uint32> libraries_;
+  std::vector<FileRecord> files_;
+  std::vector<NamespaceRecord> namespaces_;
+  std::vector<ClassRecord> classes_;
+  std::vector<FieldRecord> fields_;
+  std::vector<MethodRecord> methods_;
+  std::vector<FunctionRecord> functions_;
+  std::vector<ArgumentRecord> arguments_;
+  std::vector<EnumRecord> enums_;
+  std::vector<EnumItemRecord> enum_items_;
+  std::vector<TypedefRecord> typedefs_;
+  std::vector<AnnotationRecord> annotations_;
+  std::vector<AnnotationEntryRecord> annotation_entries_;
+};
+
+uint32 Builder::AddString(std::string const &str) {
+  if (str.empty())
+    return 0;
+  auto it = string_refs_.find(str);
+  if (it != string_refs_.end())
+    return it->second;
+  uint32 ref = strings_.size();
+  uint32 size = str.size();
+  strings_.append(reinterpret_cast<char const *>(&size), sizeof(size));
+  strings_.append(str.c_str(), str.size() + 1);
+  // keep size prefixes aligned
+  size_t padding = strings_.size() % sizeof(size);
+  if (padding)
+    strings_.append(sizeof(size) - padding, '\0');
+  string_refs_.insert(std::make_pair(str, ref));
+  return ref;
+}
+
+uint32 Builder::AddAnnotation(bool has_annotation,
+                              proto::Annotation const &anno) {
+  if (!has_annotation)
+    return kNone;
+  AnnotationRecord record;
+  record.kind = AddString(anno.kind());
+  record.entries = AddChildren(anno.entries(), &annotation_entries_);
+  annotations_.push_back(record);
+  return annotations_.size() - 1;
+}
+
+uint32 Builder::AddArgument(proto::Argument const &arg) {
+  ArgumentRecord record;
+  memset(&record, 0, sizeof(record));
+  Fill(arg, &record);
+  arguments_.push_back(record);
+  return arguments_.size() - 1;
+}
+
+void Builder::SetTypeRef(proto::TypeRef const &type_ref,
+                         TypeRefRecord *record) {
+  record->kind = type_ref.kind();
+  record->type_name = AddString(type_ref.type_name());
+  record->source_file = AddString(type_ref.source_file());
+  record->underlying_type = AddString(type_ref.underlying_type());
+}
+
+void Builder::Fill(proto::Annotation::Entry const &entry,
+                   AnnotationEntryRecord *record) {
+  record->key = AddString(entry.key());
+  record->type = entry.type();
+  record->value = AddString(entry.value());
+  switch (entry.type()) {
+    case proto::Annotation::Entry::INT:
+      record->number = entry.int_value();
+      break;
+    case proto::Annotation::Entry::FLOAT: {
+      double value = entry.float_value();
+      memcpy(&record->number, &value, sizeof(value));
+      break;
+    }
+    case proto::Annotation::Entry::BOOL:
+      record->number = entry.bool_value() ? 1 : 0;
+      break;
+    default:
+      break;
+  }
+}
+
+void Builder::Fill(proto::Enum::Item const &item, EnumItemRecord *record) {
+  record->id = AddString(item.id());
+  record->value = item.value();
+}
+
+void Builder::Fill(proto::Enum const &enm, EnumRecord *record) {
+  record->name = AddString(enm.name());
+  record->type = AddString(enm.type());
+  record->annotation = AddAnnotation(enm.has_annotation(), enm.annotation());
+  record->items = AddChildren(enm.items(), &enum_items_);
+}
+
+void Builder::Fill(proto::Argument const &arg, ArgumentRecord *record) {
+  record->name = AddString(arg.name());
+  SetTypeRef(GetTypeRef(*pkg_, *file_, arg), &record->type_ref);
+  record->qualifiers = GetQualifierFlags(arg.type_qualifier());
+  record->annotation = AddAnnotation(arg.has_annotation(), arg.annotation());
+}
+
+void Builder::Fill(proto::Typedef const &tdef, TypedefRecord *record) {
+  record->name = AddString(tdef.name());
+  SetTypeRef(GetTypeRef(*pkg_, *file_, tdef), &record->type_ref);
+  record->qualifiers = GetQualifierFlags(tdef.type_qualifier());
+  record->annotation =
+      AddAnnotation(tdef.has_annotation(), tdef.annotation());
+}
+
+void Builder::Fill(proto::Field const &field, FieldRecord *record) {
+  record->name = AddString(field.name());
+  SetTypeRef(GetTypeRef(*pkg_, *file_, field), &record->type_ref);
+  record->qualifiers = GetQualifierFlags(field.type_qualifier());
+  record->annotation =
+      AddAnnotation(field.has_annotation(), field.annotation());
+  record->offset = field.offset();
+}
+
+void Builder::Fill(proto::Method const &method, MethodRecord *record) {
+  record->name = AddString(method.name());
+  record->annotation =
+      AddAnnotation(method.has_annotation(), method.annotation());
+  record->arguments = AddChildren(method.arguments(), &arguments_);
+  record->return_value = method.has_return_value()
+                             ? AddArgument(method.return_value())
+                             : kNone;
+  record->static_method = method.static_method();
+}
+
+void Builder::Fill(proto::Function const &function, FunctionRecord *record) {
+  record->name = AddString(function.name());
+  record->annotation =
+      AddAnnotation(function.has_annotation(), function.annotation());
+  record->arguments = AddChildren(function.arguments(), &arguments_);
+  record->return_value = function.has_return_value()
+                             ? AddArgument(function.return_value())
+                             : kNone;
+}
+
+void Builder::Fill(proto::Class const &klass, ClassRecord *record) {
+  record->name = AddString(klass.name());
+  record->order = klass.order();
+  record->base_class_offset = klass.base_class_offset();
+  record->has_base_class = klass.has_base_class();
+  SetTypeRef(klass.base_class(), &record->base_class);
+  record->annotation =
+      AddAnnotation(klass.has_annotation(), klass.annotation());
+  record->fields = AddChildren(klass.fields(), &fields_);
+  record->methods = AddChildren(klass.methods(), &methods_);
+  record->enums = AddChildren(klass.enums(), &enums_);
+  record->classes = AddChildren(klass.classes(), &classes_);
+  record->typedefs = AddChildren(klass.typedefs(), &typedefs_);
+}
+
+void Builder::Fill(proto::Namespace const &ns, NamespaceRecord *record) {
+  record->name = AddString(ns.name());
+  record->annotation = AddAnnotation(ns.has_annotation(), ns.annotation());
+  record->classes = AddChildren(ns.classes(), &classes_);
+  record->enums = AddChildren(ns.enums(), &enums_);
+  record->namespaces = AddChildren(ns.namespaces(), &namespaces_);
+  record->functions = AddChildren(ns.functions(), &functions_);
+  record->typedefs = AddChildren(ns.typedefs(), &typedefs_);
+}
+
+void Builder::Fill(proto::PackageFile const &file, FileRecord *record) {
+  file_ = &file;
+  record->name = AddString(file.name());
+  record->source_file = AddString(file.source_file());
+  record->is_dependency = file.is_dependecy();
+  record->namespaces = AddChildren(file.namespaces(), &namespaces_);
+  record->classes = AddChildren(file.classes(), &classes_);
+  record->enums = AddChildren(file.enums(), &enums_);
+  record->functions = AddChildren(file.functions(), &functions_);
+  record->typedefs = AddChildren(file.typedefs(), &typedefs_);
+}
+
+void Builder::AppendTable(Table table,
+                          void const *data,
+                          size_t count,
+                          Header *header,
+                          std::string *out) {
+  out->append((kAlignment - out->size() % kAlignment) % kAlignment, '\0');
+  header->tables[table].offset = out->size();
+  header->tables[table].count = count;
+  if (count)
+    out->append(static_cast<char const *>(data), count * kRecordSize[table]);
+}
+
+void Builder::Build(proto::Package const &pkg, std::string *out) {
+  Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  pkg_ = &pkg;
+  header.name = AddString(pkg.name());
+  header.package_version = AddString(pkg.version());
+  for (int i = 0; i < pkg.imports_size(); ++i) {
+    imports_.push_back(AddString(pkg.imports(i)));
+  }
+  for (int i = 0; i < pkg.libraries_size(); ++i) {
+    libraries_.push_back(AddString(pkg.libraries(i)));
+  }
+  AddChildren(pkg.package_files(), &files_);
+
+  // offsets are relative to the start of the map
+  std::string data(sizeof(header), '\0');
+  AppendTable(kStrings_Table, strings_.data(), strings_.size(), &header,
+              &data);
+  AppendTable(kImports_Table, imports_, &header, &data);
+  AppendTable(kLibraries_Table, libraries_, &header, &data);
+  AppendTable(kFiles_Table, files_, &header, &data);
+  AppendTable(kNamespaces_Table, namespaces_, &header, &data);
+  AppendTable(kClasses_Table, classes_, &header, &data);
+  AppendTable(kFields_Table, fields_, &header, &data);
+  AppendTable(kMethods_Table, methods_, &header, &data);
+  AppendTable(kFunctions_Table, functions_, &header, &data);
+  AppendTable(kArguments_Table, arguments_, &header, &data);
+  AppendTable(kEnums_Table, enums_, &header, &data);
+  AppendTable(kEnumItems_Table, enum_items_, &header, &data);
+  AppendTable(kTypedefs_Table, typedefs_, &header, &data);
+  AppendTable(kAnnotations_Table, annotations_, &header, &data);
+  AppendTable(kAnnotationEntries_Table, annotation_entries_, &header, &data);
+  header.size = data.size();
+  memcpy(&data[0], &header, sizeof(header));
+  out->append(data);
+}
+
+}  // namespace
+
+PackageMap::PackageMap()
+    : data_(nullptr), header_(nullptr), mapping_(nullptr), mapping_size_(0) {
+}
+
+PackageMap::~PackageMap() {
+  Close();
+}
+
+bool PackageMap::Open(std::string const &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+#if OS_POSIX
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+#else
+  // no mapping, the file is read into aligned memory instead
+  void *mapping = new uint64[(size + sizeof(uint64) - 1) / sizeof(uint64)];
+  bool read_ok = read(fd, mapping, size) == static_cast<int>(size);
+  close(fd);
+  if (!read_ok) {
+    delete[] static_cast<uint64 *>(mapping);
+    return false;
+  }
+#endif
+  mapping_ = mapping;
+  mapping_size_ = size;
+  if (!Attach(mapping, size)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool PackageMap::Attach(void const *data, size_t size) {
+  data_ = static_cast<char const *>(data);
+  header_ = static_cast<Header const *>(data);
+  if (!Validate(size)) {
+    data_ = nullptr;
+    header_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void PackageMap::Close() {
+  data_ = nullptr;
+  header_ = nullptr;
+  if (!mapping_)
+    return;
+#if OS_POSIX
+  munmap(mapping_, mapping_size_);
+#else
+  delete[] static_cast<uint64 *>(mapping_);
+#endif
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+}
+
+bool PackageMap::Validate(size_t size) const {
+  if (size < sizeof(Header) ||
+      reinterpret_cast<uintptr_t>(data_) % kAlignment != 0 ||
+      header_->magic != kMagic || header_->version != kVersion ||
+      header_->size != size) {
+    return false;
+  }
+  // only table bounds are checked here, references within records are
+  // checked when followed
+  for (int i = 0; i < kTable_Count; ++i) {
+    TableEntry const &table = header_->tables[i];
+    if (table.offset % kAlignment != 0 || table.offset > size ||
+        table.count > (size - table.offset) / kRecordSize[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+String PackageMap::GetString(uint32 ref) const {
+  TableEntry const &table = header_->tables[kStrings_Table];
+  if (ref == 0 || table.count < sizeof(uint32) + 1 ||
+      ref > table.count - sizeof(uint32) - 1 ||
+      ref % sizeof(uint32) != 0) {
+    return String();
+  }
+  char const *str = data_ + table.offset + ref;
+  uint32 size = *reinterpret_cast<uint32 const *>(str);
+  if (size > table.count - ref - sizeof(uint32) - 1)
+    return String();
+  return String(str + sizeof(uint32), size);
+}
+
+String PackageMap::name() const {
+  return header_ ? GetString(header_->name) : String();
+}
+
+String PackageMap::version() const {
+  return header_ ? GetString(header_->package_version) : String();
+}
+
+int PackageMap::imports_size() const {
+  return table_count(kImports_Table);
+}
+
+String PackageMap::imports(int index) const {
+  uint32 const *ref = GetRecord<uint32>(kImports_Table, index);
+  return ref ? GetString(*ref) : String();
+}
+
+int PackageMap::libraries_size() const {
+  return table_count(kLibraries_Table);
+}
+
+String PackageMap::libraries(int index) const {
+  uint32 const *ref = GetRecord<uint32>(kLibraries_Table, index);
+  return ref ? GetString(*ref) : String();
+}
+
+int PackageMap::files_size() const {
+  return table_count(kFiles_Table);
+}
+
+void BuildPackageMap(proto::Package const &pkg, std::string *out) {
+  Builder builder;
+  builder.Build(pkg, out);
+}
+
+bool WritePackageMap(proto::Package const &pkg, std::string const &path) {
+  std::string data;
+  BuildPackageMap(pkg, &data);
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if (fd < 0)
+    return false;
+  bool ret = write(fd, data.data(), data.size()) ==
+             static_cast<ssize_t>(data.size());
+  return close(fd) == 0 && ret;
+}
+
+} // namespace package_map
+} // namespace rfl
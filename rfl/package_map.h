@@ -0,0 +1,625 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_PACKAGE_MAP_H__
+#define __RFL_PACKAGE_MAP_H__
+
+#include "rfl/rfl_export.h"
+#include "rfl/reflected.pb.h"
+#include "rfl/types.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+
+namespace rfl {
+
+// .rflm files hold a proto::Package as flat tables of fixed size records,
+// meant to be mapped into memory and read in place. Nothing is parsed or
+// allocated when a file is loaded, views below point straight into the
+// mapped data.
+//
+// The file starts with a Header followed by tables, each 8 byte aligned.
+// Integers are in native byte order, the magic tells when it does not match.
+// Strings are referenced by offset into a single table of deduplicated
+// strings, each prefixed by its 32 bit size and terminated by NUL; offset 0
+// is the empty string. Optional records are referenced by index into their
+// table or kNone, child records by a Range of indices.
+namespace package_map {
+
+uint32 const kMagic = 0x4d4c4652; // 'RFLM'
+uint32 const kVersion = 1;
+uint32 const kNone = 0xffffffff;
+
+enum Table {
+  kStrings_Table = 0,
+  kImports_Table,
+  kLibraries_Table,
+  kFiles_Table,
+  kNamespaces_Table,
+  kClasses_Table,
+  kFields_Table,
+  kMethods_Table,
+  kFunctions_Table,
+  kArguments_Table,
+  kEnums_Table,
+  kEnumItems_Table,
+  kTypedefs_Table,
+  kAnnotations_Table,
+  kAnnotationEntries_Table,
+  kTable_Count
+};
+
+enum QualifierFlags {
+  kPointer_Qualifier = 1 << 0,
+  kRef_Qualifier = 1 << 1,
+  kPod_Qualifier = 1 << 2,
+  kArray_Qualifier = 1 << 3,
+  kConst_Qualifier = 1 << 4,
+  kVolatile_Qualifier = 1 << 5,
+  kRestrict_Qualifier = 1 << 6,
+};
+
+struct TableEntry {
+  uint32 offset;
+  uint32 count; // in bytes for kStrings_Table, in records otherwise
+};
+
+struct Header {
+  uint32 magic;
+  uint32 version;
+  uint32 size;
+  uint32 name;
+  uint32 package_version;
+  uint32 reserved;
+  TableEntry tables[kTable_Count];
+};
+
+struct Range {
+  uint32 first;
+  uint32 count;
+};
+
+struct TypeRefRecord {
+  uint32 kind;
+  uint32 type_name;
+  uint32 source_file;
+  uint32 underlying_type;
+};
+
+struct AnnotationEntryRecord {
+  uint32 key;
+  uint32 type;
+  uint32 value;
+  uint32 reserved;
+  int64 number; // int or bool value, bits of double for floats
+};
+
+struct AnnotationRecord {
+  uint32 kind;
+  Range entries;
+};
+
+struct EnumItemRecord {
+  uint32 id;
+  uint32 reserved;
+  int64 value;
+};
+
+struct EnumRecord {
+  uint32 name;
+  uint32 type;
+  uint32 annotation;
+  Range items;
+};
+
+struct ArgumentRecord {
+  uint32 name;
+  TypeRefRecord type_ref;
+  uint32 qualifiers;
+  uint32 annotation;
+};
+
+struct TypedefRecord {
+  uint32 name;
+  TypeRefRecord type_ref;
+  uint32 qualifiers;
+  uint32 annotation;
+};
+
+struct FieldRecord {
+  uint32 name;
+  TypeRefRecord type_ref;
+  uint32 qualifiers;
+  uint32 annotation;
+  uint32 offset;
+};
+
+struct MethodRecord {
+  uint32 name;
+  uint32 annotation;
+  uint32 return_value;
+  uint32 static_method;
+  Range arguments;
+};
+
+struct FunctionRecord {
+  uint32 name;
+  uint32 annotation;
+  uint32 return_value;
+  Range arguments;
+};
+
+struct ClassRecord {
+  uint32 name;
+  uint32 order;
+  uint32 base_class_offset;
+  uint32 has_base_class;
+  TypeRefRecord base_class;
+  uint32 annotation;
+  Range fields;
+  Range methods;
+  Range enums;
+  Range classes;
+  Range typedefs;
+};
+
+struct NamespaceRecord {
+  uint32 name;
+  uint32 annotation;
+  Range classes;
+  Range enums;
+  Range namespaces;
+  Range functions;
+  Range typedefs;
+};
+
+struct FileRecord {
+  uint32 name;
+  uint32 source_file;
+  uint32 is_dependency;
+  Range namespaces;
+  Range classes;
+  Range enums;
+  Range functions;
+  Range typedefs;
+};
+
+// NUL terminated string stored in the map.
+class String {
+public:
+  String() : data_(""), size_(0) {}
+  String(char const *data, uint32 size) : data_(data), size_(size) {}
+
+  char const *c_str() const { return data_; }
+  uint32 size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string str() const { return std::string(data_, size_); }
+
+  bool operator==(char const *other) const {
+    return strlen(other) == size_ && memcmp(data_, other, size_) == 0;
+  }
+  bool operator!=(char const *other) const { return !(*this == other); }
+
+private:
+  char const *data_;
+  uint32 size_;
+};
+
+class PackageFile;
+
+// Read-only view of a .rflm file, either mapped by Open() or attached to
+// memory owned by caller.
+class RFL_EXPORT PackageMap {
+public:
+  PackageMap();
+  ~PackageMap();
+
+  bool Open(std::string const &path);
+  // |data| has to be 8 byte aligned and stay valid until Close().
+  bool Attach(void const *data, size_t size);
+  void Close();
+
+  bool is_open() const { return header_ != nullptr; }
+
+  String name() const;
+  String version() const;
+  int imports_size() const;
+  String imports(int index) const;
+  int libraries_size() const;
+  String libraries(int index) const;
+  int files_size() const;
+  PackageFile files(int index) const;
+
+  // Lookups used by views, out of range references yield empty string and
+  // null record.
+  String GetString(uint32 ref) const;
+  template <class R>
+  R const *GetRecord(Table table, uint32 index) const {
+    if (index >= table_count(table))
+      return nullptr;
+    return reinterpret_cast<R const *>(data_ +
+                                       header_->tables[table].offset) +
+           index;
+  }
+  uint32 table_count(Table table) const {
+    return header_ ? header_->tables[table].count : 0;
+  }
+
+private:
+  bool Validate(size_t size) const;
+
+  char const *data_;
+  Header const *header_;
+  void *mapping_;
+  size_t mapping_size_;
+};
+
+// Base of views, |record_| is null for missing records, whose accessors
+// return empty values.
+template <class R>
+class View {
+public:
+  typedef R Record;
+
+  View() : map_(nullptr), record_(nullptr) {}
+  View(PackageMap const *map, R const *record) : map_(map), record_(record) {}
+
+  bool is_valid() const { return record_ != nullptr; }
+
+protected:
+  String GetString(uint32 ref) const {
+    return map_ ? map_->GetString(ref) : String();
+  }
+  template <class V>
+  V Get(uint32 index) const {
+    if (!map_)
+      return V();
+    return V(map_, map_->GetRecord<typename V::Record>(V::kTable, index));
+  }
+  template <class V>
+  V Child(Range const &range, int index) const {
+    if (index < 0 || static_cast<uint32>(index) >= range.count)
+      return V();
+    return Get<V>(range.first + index);
+  }
+
+  PackageMap const *map_;
+  R const *record_;
+};
+
+class TypeRef {
+public:
+  TypeRef(PackageMap const *map, TypeRefRecord const *record)
+      : map_(map), record_(record) {}
+
+  proto::TypeRef::Kind kind() const {
+    return record_ ? static_cast<proto::TypeRef::Kind>(record_->kind)
+                   : proto::TypeRef::INVALID;
+  }
+  String type_name() const { return GetString(&TypeRefRecord::type_name); }
+  String source_file() const {
+    return GetString(&TypeRefRecord::source_file);
+  }
+  String underlying_type() const {
+    return GetString(&TypeRefRecord::underlying_type);
+  }
+
+private:
+  String GetString(uint32 TypeRefRecord::*member) const {
+    return record_ ? map_->GetString(record_->*member) : String();
+  }
+
+  PackageMap const *map_;
+  TypeRefRecord const *record_;
+};
+
+class TypeQualifier {
+public:
+  explicit TypeQualifier(uint32 flags) : flags_(flags) {}
+
+  bool is_pointer() const { return flags_ & kPointer_Qualifier; }
+  bool is_ref() const { return flags_ & kRef_Qualifier; }
+  bool is_pod() const { return flags_ & kPod_Qualifier; }
+  bool is_array() const { return flags_ & kArray_Qualifier; }
+  bool is_const() const { return flags_ & kConst_Qualifier; }
+  bool is_volatile() const { return flags_ & kVolatile_Qualifier; }
+  bool is_restrict() const { return flags_ & kRestrict_Qualifier; }
+
+private:
+  uint32 flags_;
+};
+
+class AnnotationEntry : public View<AnnotationEntryRecord> {
+public:
+  static Table const kTable = kAnnotationEntries_Table;
+  using View::View;
+
+  String key() const { return record_ ? GetString(record_->key) : String(); }
+  proto::Annotation::Entry::Type type() const {
+    return record_ ? static_cast<proto::Annotation::Entry::Type>(record_->type)
+                   : proto::Annotation::Entry::STRING;
+  }
+  String value() const {
+    return record_ ? GetString(record_->value) : String();
+  }
+  int64 int_value() const { return record_ ? record_->number : 0; }
+  double float_value() const {
+    double value = 0;
+    if (record_)
+      memcpy(&value, &record_->number, sizeof(value));
+    return value;
+  }
+  bool bool_value() const { return record_ && record_->number != 0; }
+};
+
+class Annotation : public View<AnnotationRecord> {
+public:
+  static Table const kTable = kAnnotations_Table;
+  using View::View;
+
+  String kind() const { return record_ ? GetString(record_->kind) : String(); }
+  int entries_size() const { return record_ ? record_->entries.count : 0; }
+  AnnotationEntry entries(int index) const {
+    return record_ ? Child<AnnotationEntry>(record_->entries, index)
+                   : AnnotationEntry();
+  }
+};
+
+class EnumItem : public View<EnumItemRecord> {
+public:
+  static Table const kTable = kEnumItems_Table;
+  using View::View;
+
+  String id() const { return record_ ? GetString(record_->id) : String(); }
+  int64 value() const { return record_ ? record_->value : 0; }
+};
+
+class Enum : public View<EnumRecord> {
+public:
+  static Table const kTable = kEnums_Table;
+  using View::View;
+
+  String name() const { return record_ ? GetString(record_->name) : String(); }
+  String type() const { return record_ ? GetString(record_->type) : String(); }
+  bool has_annotation() const {
+    return record_ && record_->annotation != kNone;
+  }
+  Annotation annotation() const {
+    return record_ ? Get<Annotation>(record_->annotation) : Annotation();
+  }
+  int items_size() const { return record_ ? record_->items.count : 0; }
+  EnumItem items(int index) const {
+    return record_ ? Child<EnumItem>(record_->items, index) : EnumItem();
+  }
+};
+
+// Common accessors of records with name, type and annotation.
+template <class R>
+class TypedView : public View<R> {
+public:
+  using View<R>::View;
+
+  String name() const {
+    return this->record_ ? this->GetString(this->record_->name) : String();
+  }
+  TypeRef type_ref() const {
+    return TypeRef(this->map_,
+                   this->record_ ? &this->record_->type_ref : nullptr);
+  }
+  TypeQualifier type_qualifier() const {
+    return TypeQualifier(this->record_ ? this->record_->qualifiers : 0);
+  }
+  bool has_annotation() const {
+    return this->record_ && this->record_->annotation != kNone;
+  }
+  Annotation annotation() const {
+    return this->record_
+               ? this->template Get<Annotation>(this->record_->annotation)
+               : Annotation();
+  }
+};
+
+class Argument : public TypedView<ArgumentRecord> {
+public:
+  static Table const kTable = kArguments_Table;
+  using TypedView::TypedView;
+};
+
+class Typedef : public TypedView<TypedefRecord> {
+public:
+  static Table const kTable = kTypedefs_Table;
+  using TypedView::TypedView;
+};
+
+class Field : public TypedView<FieldRecord> {
+public:
+  static Table const kTable = kFields_Table;
+  using TypedView::TypedView;
+
+  uint32 offset() const { return record_ ? record_->offset : 0; }
+};
+
+// Common accessors of methods and functions.
+template <class R>
+class CallableView : public View<R> {
+public:
+  using View<R>::View;
+
+  String name() const {
+    return this->record_ ? this->GetString(this->record_->name) : String();
+  }
+  bool has_annotation() const {
+    return this->record_ && this->record_->annotation != kNone;
+  }
+  Annotation annotation() const {
+    return this->record_
+               ? this->template Get<Annotation>(this->record_->annotation)
+               : Annotation();
+  }
+  bool has_return_value() const {
+    return this->record_ && this->record_->return_value != kNone;
+  }
+  Argument return_value() const {
+    return this->record_
+               ? this->template Get<Argument>(this->record_->return_value)
+               : Argument();
+  }
+  int arguments_size() const {
+    return this->record_ ? this->record_->arguments.count : 0;
+  }
+  Argument arguments(int index) const {
+    return this->record_
+               ? this->template Child<Argument>(this->record_->arguments,
+                                                index)
+               : Argument();
+  }
+};
+
+class Method : public CallableView<MethodRecord> {
+public:
+  static Table const kTable = kMethods_Table;
+  using CallableView::CallableView;
+
+  bool static_method() const { return record_ && record_->static_method; }
+};
+
+class Function : public CallableView<FunctionRecord> {
+public:
+  static Table const kTable = kFunctions_Table;
+  using CallableView::CallableView;
+};
+
+class Class : public View<ClassRecord> {
+public:
+  static Table const kTable = kClasses_Table;
+  using View::View;
+
+  String name() const { return record_ ? GetString(record_->name) : String(); }
+  uint32 order() const { return record_ ? record_->order : 0; }
+  uint32 base_class_offset() const {
+    return record_ ? record_->base_class_offset : 0;
+  }
+  bool has_base_class() const { return record_ && record_->has_base_class; }
+  TypeRef base_class() const {
+    return TypeRef(map_, record_ ? &record_->base_class : nullptr);
+  }
+  bool has_annotation() const {
+    return record_ && record_->annotation != kNone;
+  }
+  Annotation annotation() const {
+    return record_ ? Get<Annotation>(record_->annotation) : Annotation();
+  }
+  int fields_size() const { return record_ ? record_->fields.count : 0; }
+  Field fields(int index) const {
+    return record_ ? Child<Field>(record_->fields, index) : Field();
+  }
+  int methods_size() const { return record_ ? record_->methods.count : 0; }
+  Method methods(int index) const {
+    return record_ ? Child<Method>(record_->methods, index) : Method();
+  }
+  int enums_size() const { return record_ ? record_->enums.count : 0; }
+  Enum enums(int index) const {
+    return record_ ? Child<Enum>(record_->enums, index) : Enum();
+  }
+  int classes_size() const { return record_ ? record_->classes.count : 0; }
+  Class classes(int index) const {
+    return record_ ? Child<Class>(record_->classes, index) : Class();
+  }
+  int typedefs_size() const { return record_ ? record_->typedefs.count : 0; }
+  Typedef typedefs(int index) const {
+    return record_ ? Child<Typedef>(record_->typedefs, index) : Typedef();
+  }
+};
+
+class Namespace : public View<NamespaceRecord> {
+public:
+  static Table const kTable = kNamespaces_Table;
+  using View::View;
+
+  String name() const { return record_ ? GetString(record_->name) : String(); }
+  bool has_annotation() const {
+    return record_ && record_->annotation != kNone;
+  }
+  Annotation annotation() const {
+    return record_ ? Get<Annotation>(record_->annotation) : Annotation();
+  }
+  int classes_size() const { return record_ ? record_->classes.count : 0; }
+  Class classes(int index) const {
+    return record_ ? Child<Class>(record_->classes, index) : Class();
+  }
+  int enums_size() const { return record_ ? record_->enums.count : 0; }
+  Enum enums(int index) const {
+    return record_ ? Child<Enum>(record_->enums, index) : Enum();
+  }
+  int namespaces_size() const {
+    return record_ ? record_->namespaces.count : 0;
+  }
+  Namespace namespaces(int index) const {
+    return record_ ? Child<Namespace>(record_->namespaces, index)
+                   : Namespace();
+  }
+  int functions_size() const { return record_ ? record_->functions.count : 0; }
+  Function functions(int index) const {
+    return record_ ? Child<Function>(record_->functions, index) : Function();
+  }
+  int typedefs_size() const { return record_ ? record_->typedefs.count : 0; }
+  Typedef typedefs(int index) const {
+    return record_ ? Child<Typedef>(record_->typedefs, index) : Typedef();
+  }
+};
+
+class PackageFile : public View<FileRecord> {
+public:
+  static Table const kTable = kFiles_Table;
+  using View::View;
+
+  String name() const { return record_ ? GetString(record_->name) : String(); }
+  String source_file() const {
+    return record_ ? GetString(record_->source_file) : String();
+  }
+  bool is_dependency() const { return record_ && record_->is_dependency; }
+  int namespaces_size() const {
+    return record_ ? record_->namespaces.count : 0;
+  }
+  Namespace namespaces(int index) const {
+    return record_ ? Child<Namespace>(record_->namespaces, index)
+                   : Namespace();
+  }
+  int classes_size() const { return record_ ? record_->classes.count : 0; }
+  Class classes(int index) const {
+    return record_ ? Child<Class>(record_->classes, index) : Class();
+  }
+  int enums_size() const { return record_ ? record_->enums.count : 0; }
+  Enum enums(int index) const {
+    return record_ ? Child<Enum>(record_->enums, index) : Enum();
+  }
+  int functions_size() const { return record_ ? record_->functions.count : 0; }
+  Function functions(int index) const {
+    return record_ ? Child<Function>(record_->functions, index) : Function();
+  }
+  int typedefs_size() const { return record_ ? record_->typedefs.count : 0; }
+  Typedef typedefs(int index) const {
+    return record_ ? Child<Typedef>(record_->typedefs, index) : Typedef();
+  }
+};
+
+inline PackageFile PackageMap::files(int index) const {
+  if (index < 0)
+    return PackageFile();
+  return PackageFile(this, GetRecord<FileRecord>(kFiles_Table, index));
+}
+
+// Serializes |pkg| to .rflm form, appending it to |out|.
+RFL_EXPORT void BuildPackageMap(proto::Package const &pkg, std::string *out);
+
+// Writes .rflm file |path| of |pkg|.
+RFL_EXPORT bool WritePackageMap(proto::Package const &pkg,
+                                std::string const &path);
+
+} // namespace package_map
+} // namespace rfl
+
+#endif /* __RFL_PACKAGE_MAP_H__ */
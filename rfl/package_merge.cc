@@ -0,0 +1,377 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/package_merge.h"
+
+#include "rfl/package_io.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "google/protobuf/wire_format_lite_inl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace rfl {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileOutputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::io::ZeroCopyOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+// Field numbers of proto::Package and proto::PackageFile.
+enum {
+  kName_Field = 1,
+  kVersion_Field = 2,
+  kImports_Field = 3,
+  kLibraries_Field = 4,
+  kPackageFiles_Field = 5,
+  kProvidedClasses_Field = 6,
+  kTypes_Field = 7,
+};
+int const kPackageFileName_Field = 1;
+int const kPackageFileTypeBase_Field = 9;
+
+void SetInputLimits(CodedInputStream *in) {
+  in->SetTotalBytesLimit(INT_MAX, -1);
+}
+
+// Reads name and type_base of encoded proto::PackageFile, skipping all
+// other fields.
+bool ReadPackageFileHeader(char const *data,
+                           int size,
+                           std::string *name,
+                           uint32 *type_base) {
+  CodedInputStream in(reinterpret_cast<uint8 const *>(data), size);
+  SetInputLimits(&in);
+  name->clear();
+  *type_base = 0;
+  while (uint32 tag = in.ReadTag()) {
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    WireFormatLite::WireType type = WireFormatLite::GetTagWireType(tag);
+    if (field == kPackageFileName_Field &&
+        type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::ReadString(&in, name))
+        return false;
+    } else if (field == kPackageFileTypeBase_Field &&
+               type == WireFormatLite::WIRETYPE_VARINT) {
+      if (!in.ReadVarint32(type_base))
+        return false;
+    } else if (!WireFormatLite::SkipField(&in, tag, NULL)) {
+      return false;
+    }
+  }
+  return in.ConsumedEntireMessage();
+}
+
+bool ReadFile(std::string const &path, std::string *data) {
+  int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool ret = fstat(fd, &st) == 0;
+  if (ret) {
+    data->resize(st.st_size);
+    size_t done = 0;
+    while (ret && done < data->size()) {
+      int count = read(fd, &(*data)[done], data->size() - done);
+      ret = count > 0;
+      done += ret ? count : 0;
+    }
+  }
+  close(fd);
+  return ret;
+}
+
+}  // namespace
+
+PackageMerger::PackageMerger() : input_type_base_(0), duplicates_(0) {
+}
+
+PackageMerger::~PackageMerger() {
+}
+
+bool PackageMerger::AddFile(std::string const &path, std::string *error) {
+  std::string data;
+  if (!ReadFile(path, &data)) {
+    *error = "failed to read " + path + " : " + strerror(errno);
+    return false;
+  }
+  return AddData(std::move(data), path, error);
+}
+
+bool PackageMerger::AddData(std::string data,
+                            std::string const &source,
+                            std::string *error) {
+  if (data.size() < 4 || data.compare(0, 3, "RFL") != 0) {
+    *error = source + " is not a rfl package";
+    return false;
+  }
+  if (!DecompressPackage(&data)) {
+    *error = source + " has malformed compressed data";
+    return false;
+  }
+  if (data.size() > INT_MAX) {
+    *error = source + " is too large";
+    return false;
+  }
+  // spans of package files point into the buffer
+  buffers_.push_back(std::unique_ptr<std::string>(new std::string()));
+  buffers_.back()->swap(data);
+  char const *buffer = buffers_.back()->data();
+  int size = buffers_.back()->size();
+
+  // type indices of the input are offset by types merged so far
+  input_type_base_ = types_.size();
+
+  int version = static_cast<uint8>(buffer[3]);
+  if (version == kV1_PackageFormat)
+    return AddRecord(buffer + 4, size - 4, source, error);
+  if (version == kV3_PackageFormat) {
+    // only records are merged, the index is written anew
+    uint64 index_offset;
+    uint32 index_size;
+    if (size < 4 + kPackageFooterSize ||
+        !ReadPackageFooter(buffer + size - kPackageFooterSize, &index_offset,
+                           &index_size) ||
+        index_offset < 4 ||
+        index_offset + index_size + kPackageFooterSize !=
+            static_cast<uint64>(size)) {
+      *error = source + " has malformed index";
+      return false;
+    }
+    size = index_offset;
+  } else if (version != kV2_PackageFormat) {
+    *error = source + " has unsupported format version " +
+             std::to_string(version);
+    return false;
+  }
+
+  CodedInputStream in(reinterpret_cast<uint8 const *>(buffer + 4), size - 4);
+  SetInputLimits(&in);
+  while (in.CurrentPosition() < size - 4) {
+    uint32 record_size;
+    if (!in.ReadVarint32(&record_size) ||
+        record_size > static_cast<uint32>(size - 4 - in.CurrentPosition())) {
+      *error = source + " has truncated record";
+      return false;
+    }
+    if (!AddRecord(buffer + 4 + in.CurrentPosition(), record_size, source,
+                   error)) {
+      return false;
+    }
+    in.Skip(record_size);
+  }
+  return true;
+}
+
+bool PackageMerger::AddRecord(char const *data,
+                              int size,
+                              std::string const &source,
+                              std::string *error) {
+  CodedInputStream in(reinterpret_cast<uint8 const *>(data), size);
+  SetInputLimits(&in);
+  std::string value;
+  for (;;) {
+    int start = in.CurrentPosition();
+    uint32 tag = in.ReadTag();
+    if (tag == 0)
+      break;
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    bool is_string = WireFormatLite::GetTagWireType(tag) ==
+                     WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+
+    if (field == kPackageFiles_Field && is_string) {
+      uint32 length;
+      File file;
+      if (!in.ReadVarint32(&length) ||
+          length > static_cast<uint32>(size - in.CurrentPosition()) ||
+          !ReadPackageFileHeader(data + in.CurrentPosition(), length, &value,
+                                 &file.type_base)) {
+        *error = source + " has malformed package file";
+        return false;
+      }
+      file.data = Span(data + in.CurrentPosition(), length);
+      file.rebased = input_type_base_ != 0;
+      file.type_base += input_type_base_;
+      in.Skip(length);
+      if (file_names_.insert(value).second) {
+        files_.push_back(file);
+      } else {
+        ++duplicates_;
+      }
+      continue;
+    }
+
+    if (field == kTypes_Field && is_string) {
+      if (!WireFormatLite::SkipField(&in, tag, NULL)) {
+        *error = source + " is malformed";
+        return false;
+      }
+      types_.push_back(Span(data + start, in.CurrentPosition() - start));
+      continue;
+    }
+
+    if (field < kName_Field || field > kProvidedClasses_Field || !is_string) {
+      // kept as they are, as MergeFrom() keeps unknown fields
+      if (!WireFormatLite::SkipField(&in, tag, NULL)) {
+        *error = source + " is malformed";
+        return false;
+      }
+      unknown_fields_.push_back(
+          Span(data + start, in.CurrentPosition() - start));
+      continue;
+    }
+
+    if (!WireFormatLite::ReadString(&in, &value)) {
+      *error = source + " is malformed";
+      return false;
+    }
+    switch (field) {
+      case kName_Field:
+        if (!name_.empty() && name_ != value) {
+          *error = "Package names do not match " + value + " " + name_ +
+                   " (" + source + ")";
+          return false;
+        }
+        name_ = value;
+        break;
+      case kVersion_Field:
+        if (!version_.empty() && version_ != value) {
+          *error = "Package versions do not match " + value + " " +
+                   version_ + " (" + source + ")";
+          return false;
+        }
+        version_ = value;
+        break;
+      case kImports_Field:
+        AddString(value, &imports_, &seen_imports_);
+        break;
+      case kLibraries_Field:
+        AddString(value, &libraries_, &seen_libraries_);
+        break;
+      case kProvidedClasses_Field:
+        AddString(value, &provided_classes_, &seen_provided_classes_);
+        break;
+    }
+  }
+  if (!in.ConsumedEntireMessage() || in.CurrentPosition() != size) {
+    *error = source + " is malformed";
+    return false;
+  }
+  return true;
+}
+
+void PackageMerger::AddString(std::string const &value,
+                              std::vector<std::string> *values,
+                              std::set<std::string> *seen) {
+  if (seen->insert(value).second)
+    values->push_back(value);
+}
+
+void PackageMerger::WriteTo(ZeroCopyOutputStream *stream) const {
+  std::string header;
+  {
+    StringOutputStream header_stream(&header);
+    CodedOutputStream out(&header_stream);
+    if (!name_.empty())
+      WireFormatLite::WriteString(kName_Field, name_, &out);
+    if (!version_.empty())
+      WireFormatLite::WriteString(kVersion_Field, version_, &out);
+    for (std::string const &import : imports_) {
+      WireFormatLite::WriteString(kImports_Field, import, &out);
+    }
+    for (std::string const &library : libraries_) {
+      WireFormatLite::WriteString(kLibraries_Field, library, &out);
+    }
+  }
+
+  std::string body;
+  {
+    StringOutputStream body_stream(&body);
+    CodedOutputStream out(&body_stream);
+    uint32 tag = WireFormatLite::MakeTag(kPackageFileTypeBase_Field,
+                                         WireFormatLite::WIRETYPE_VARINT);
+    for (File const &file : files_) {
+      int length = file.data.second;
+      if (file.rebased) {
+        // the last value of a field wins when parsing
+        length += CodedOutputStream::VarintSize32(tag) +
+                  CodedOutputStream::VarintSize32(file.type_base);
+      }
+      WireFormatLite::WriteTag(kPackageFiles_Field,
+                               WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                               &out);
+      out.WriteVarint32(length);
+      out.WriteRaw(file.data.first, file.data.second);
+      if (file.rebased) {
+        out.WriteVarint32(tag);
+        out.WriteVarint32(file.type_base);
+      }
+    }
+    for (std::string const &klass : provided_classes_) {
+      WireFormatLite::WriteString(kProvidedClasses_Field, klass, &out);
+    }
+    for (Span const &type : types_) {
+      out.WriteRaw(type.first, type.second);
+    }
+    for (Span const &field : unknown_fields_) {
+      out.WriteRaw(field.first, field.second);
+    }
+  }
+
+  proto::PackageIndex index;
+  CodedOutputStream out(stream);
+  out.WriteRaw("RFL", 3);
+  uint8 version = kV3_PackageFormat;
+  out.WriteRaw(&version, 1);
+  out.WriteVarint32(header.size());
+  index.mutable_header()->set_offset(out.ByteCount());
+  index.mutable_header()->set_size(header.size());
+  out.WriteString(header);
+  out.WriteVarint32(body.size());
+  AddRecordToIndex(body.data(), body.size(), out.ByteCount(), &index);
+  out.WriteString(body);
+  WritePackageIndex(index, out.ByteCount(), &out);
+}
+
+bool PackageMerger::Write(std::string const &path) const {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if (fd < 0)
+    return false;
+  bool ret;
+  {
+    FileOutputStream stream(fd);
+    WriteTo(&stream);
+    ret = stream.Flush();
+  }
+  return close(fd) == 0 && ret;
+}
+
+void PackageMerger::Write(std::string *out) const {
+  // offsets of the index are from the start of |out|
+  out->clear();
+  StringOutputStream stream(out);
+  WriteTo(&stream);
+}
+
+} // namespace rfl
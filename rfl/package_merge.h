@@ -0,0 +1,96 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_PACKAGE_MERGE_H__
+#define __RFL_PACKAGE_MERGE_H__
+
+#include "rfl/rfl_export.h"
+#include "rfl/types.h"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace google {
+namespace protobuf {
+namespace io {
+class ZeroCopyOutputStream;
+} // namespace io
+} // namespace protobuf
+} // namespace google
+
+namespace rfl {
+
+// Merges .rfl files of the same package at the wire level. Header fields
+// (name, version, imports and libraries) are decoded and checked, encoded
+// package files are copied as they are, only their names are read to drop
+// duplicates. Type tables are concatenated, package files of every input
+// but the first get their type_base shifted by appending a new value to
+// their encoding. The result is the same as of proto::Package::MergeFrom()
+// over all inputs, except that package files of the same name and repeated
+// imports, libraries and provided classes are kept once. Inputs of
+// different package name or version are rejected.
+class RFL_EXPORT PackageMerger {
+public:
+  PackageMerger();
+  ~PackageMerger();
+
+  // Adds .rfl file |path| of any format version, |error| tells why it
+  // failed. The merged package is not usable after a failure.
+  bool AddFile(std::string const &path, std::string *error);
+  // Adds .rfl file content read from |source|.
+  bool AddData(std::string data,
+               std::string const &source,
+               std::string *error);
+
+  // Writes merged package as version 3 .rfl, the header record followed by
+  // a single record of package files and types.
+  bool Write(std::string const &path) const;
+  void Write(std::string *out) const;
+
+  std::string const &name() const { return name_; }
+  std::string const &version() const { return version_; }
+  size_t package_files() const { return files_.size(); }
+  unsigned duplicates() const { return duplicates_; }
+
+private:
+  typedef std::pair<char const *, int> Span;
+
+  // Encoded package file, without its tag and length.
+  struct File {
+    Span data;
+    uint32 type_base;
+    bool rebased;
+  };
+
+  bool AddRecord(char const *data, int size, std::string const &source,
+                 std::string *error);
+  void AddString(std::string const &value,
+                 std::vector<std::string> *values,
+                 std::set<std::string> *seen);
+  void WriteTo(google::protobuf::io::ZeroCopyOutputStream *stream) const;
+
+  std::vector<std::unique_ptr<std::string>> buffers_;
+  std::string name_;
+  std::string version_;
+  std::vector<std::string> imports_;
+  std::set<std::string> seen_imports_;
+  std::vector<std::string> libraries_;
+  std::set<std::string> seen_libraries_;
+  std::vector<std::string> provided_classes_;
+  std::set<std::string> seen_provided_classes_;
+  std::vector<File> files_;
+  std::vector<Span> types_;
+  // type_base of package files of the input being added
+  uint32 input_type_base_;
+  std::set<std::string> file_names_;
+  std::vector<Span> unknown_fields_;
+  unsigned duplicates_;
+};
+
+} // namespace rfl
+
+#endif /* __RFL_PACKAGE_MERGE_H__ */
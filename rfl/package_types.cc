@@ -0,0 +1,140 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/package_types.h"
+
+namespace rfl {
+
+namespace {
+
+template <class V>
+void VisitTypedefs(google::protobuf::RepeatedPtrField<proto::Typedef> *items,
+                   V const &visitor) {
+  for (int i = 0; i < items->size(); ++i) {
+    visitor(items->Mutable(i));
+  }
+}
+
+template <class F, class V>
+void VisitCallable(F *callable, V const &visitor) {
+  if (callable->has_return_value())
+    visitor(callable->mutable_return_value());
+  for (int i = 0; i < callable->arguments_size(); ++i) {
+    visitor(callable->mutable_arguments(i));
+  }
+}
+
+template <class V>
+void VisitClass(proto::Class *klass, V const &visitor) {
+  for (int i = 0; i < klass->fields_size(); ++i) {
+    visitor(klass->mutable_fields(i));
+  }
+  for (int i = 0; i < klass->methods_size(); ++i) {
+    VisitCallable(klass->mutable_methods(i), visitor);
+  }
+  VisitTypedefs(klass->mutable_typedefs(), visitor);
+  for (int i = 0; i < klass->classes_size(); ++i) {
+    VisitClass(klass->mutable_classes(i), visitor);
+  }
+}
+
+// Namespaces and package files have the same containers.
+template <class N, class V>
+void VisitNamespace(N *ns, V const &visitor) {
+  for (int i = 0; i < ns->classes_size(); ++i) {
+    VisitClass(ns->mutable_classes(i), visitor);
+  }
+  for (int i = 0; i < ns->functions_size(); ++i) {
+    VisitCallable(ns->mutable_functions(i), visitor);
+  }
+  VisitTypedefs(ns->mutable_typedefs(), visitor);
+}
+
+// Calls |visitor| for every field, argument and typedef of a package file.
+template <class V>
+void VisitPackageFile(proto::PackageFile *file, V const &visitor) {
+  VisitNamespace(file, visitor);
+  std::vector<proto::Namespace *> namespaces;
+  for (int i = 0; i < file->namespaces_size(); ++i) {
+    namespaces.push_back(file->mutable_namespaces(i));
+  }
+  while (!namespaces.empty()) {
+    proto::Namespace *ns = namespaces.back();
+    namespaces.pop_back();
+    VisitNamespace(ns, visitor);
+    for (int i = 0; i < ns->namespaces_size(); ++i) {
+      namespaces.push_back(ns->mutable_namespaces(i));
+    }
+  }
+}
+
+struct Remapper {
+  explicit Remapper(std::vector<uint32> const &indices) : indices_(indices) {}
+
+  template <class T>
+  void operator()(T *item) const {
+    if (item->has_type_index() && item->type_index() < indices_.size())
+      item->set_type_index(indices_[item->type_index()]);
+  }
+
+  std::vector<uint32> const &indices_;
+};
+
+struct Resolver {
+  Resolver(proto::Package const &pkg, proto::PackageFile const &file)
+      : pkg_(pkg), file_(file) {}
+
+  template <class T>
+  void operator()(T *item) const {
+    if (!item->has_type_index())
+      return;
+    item->mutable_type_ref()->CopyFrom(GetTypeRef(pkg_, file_, *item));
+    item->clear_type_index();
+  }
+
+  proto::Package const &pkg_;
+  proto::PackageFile const &file_;
+};
+
+}  // namespace
+
+TypeTable::TypeTable() {
+}
+
+TypeTable::~TypeTable() {
+}
+
+uint32 TypeTable::Add(proto::TypeRef const &type, proto::Package *pkg) {
+  key_.clear();
+  type.AppendToString(&key_);
+  auto it = indices_.find(key_);
+  if (it != indices_.end())
+    return it->second;
+  uint32 index = pkg->types_size();
+  pkg->add_types()->CopyFrom(type);
+  indices_.insert(std::make_pair(key_, index));
+  return index;
+}
+
+void TypeTable::Clear() {
+  indices_.clear();
+}
+
+void RemapTypeIndices(std::vector<uint32> const &indices,
+                      proto::PackageFile *file) {
+  VisitPackageFile(file, Remapper(indices));
+}
+
+void ResolveTypes(proto::Package *pkg) {
+  if (pkg->types_size() == 0)
+    return;
+  for (int i = 0; i < pkg->package_files_size(); ++i) {
+    proto::PackageFile *file = pkg->mutable_package_files(i);
+    VisitPackageFile(file, Resolver(*pkg, *file));
+    file->clear_type_base();
+  }
+  pkg->clear_types();
+}
+
+} // namespace rfl
@@ -0,0 +1,60 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_PACKAGE_TYPES_H__
+#define __RFL_PACKAGE_TYPES_H__
+
+#include "rfl/rfl_export.h"
+#include "rfl/reflected.pb.h"
+#include "rfl/types.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rfl {
+
+// Adds types to the package level table (proto::Package.types), each of
+// them once.
+class RFL_EXPORT TypeTable {
+public:
+  TypeTable();
+  ~TypeTable();
+
+  // Returns index of |type| in types of |pkg|, adding it when not there.
+  // All calls have to use the same package.
+  uint32 Add(proto::TypeRef const &type, proto::Package *pkg);
+  void Clear();
+
+private:
+  std::unordered_map<std::string, uint32> indices_;
+  std::string key_;
+};
+
+// Returns type of field, argument or typedef |item| of |file| in |pkg|,
+// whether it refers to the type table or has type_ref of its own.
+template <class T>
+proto::TypeRef const &GetTypeRef(proto::Package const &pkg,
+                                 proto::PackageFile const &file,
+                                 T const &item) {
+  if (!item.has_type_index())
+    return item.type_ref();
+  uint32 index = file.type_base() + item.type_index();
+  if (index >= static_cast<uint32>(pkg.types_size()))
+    return proto::TypeRef::default_instance();
+  return pkg.types(index);
+}
+
+// Replaces type indices of |file| by |indices|[type_index], |file| is
+// expected to have zero type_base.
+RFL_EXPORT void RemapTypeIndices(std::vector<uint32> const &indices,
+                                 proto::PackageFile *file);
+
+// Moves types of |pkg| back to type_ref of fields, arguments and typedefs,
+// so that readers unaware of the type table can use it.
+RFL_EXPORT void ResolveTypes(proto::Package *pkg);
+
+} // namespace rfl
+
+#endif /* __RFL_PACKAGE_TYPES_H__ */
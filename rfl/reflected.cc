@@ -7,7 +7,10 @@
 #include <algorithm>
 #include <iostream>
 #include <assert.h>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <new>
 #include <sstream>
 
 namespace rfl {
@@ -16,17 +19,37 @@ Annotation::Annotation() {
 }
 
 Annotation::Annotation(Annotation const &x)
-    : kind_(x.kind_), entries_(x.entries_) {
+    : kind_(x.kind_), entries_(x.entries_), typed_values_(x.typed_values_) {
 }
 
 Annotation &Annotation::operator=(Annotation const &x) {
   kind_ = x.kind_;
   entries_ = x.entries_;
+  typed_values_ = x.typed_values_;
   return *this;
 }
 
-void Annotation::AddEntry(char const *key, char const *value) {
-  entries_.insert(std::make_pair(key, value));
+void Annotation::AddEntry(char const *key, char const *value, ValueType type) {
+  if (!entries_.insert(std::make_pair(key, value)).second)
+    return;
+  if (type == kString_Value)
+    return;
+
+  TypedValue typed_value;
+  typed_value.type = type;
+  typed_value.int_value = 0;
+  char *end = nullptr;
+  if (type == kInt_Value) {
+    typed_value.int_value = strtoll(value, &end, 0);
+  } else if (type == kFloat_Value) {
+    typed_value.float_value = strtod(value, &end);
+  } else if (type == kBool_Value) {
+    typed_value.bool_value = strcmp(value, "true") == 0;
+  }
+  // malformed numbers stay strings
+  if (end == value)
+    return;
+  typed_values_[key] = typed_value;
 }
 
 char const *Annotation::GetEntry(char const *key) const {
@@ -36,6 +59,43 @@ char const *Annotation::GetEntry(char const *key) const {
   return nullptr;
 }
 
+Annotation::ValueType Annotation::GetEntryType(char const *key) const {
+  TypedValueMap::const_iterator it = typed_values_.find(key);
+  if (it != typed_values_.end())
+    return it->second.type;
+  return kString_Value;
+}
+
+bool Annotation::GetInt(char const *key, int64 *value) const {
+  TypedValueMap::const_iterator it = typed_values_.find(key);
+  if (it == typed_values_.end() || it->second.type != kInt_Value)
+    return false;
+  *value = it->second.int_value;
+  return true;
+}
+
+bool Annotation::GetFloat(char const *key, double *value) const {
+  TypedValueMap::const_iterator it = typed_values_.find(key);
+  if (it == typed_values_.end())
+    return false;
+  if (it->second.type == kInt_Value) {
+    *value = (double)it->second.int_value;
+    return true;
+  }
+  if (it->second.type != kFloat_Value)
+    return false;
+  *value = it->second.float_value;
+  return true;
+}
+
+bool Annotation::GetBool(char const *key, bool *value) const {
+  TypedValueMap::const_iterator it = typed_values_.find(key);
+  if (it == typed_values_.end() || it->second.type != kBool_Value)
+    return false;
+  *value = it->second.bool_value;
+  return true;
+}
+
 char const *Annotation::kind() const {
   return kind_.c_str();
 }
@@ -80,8 +140,7 @@ TypeQualifier &TypeQualifier::operator=(TypeQualifier const &x) {
 ////////////////////////////////////////////////////////////////////////////////
 
 TypeRef::TypeRef()
-    : kind_(kInvalid_Kind),
-      type_name_() {}
+    : kind_(kInvalid_Kind) {}
 
 TypeRef::~TypeRef() {}
 
@@ -128,7 +187,7 @@ char const *TypeRef::type_name() const {
 	return type_name_.c_str();
 }
 
-void TypeRef::set_type_name(char const *name) {
+void TypeRef::set_type_name(Atom name) {
 	kind_ = kSystem_Kind;
 	type_name_ = name;
 }
@@ -153,9 +212,16 @@ void TypeRef::set_class_type(Class *klass) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+Reflected::Reflected(Atom name) : name_(name) {
+}
+
 Reflected::Reflected(char const *name) : name_(name) {
 }
 
+Reflected::Reflected(Atom name, Annotation const &anno)
+    : name_(name), annotation_(anno) {
+}
+
 Reflected::Reflected(char const *name, Annotation const &anno)
     : name_(name), annotation_(anno) {
 }
@@ -170,7 +236,7 @@ Annotation const &Reflected::annotation() const {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Field::Field(char const *name,
+Field::Field(Atom name,
              TypeRef const &type,
              uint32 offset,
              TypeQualifier const &type_qualifier,
@@ -181,6 +247,13 @@ Field::Field(char const *name,
       type_qualifier_(type_qualifier),
       class_(nullptr) {}
 
+Field::Field(char const *name,
+             TypeRef const &type,
+             uint32 offset,
+             TypeQualifier const &type_qualifier,
+             Annotation const &anno)
+    : Field(Atom(name), type, offset, type_qualifier, anno) {}
+
 void Field::set_parent_class(Class *clazz) {
   class_ = clazz;
 }
@@ -205,7 +278,7 @@ TypeQualifier const &Field::type_qualifier() const {
 
 EnumItem::EnumItem() : value_(-1) {}
 
-EnumItem::EnumItem(long value, char const *id, char const *name)
+EnumItem::EnumItem(long value, Atom id, Atom name)
     : value_(value), id_(id), name_(name) {}
 
 EnumItem::EnumItem(EnumItem const &x)
@@ -230,7 +303,7 @@ char const *EnumItem::id() const {
   return id_.c_str();
 }
 
-void EnumItem::set_id(char const *id) {
+void EnumItem::set_id(Atom id) {
   id_ = id;
 }
 
@@ -238,14 +311,14 @@ char const *EnumItem::name() const {
   return name_.c_str();
 }
 
-void EnumItem::set_name(char const *name) {
+void EnumItem::set_name(Atom name) {
   name_ = name;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Enum::Enum(char const *name,
-           char const *type,
+Enum::Enum(Atom name,
+           Atom type,
            PackageFile *pkg_file,
            Annotation const &anno,
            Namespace *ns,
@@ -259,6 +332,15 @@ Enum::Enum(char const *name,
     pkg_file_->AddEnum(this);
 }
 
+Enum::Enum(char const *name,
+           char const *type,
+           PackageFile *pkg_file,
+           Annotation const &anno,
+           Namespace *ns,
+           Class *parent)
+    : Enum(Atom(name), Atom(type), pkg_file, anno, ns, parent) {
+}
+
 void Enum::AddEnumItem(EnumItem const &item) {
   items_.push_back(item);
 }
@@ -312,9 +394,16 @@ void EnumContainer::RemoveEnum(Enum *e) {
 }
 
 Enum *EnumContainer::FindEnum(char const *enum_name) const {
-  std::string const ename(enum_name);
   for (Enum *e : enums_) {
-    if (ename.compare(e->name()) == 0)
+    if (strcmp(enum_name, e->name()) == 0)
+      return e;
+  }
+  return nullptr;
+}
+
+Enum *EnumContainer::FindEnum(Atom enum_name) const {
+  for (Enum *e : enums_) {
+    if (e->name_atom() == enum_name)
       return e;
   }
   return nullptr;
@@ -332,11 +421,17 @@ Enum *EnumContainer::GetEnumAt(size_t idx) const {
 
 Argument::Argument() {}
 
+Argument::Argument(Atom name,
+                   Kind kind,
+                   Atom type,
+                   Annotation const &anno)
+    : Reflected(name, anno), kind_(kind), type_(type) {}
+
 Argument::Argument(char const *name,
                    Kind kind,
                    char const *type,
                    Annotation const &anno)
-    : Reflected(name, anno), kind_(kind), type_(type) {}
+    : Argument(Atom(name), kind, Atom(type), anno) {}
 
 Argument::Kind Argument::kind() const {
   return kind_;
@@ -350,9 +445,12 @@ char const *Argument::type() const {
 
 Method::Method() {}
 
-Method::Method(char const *name, Annotation const &anno)
+Method::Method(Atom name, Annotation const &anno)
     : Reflected(name, anno) {}
 
+Method::Method(char const *name, Annotation const &anno)
+    : Method(Atom(name), anno) {}
+
 Class *Method::parent_class() const {
   return class_;
 }
@@ -378,7 +476,7 @@ size_t Method::GetNumArguments() const {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Class::Class(char const *name,
+Class::Class(Atom name,
              PackageFile *pkg_file,
              Annotation const &anno,
              Class *super,
@@ -409,6 +507,16 @@ Class::Class(char const *name,
   }
 }
 
+Class::Class(char const *name,
+             PackageFile *pkg_file,
+             Annotation const &anno,
+             Class *super,
+             Field **props,
+             Class **nested
+             )
+    : Class(Atom(name), pkg_file, anno, super, props, nested) {
+}
+
 void Class::AddField(Field *prop) {
   assert(prop != nullptr);
   fields_.push_back(prop);
@@ -432,15 +540,22 @@ Field *Class::GetFieldAt(size_t idx) const {
 }
 
 Field *Class::FindField(char const *name) const {
-  std::string const name_str(name);
   for (Field *prop : fields_) {
-    if (name_str.compare(prop->name()) == 0) {
+    if (strcmp(name, prop->name()) == 0) {
       return prop;
     }
   }
   return nullptr;
 }
 
+Field *Class::FindField(Atom name) const {
+  for (Field *prop : fields_) {
+    if (prop->name_atom() == name)
+      return prop;
+  }
+  return nullptr;
+}
+
 void Class::AddMethod(Method *method) {
   methods_.push_back(method);
 }
@@ -460,9 +575,16 @@ Method *Class::GetMethodAt(size_t idx) const {
 }
 
 Method *Class::FindMethod(char const *name) const {
-  std::string const mname(name);
   for (Method *m : methods_) {
-    if (mname.compare(m->name()) == 0)
+    if (strcmp(name, m->name()) == 0)
+      return m;
+  }
+  return nullptr;
+}
+
+Method *Class::FindMethod(Atom name) const {
+  for (Method *m : methods_) {
+    if (m->name_atom() == name)
       return m;
   }
   return nullptr;
@@ -482,15 +604,22 @@ void Class::RemoveClass(Class *klass) {
 }
 
 Class *Class::FindClass(char const *class_name) const {
-  std::string const class_str(class_name);
   for (Class *klass : classes_) {
-    if (class_str.compare(klass->name()) == 0) {
+    if (strcmp(class_name, klass->name()) == 0) {
       return klass;
     }
   }
   return nullptr;
 }
 
+Class *Class::FindClass(Atom class_name) const {
+  for (Class *klass : classes_) {
+    if (klass->name_atom() == class_name)
+      return klass;
+  }
+  return nullptr;
+}
+
 size_t Class::GetNumClasses() const {
   return classes_.size();
 }
@@ -545,7 +674,7 @@ void Class::set_base_class_offset(uint32 offset) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Namespace::Namespace(char const *name,
+Namespace::Namespace(Atom name,
                      Class **classes,
                      Namespace **namespaces)
     : Reflected(name), parent_namespace_(nullptr) {
@@ -565,6 +694,12 @@ Namespace::Namespace(char const *name,
   }
 }
 
+Namespace::Namespace(char const *name,
+                     Class **classes,
+                     Namespace **namespaces)
+    : Namespace(Atom(name), classes, namespaces) {
+}
+
 void Namespace::AddClass(Class *klass) {
   classes_.push_back(klass);
   klass->set_class_namespace(this);
@@ -579,15 +714,22 @@ void Namespace::RemoveClass(Class *klass) {
 }
 
 Class *Namespace::FindClass(char const *class_name) const {
-  std::string const class_str(class_name);
   for (Class *klass : classes_) {
-    if (class_str.compare(klass->name()) == 0) {
+    if (strcmp(class_name, klass->name()) == 0) {
       return klass;
     }
   }
   return nullptr;
 }
 
+Class *Namespace::FindClass(Atom class_name) const {
+  for (Class *klass : classes_) {
+    if (klass->name_atom() == class_name)
+      return klass;
+  }
+  return nullptr;
+}
+
 size_t Namespace::GetNumClasses() const {
   return classes_.size();
 }
@@ -609,9 +751,16 @@ void Namespace::RemoveNamespace(Namespace *ns) {
 }
 
 Namespace *Namespace::FindNamespace(char const *name) const {
-  std::string const name_str(name);
   for (Namespace *ns : namespaces_) {
-    if (name_str.compare(ns->name()) == 0)
+    if (strcmp(name, ns->name()) == 0)
+      return ns;
+  }
+  return nullptr;
+}
+
+Namespace *Namespace::FindNamespace(Atom name) const {
+  for (Namespace *ns : namespaces_) {
+    if (ns->name_atom() == name)
       return ns;
   }
   return nullptr;
@@ -680,7 +829,7 @@ void PackageFile::set_is_dependecy(bool is) {
 Package::Package(char const *name,
                  char const *version,
                  Namespace **nested)
-    : Namespace(name, nullptr, nested), version_(version) {
+    : Namespace(Atom(name), nullptr, nested), version_(version) {
 }
 
 void Package::AddImport(char const *import) {
@@ -713,7 +862,7 @@ PackageFile *Package::GetOrCreatePackageFile(char const *path) {
     if (path_str.compare(file->source_path()) == 0)
       return file;
   }
-  PackageFile *ret = new PackageFile(path);
+  PackageFile *ret = arena_.NewPackageFile(path);
   AddPackageFile(ret);
   return ret;
 }
@@ -742,6 +891,138 @@ char const *Package::version() const {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+size_t const kArenaBlockSize = 64 * 1024;
+size_t const kArenaAlignment = 16;
+
+size_t AlignArenaSize(size_t size) {
+  return (size + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+}
+
+template <class T>
+void DestroyArenaNode(void *node) {
+  static_cast<T *>(node)->~T();
+}
+
+}  // namespace
+
+struct PackageArena::Block {
+  Block *next;
+};
+
+// Precedes every node, nodes are destroyed in reverse order of creation.
+struct PackageArena::Node {
+  Node *prev;
+  void (*destroy)(void *);
+};
+
+PackageArena::PackageArena()
+    : blocks_(nullptr),
+      ptr_(nullptr),
+      end_(nullptr),
+      last_node_(nullptr),
+      bytes_allocated_(0) {
+}
+
+PackageArena::~PackageArena() {
+  Clear();
+}
+
+void *PackageArena::Allocate(size_t size, void (*destroy)(void *)) {
+  size_t header_size = AlignArenaSize(sizeof(Node));
+  size_t node_size = header_size + AlignArenaSize(size);
+  if (static_cast<size_t>(end_ - ptr_) < node_size) {
+    size_t block_header_size = AlignArenaSize(sizeof(Block));
+    size_t block_size =
+        std::max(kArenaBlockSize, block_header_size + node_size);
+    Block *block = static_cast<Block *>(malloc(block_size));
+    block->next = blocks_;
+    blocks_ = block;
+    ptr_ = reinterpret_cast<char *>(block) + block_header_size;
+    end_ = reinterpret_cast<char *>(block) + block_size;
+  }
+  Node *node = reinterpret_cast<Node *>(ptr_);
+  node->prev = last_node_;
+  node->destroy = destroy;
+  last_node_ = node;
+  ptr_ += node_size;
+  bytes_allocated_ += node_size;
+  return reinterpret_cast<char *>(node) + header_size;
+}
+
+void PackageArena::Clear() {
+  size_t header_size = AlignArenaSize(sizeof(Node));
+  while (last_node_) {
+    Node *node = last_node_;
+    last_node_ = node->prev;
+    node->destroy(reinterpret_cast<char *>(node) + header_size);
+  }
+  while (blocks_) {
+    Block *block = blocks_;
+    blocks_ = block->next;
+    free(block);
+  }
+  ptr_ = end_ = nullptr;
+  bytes_allocated_ = 0;
+}
+
+Namespace *PackageArena::NewNamespace(char const *name) {
+  return new (Allocate(sizeof(Namespace), &DestroyArenaNode<Namespace>))
+      Namespace(atoms_.Intern(name));
+}
+
+PackageFile *PackageArena::NewPackageFile(char const *path) {
+  return new (Allocate(sizeof(PackageFile), &DestroyArenaNode<PackageFile>))
+      PackageFile(path);
+}
+
+Class *PackageArena::NewClass(char const *name,
+                              PackageFile *pkg_file,
+                              Annotation const &anno,
+                              Class *super) {
+  return new (Allocate(sizeof(Class), &DestroyArenaNode<Class>))
+      Class(atoms_.Intern(name), pkg_file, anno, super);
+}
+
+Field *PackageArena::NewField(char const *name,
+                              TypeRef const &typeref,
+                              uint32 offset,
+                              TypeQualifier const &type_qualifier,
+                              Annotation const &anno) {
+  TypeRef type(typeref);
+  if (type.kind() == TypeRef::kSystem_Kind)
+    type.set_type_name(atoms_.Intern(type.type_name()));
+  return new (Allocate(sizeof(Field), &DestroyArenaNode<Field>))
+      Field(atoms_.Intern(name), type, offset, type_qualifier, anno);
+}
+
+Enum *PackageArena::NewEnum(char const *name,
+                            char const *type,
+                            PackageFile *pkg_file,
+                            Annotation const &anno,
+                            Namespace *ns,
+                            Class *parent) {
+  return new (Allocate(sizeof(Enum), &DestroyArenaNode<Enum>))
+      Enum(atoms_.Intern(name), atoms_.Intern(type), pkg_file, anno, ns,
+           parent);
+}
+
+Method *PackageArena::NewMethod(char const *name, Annotation const &anno) {
+  return new (Allocate(sizeof(Method), &DestroyArenaNode<Method>))
+      Method(atoms_.Intern(name), anno);
+}
+
+Argument *PackageArena::NewArgument(char const *name,
+                                    Argument::Kind kind,
+                                    char const *type,
+                                    Annotation const &anno) {
+  return new (Allocate(sizeof(Argument), &DestroyArenaNode<Argument>))
+      Argument(atoms_.Intern(name), kind, atoms_.Intern(type), anno);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 bool PackageManifest::Load(char const *filename) {
   std::ifstream is(filename, std::ios_base::in);
   std::string line;
@@ -5,6 +5,7 @@
 #ifndef __RFL_REFLECTED__
 #define __RFL_REFLECTED__
 
+#include "rfl/atom_table.h"
 #include "rfl/rfl_export.h"
 #include "rfl/types.h"
 
@@ -42,14 +43,31 @@ class RFL_EXPORT Annotation {
 public:
   typedef EntryMap::value_type Entry;
 
+  enum ValueType {
+    kString_Value = 0,
+    kInt_Value,
+    kFloat_Value,
+    kBool_Value,
+    kSymbol_Value,
+  };
+
   Annotation();
 
   Annotation(Annotation const &x);
   Annotation &operator= (Annotation const &x);
 
-  void AddEntry(char const *key, char const *value);
+  void AddEntry(char const *key,
+                char const *value,
+                ValueType type = kString_Value);
   char const *GetEntry(char const *key) const;
 
+  // Typed values, getters return false when entry is missing or of other
+  // type. Integers are readable as floats too.
+  ValueType GetEntryType(char const *key) const;
+  bool GetInt(char const *key, int64 *value) const;
+  bool GetFloat(char const *key, double *value) const;
+  bool GetBool(char const *key, bool *value) const;
+
   template <class T>
   void EnumerateEntries(T &enumerator) const {
     for (Entry const &entry : entries_) {
@@ -61,8 +79,19 @@ public:
   void set_kind(char const *kind);
 
 private:
+  struct TypedValue {
+    ValueType type;
+    union {
+      int64 int_value;
+      double float_value;
+      bool bool_value;
+    };
+  };
+  typedef std::map<std::string, TypedValue> TypedValueMap;
+
   std::string kind_;
   EntryMap entries_;
+  TypedValueMap typed_values_;
 };
 
 template <class T>
@@ -100,7 +129,7 @@ public:
 	Kind kind() const;
 
 	char const *type_name() const;
-	void set_type_name(char const *name);
+	void set_type_name(Atom name);
 
 	Enum *enum_type() const;
 	void set_enum_type(Enum *enm);
@@ -110,7 +139,7 @@ public:
 
 private:
 	Kind kind_;
-	std::string type_name_;
+	Atom type_name_;
 	union {
 		Class *class_type_;
 		Enum *enum_type_;
@@ -158,22 +187,35 @@ private:
   bool is_restrict_ : 1;
 };
 
+// Names are atoms, those of nodes created by PackageArena are from atom
+// table of the package, so that Find*(Atom) methods compare pointers for
+// atoms of that table. Other atoms are compared by their characters.
+// Constructors taking char const * names intern them in the shared table,
+// see Atom(char const *).
 class RFL_EXPORT Reflected {
 public:
   Reflected() {}
+  Reflected(Atom name);
   Reflected(char const *name);
+  Reflected(Atom name, Annotation const &anno);
   Reflected(char const *name, Annotation const &anno);
 
   char const *name() const;
+  Atom name_atom() const { return name_; }
   Annotation const &annotation() const;
 
 private:
-  std::string name_;
+  Atom name_;
   Annotation annotation_;
 };
 
 class RFL_EXPORT Field : public Reflected {
 public:
+  Field(Atom name,
+        TypeRef const &typeref,
+        uint32 offset,
+        TypeQualifier const &type_qualifier,
+        Annotation const &anno);
   Field(char const *name,
         TypeRef const &typeref,
         uint32 offset,
@@ -198,7 +240,7 @@ private:
 class RFL_EXPORT EnumItem {
 public:
 	EnumItem();
-	EnumItem(long value, char const *id, char const *name);
+	EnumItem(long value, Atom id, Atom name);
 	EnumItem(EnumItem const &x);
 	EnumItem &operator=(EnumItem const &x);
 
@@ -206,19 +248,25 @@ public:
   void set_value(long value);
 
   char const *id() const;
-  void set_id(char const *id);
+  void set_id(Atom id);
 
   char const *name() const;
-  void set_name(char const *name);
+  void set_name(Atom name);
 
 private:
   long value_;
-  std::string id_;
-  std::string name_;
+  Atom id_;
+  Atom name_;
 };
 
 class RFL_EXPORT Enum : public Reflected {
 public:
+  Enum(Atom name,
+       Atom type,
+       PackageFile *pkg_file,
+       Annotation const &anno,
+       Namespace *ns,
+       Class *parent);
   Enum(char const *name,
        char const *type,
        PackageFile *pkg_file,
@@ -240,7 +288,7 @@ public:
 private:
   Namespace *namespace_;
   Class *parent_class_;
-  std::string type_;
+  Atom type_;
   std::vector<EnumItem> items_;
   PackageFile *pkg_file_;
 };
@@ -254,6 +302,10 @@ public:
     kInOut_Kind
   };
   Argument();
+  Argument(Atom name,
+           Kind kind,
+           Atom type,
+           Annotation const &anno);
   Argument(char const *name,
            Kind kind,
            char const *type,
@@ -264,12 +316,13 @@ public:
 
 private:
   Kind kind_;
-  std::string type_;
+  Atom type_;
 };
 
 class RFL_EXPORT Method : public Reflected {
 public:
   Method();
+  Method(Atom name, Annotation const &anno);
   Method(char const *name, Annotation const &anno);
 
   Class *parent_class() const;
@@ -293,6 +346,7 @@ public:
   void AddEnum(Enum *e);
   void RemoveEnum(Enum *e);
   Enum *FindEnum(char const *enum_name) const;
+  Enum *FindEnum(Atom enum_name) const;
   size_t GetNumEnums() const;
   Enum *GetEnumAt(size_t idx) const;
 private:
@@ -301,6 +355,13 @@ private:
 
 class RFL_EXPORT Class : public Reflected, public EnumContainer {
 public:
+  Class(Atom name,
+        PackageFile *pkg_file,
+        Annotation const &anno,
+        Class *super = nullptr,
+        Field **props = nullptr,
+        Class **nested = nullptr
+        );
   Class(char const *name,
         PackageFile *pkg_file,
         Annotation const &anno,
@@ -320,16 +381,19 @@ public:
   size_t GetNumFields() const;
   Field *GetFieldAt(size_t idx) const;
   Field *FindField(char const *name) const;
+  Field *FindField(Atom name) const;
 
   void AddMethod(Method *method);
   void RemoveMethod(Method *method);
   size_t GetNumMethods() const;
   Method *GetMethodAt(size_t idx) const;
   Method *FindMethod(char const *name) const;
+  Method *FindMethod(Atom name) const;
 
   void AddClass(Class *klass);
   void RemoveClass(Class *klass);
   Class *FindClass(char const *class_name) const;
+  Class *FindClass(Atom class_name) const;
   size_t GetNumClasses() const;
   Class *GetClassAt(size_t idx) const;
 
@@ -358,6 +422,9 @@ private:
 
 class RFL_EXPORT Namespace : public Reflected, public EnumContainer {
 public:
+  Namespace(Atom name,
+            Class **classes = nullptr,
+            Namespace **namespaces = nullptr);
   Namespace(char const *name,
             Class **classes = nullptr,
             Namespace **namespaces = nullptr);
@@ -365,12 +432,14 @@ public:
   void AddClass(Class *klass);
   void RemoveClass(Class *klass);
   Class *FindClass(char const *class_name) const;
+  Class *FindClass(Atom class_name) const;
   size_t GetNumClasses() const;
   Class *GetClassAt(size_t idx) const;
 
   void AddNamespace(Namespace *ns);
   void RemoveNamespace(Namespace *ns);
   Namespace *FindNamespace(char const *ns) const;
+  Namespace *FindNamespace(Atom ns) const;
   size_t GetNumNamespaces() const;
   Namespace *GetNamespaceAt(size_t idx) const;
 
@@ -404,6 +473,63 @@ private:
   Classes classes_;
 };
 
+// Bump allocator owning nodes of one package. Nodes are placed one after
+// another in the order they are created, which is the order scanners
+// traverse declarations in, so walking the package touches few cache lines.
+// All nodes are destroyed at once with the arena. Names and type names of
+// the nodes are interned in atom table of the arena.
+class RFL_EXPORT PackageArena {
+public:
+  PackageArena();
+  ~PackageArena();
+
+  Namespace *NewNamespace(char const *name);
+  PackageFile *NewPackageFile(char const *path);
+  Class *NewClass(char const *name,
+                  PackageFile *pkg_file,
+                  Annotation const &anno,
+                  Class *super = nullptr);
+  Field *NewField(char const *name,
+                  TypeRef const &typeref,
+                  uint32 offset,
+                  TypeQualifier const &type_qualifier,
+                  Annotation const &anno);
+  Enum *NewEnum(char const *name,
+                char const *type,
+                PackageFile *pkg_file,
+                Annotation const &anno,
+                Namespace *ns,
+                Class *parent);
+  Method *NewMethod(char const *name, Annotation const &anno);
+  Argument *NewArgument(char const *name,
+                        Argument::Kind kind,
+                        char const *type,
+                        Annotation const &anno);
+
+  AtomTable *atoms() { return &atoms_; }
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+private:
+  struct Block;
+  struct Node;
+
+  PackageArena(PackageArena const &);
+  PackageArena &operator=(PackageArena const &);
+
+  // Returns memory for node of |size| bytes, that is destroyed by |destroy|.
+  void *Allocate(size_t size, void (*destroy)(void *));
+  // Destroys all nodes, only when the arena goes away, as vectors of the
+  // package and its nodes still point to them before that.
+  void Clear();
+
+  Block *blocks_;
+  char *ptr_;
+  char *end_;
+  Node *last_node_;
+  size_t bytes_allocated_;
+  AtomTable atoms_;
+};
+
 class RFL_EXPORT Package : public Namespace {
 public:
   Package(char const *name,
@@ -420,6 +546,10 @@ public:
 
   char const *version() const;
 
+  // Nodes created by the arena are owned by the package.
+  PackageArena *arena() { return &arena_; }
+  AtomTable *atoms() { return arena_.atoms(); }
+
   PackageFile *GetOrCreatePackageFile(char const *path);
 
   void AddPackageFile(PackageFile *pkg_file);
@@ -432,6 +562,7 @@ private:
   std::vector<std::string> libs_;
   std::string version_;
   PackageFiles files_;
+  PackageArena arena_;
 };
 
 class RFL_EXPORT PackageManifest {
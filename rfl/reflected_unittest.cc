@@ -3,8 +3,17 @@
 // found in the LICENSE file.
 
 #include "gtest/gtest.h"
+#include "rfl/package_io.h"
+#include "rfl/package_map.h"
+#include "rfl/package_merge.h"
+#include "rfl/package_types.h"
 #include "rfl/reflected.h"
 
+#include <string.h>
+
+#include <string>
+#include <vector>
+
 namespace rfl {
 
 TEST(TestPackageManifest, Basic) {
@@ -16,4 +25,463 @@ TEST(TestPackageManifest, Basic) {
   mf.Save("test.ini");
 }
 
+TEST(TestAnnotation, TypedValues) {
+  Annotation anno;
+  anno.AddEntry("name", "Value");
+  anno.AddEntry("min", "-0x10", Annotation::kInt_Value);
+  anno.AddEntry("step", "0.5", Annotation::kFloat_Value);
+  anno.AddEntry("visible", "false", Annotation::kBool_Value);
+  anno.AddEntry("kind", "number", Annotation::kSymbol_Value);
+
+  EXPECT_EQ(Annotation::kString_Value, anno.GetEntryType("name"));
+  EXPECT_EQ(Annotation::kInt_Value, anno.GetEntryType("min"));
+  EXPECT_EQ(Annotation::kSymbol_Value, anno.GetEntryType("kind"));
+  EXPECT_STREQ("-0x10", anno.GetEntry("min"));
+
+  int64 int_value = 0;
+  EXPECT_TRUE(anno.GetInt("min", &int_value));
+  EXPECT_EQ(-16, int_value);
+  EXPECT_FALSE(anno.GetInt("step", &int_value));
+  EXPECT_FALSE(anno.GetInt("missing", &int_value));
+
+  double float_value = 0;
+  EXPECT_TRUE(anno.GetFloat("step", &float_value));
+  EXPECT_DOUBLE_EQ(0.5, float_value);
+  EXPECT_TRUE(anno.GetFloat("min", &float_value));
+  EXPECT_DOUBLE_EQ(-16.0, float_value);
+
+  bool bool_value = true;
+  EXPECT_TRUE(anno.GetBool("visible", &bool_value));
+  EXPECT_FALSE(bool_value);
+  EXPECT_FALSE(anno.GetBool("name", &bool_value));
+}
+
+TEST(TestAtomTable, Intern) {
+  AtomTable atoms;
+  std::string name = "float";
+  Atom a = atoms.Intern(name.c_str());
+  name[0] = 'x';
+  EXPECT_STREQ("float", a.c_str());
+  EXPECT_EQ(a, atoms.Intern("float"));
+  EXPECT_NE(a, atoms.Intern("double"));
+  EXPECT_EQ(Atom(), atoms.Intern(nullptr));
+  EXPECT_TRUE(atoms.Intern("").empty());
+  EXPECT_EQ(2u, atoms.size());
+
+  Atom found;
+  EXPECT_TRUE(atoms.Find("double", &found));
+  EXPECT_STREQ("double", found.c_str());
+  EXPECT_FALSE(atoms.Find("int", &found));
+
+  // shared table of nodes created outside of an arena, atoms of other
+  // tables are compared by their characters
+  EXPECT_EQ(Atom("float"), Atom(std::string("float").c_str()));
+  EXPECT_EQ(a, Atom("float"));
+  EXPECT_NE(a, Atom("double"));
+  EXPECT_NE(Atom(), Atom("float"));
+
+  std::string long_name(20000, 'a');
+  EXPECT_EQ(long_name, atoms.Intern(long_name.c_str()).c_str());
+}
+
+TEST(TestPackageArena, Nodes) {
+  Package pkg("test", "1.0");
+  PackageArena *arena = pkg.arena();
+  PackageFile *file = pkg.GetOrCreatePackageFile("test.h");
+  Namespace *ns = arena->NewNamespace("test");
+  pkg.AddNamespace(ns);
+  Class *klass = arena->NewClass("Foo", file, Annotation());
+  ns->AddClass(klass);
+  TypeRef type;
+  type.set_type_name(Atom("float"));
+  for (uint32 i = 0; i < 1000; ++i) {
+    klass->AddField(arena->NewField(("field" + std::to_string(i)).c_str(),
+                                    type, i * 4, TypeQualifier(),
+                                    Annotation()));
+  }
+  Method *method = arena->NewMethod("Bar", Annotation());
+  klass->AddMethod(method);
+  method->AddArgument(arena->NewArgument("return", Argument::kReturn_Kind,
+                                         "void", Annotation()));
+  Enum *e = arena->NewEnum("Kind", "int", file, Annotation(), ns, nullptr);
+  ns->AddEnum(e);
+
+  EXPECT_EQ(klass, ns->FindClass(pkg.atoms()->Intern("Foo")));
+  EXPECT_EQ(klass, ns->FindClass("Foo"));
+  EXPECT_EQ(klass, ns->FindClass(Atom("Foo")));
+  EXPECT_EQ(nullptr, ns->FindClass(Atom("Bar")));
+  Class *heap_class = new Class(Atom("Baz"), nullptr, Annotation());
+  ns->AddClass(heap_class);
+  EXPECT_EQ(heap_class, ns->FindClass(pkg.atoms()->Intern("Baz")));
+  ns->RemoveClass(heap_class);
+  delete heap_class;
+  EXPECT_EQ(ns, pkg.FindNamespace(pkg.atoms()->Intern("test")));
+  EXPECT_EQ(e, ns->FindEnum(pkg.atoms()->Intern("Kind")));
+  EXPECT_EQ(method, klass->FindMethod(pkg.atoms()->Intern("Bar")));
+  Field *field = klass->FindField(pkg.atoms()->Intern("field10"));
+  ASSERT_NE(nullptr, field);
+  EXPECT_EQ(40u, field->offset());
+  EXPECT_EQ(pkg.atoms()->Intern("float").c_str(),
+            field->type_ref().type_name());
+  EXPECT_EQ(klass->GetFieldAt(0)->type_ref().type_name(),
+            field->type_ref().type_name());
+
+  EXPECT_EQ(file, pkg.GetOrCreatePackageFile("test.h"));
+  EXPECT_EQ(1u, file->GetNumClasses());
+  EXPECT_EQ(1u, file->GetNumEnums());
+  EXPECT_EQ(ns, klass->class_namespace());
+  EXPECT_EQ(1000u, klass->GetNumFields());
+  EXPECT_STREQ("field999", klass->GetFieldAt(999)->name());
+  EXPECT_EQ(klass, klass->GetFieldAt(0)->parent_class());
+
+  // nodes follow each other in order of creation, blocks are large enough
+  // for the first few
+  uintptr_t prev = reinterpret_cast<uintptr_t>(file);
+  for (void const *node : {static_cast<void const *>(ns),
+                           static_cast<void const *>(klass),
+                           static_cast<void const *>(klass->GetFieldAt(0)),
+                           static_cast<void const *>(klass->GetFieldAt(1))}) {
+    EXPECT_LT(prev, reinterpret_cast<uintptr_t>(node));
+    prev = reinterpret_cast<uintptr_t>(node);
+  }
+  EXPECT_GT(arena->bytes_allocated(), 1000 * sizeof(Field));
+
+  PackageArena other;
+  EXPECT_EQ(0u, other.bytes_allocated());
+  other.NewClass("Bar", other.NewPackageFile("bar.h"), Annotation());
+  EXPECT_GT(other.bytes_allocated(), 0u);
+  EXPECT_STREQ("Baz", other.NewNamespace("Baz")->name());
+}
+
+TEST(TestReflected, CharNames) {
+  // nodes created outside of PackageArena take names of the shared table
+  Namespace ns("test");
+  Class klass("Foo", nullptr, Annotation());
+  ns.AddClass(&klass);
+  Field field("x", TypeRef(), 4, TypeQualifier(), Annotation());
+  klass.AddField(&field);
+  Method method("Bar", Annotation());
+  klass.AddMethod(&method);
+  Argument arg("return", Argument::kReturn_Kind, "void", Annotation());
+  method.AddArgument(&arg);
+  Enum e("Kind", "int", nullptr, Annotation(), &ns, nullptr);
+  ns.AddEnum(&e);
+
+  EXPECT_EQ(Atom("test"), ns.name_atom());
+  EXPECT_EQ(&klass, ns.FindClass(Atom("Foo")));
+  EXPECT_EQ(&field, klass.FindField("x"));
+  EXPECT_EQ(&method, klass.FindMethod(Atom("Bar")));
+  EXPECT_STREQ("void", method.GetArgumentAt(0)->type());
+  EXPECT_EQ(&e, ns.FindEnum("Kind"));
+  EXPECT_STREQ("int", e.type());
+  EXPECT_STREQ("", Reflected(nullptr).name());
+}
+
+TEST(TestPackageMap, RoundTrip) {
+  proto::Package pkg;
+  pkg.set_name("test");
+  pkg.set_version("1.0");
+  pkg.add_imports("base");
+  proto::PackageFile *file = pkg.add_package_files();
+  file->set_name("test.h");
+  proto::Namespace *ns = file->add_namespaces();
+  ns->set_name("test");
+  proto::Namespace *inner = ns->add_namespaces();
+  inner->set_name("inner");
+  proto::Class *klass = ns->add_classes();
+  klass->set_name("Object");
+  klass->add_classes()->set_name("Nested");
+  ns->add_classes()->set_name("test");
+  proto::Field *field = klass->add_fields();
+  field->set_name("value_");
+  field->set_offset(8);
+  field->mutable_type_ref()->set_kind(proto::TypeRef::SYSTEM);
+  field->mutable_type_ref()->set_type_name("float");
+  field->mutable_type_qualifier()->set_is_const(true);
+  proto::Annotation::Entry *entry = field->mutable_annotation()->add_entries();
+  entry->set_key("max");
+  entry->set_type(proto::Annotation::Entry::FLOAT);
+  entry->set_float_value(2.5);
+  proto::Method *method = klass->add_methods();
+  method->set_name("Get");
+  method->mutable_return_value()->mutable_type_ref()->set_type_name("float");
+
+  std::string data;
+  package_map::BuildPackageMap(pkg, &data);
+  // std::string storage is not guaranteed to be 8 byte aligned
+  std::vector<uint64> aligned(data.size() / sizeof(uint64) + 1);
+  memcpy(aligned.data(), data.data(), data.size());
+
+  package_map::PackageMap map;
+  ASSERT_TRUE(map.Attach(aligned.data(), data.size()));
+  EXPECT_TRUE(map.name() == "test");
+  EXPECT_TRUE(map.version() == "1.0");
+  ASSERT_EQ(1, map.imports_size());
+  EXPECT_EQ("base", map.imports(0).str());
+  EXPECT_EQ(0, map.libraries_size());
+  ASSERT_EQ(1, map.files_size());
+
+  package_map::Namespace map_ns = map.files(0).namespaces(0);
+  EXPECT_EQ("test", map_ns.name().str());
+  EXPECT_FALSE(map_ns.has_annotation());
+  ASSERT_EQ(1, map_ns.namespaces_size());
+  EXPECT_EQ("inner", map_ns.namespaces(0).name().str());
+  ASSERT_EQ(2, map_ns.classes_size());
+  EXPECT_EQ("test", map_ns.classes(1).name().str());
+
+  package_map::Class map_class = map_ns.classes(0);
+  EXPECT_EQ("Object", map_class.name().str());
+  ASSERT_EQ(1, map_class.classes_size());
+  EXPECT_EQ("Nested", map_class.classes(0).name().str());
+  ASSERT_EQ(1, map_class.fields_size());
+  package_map::Field map_field = map_class.fields(0);
+  EXPECT_EQ("value_", map_field.name().str());
+  EXPECT_EQ(8u, map_field.offset());
+  EXPECT_EQ(proto::TypeRef::SYSTEM, map_field.type_ref().kind());
+  EXPECT_EQ("float", map_field.type_ref().type_name().str());
+  EXPECT_TRUE(map_field.type_qualifier().is_const());
+  EXPECT_FALSE(map_field.type_qualifier().is_pointer());
+  ASSERT_TRUE(map_field.has_annotation());
+  ASSERT_EQ(1, map_field.annotation().entries_size());
+  EXPECT_EQ("max", map_field.annotation().entries(0).key().str());
+  EXPECT_DOUBLE_EQ(2.5, map_field.annotation().entries(0).float_value());
+  ASSERT_EQ(1, map_class.methods_size());
+  EXPECT_TRUE(map_class.methods(0).has_return_value());
+  EXPECT_EQ(0, map_class.methods(0).arguments_size());
+
+  // out of range accesses yield empty views
+  EXPECT_FALSE(map_class.fields(1).is_valid());
+  EXPECT_TRUE(map_class.fields(1).name().empty());
+
+  // truncated data is rejected
+  package_map::PackageMap truncated;
+  EXPECT_FALSE(truncated.Attach(aligned.data(), data.size() - 8));
+}
+
+TEST(TestPackageMerger, Merge) {
+  proto::Package first;
+  first.set_name("test");
+  first.set_version("1.0");
+  first.add_imports("base");
+  first.add_package_files()->set_name("a.h");
+  first.add_package_files()->set_name("b.h");
+  first.mutable_package_files(1)->add_classes()->set_name("B");
+  first.add_provided_classes("B");
+
+  proto::Package second;
+  second.set_name("test");
+  second.add_imports("base");
+  second.add_libraries("dl");
+  proto::PackageFile *file = second.add_package_files();
+  file->set_source_file("c.cc");
+  file->set_name("c.h");
+  second.add_package_files()->set_name("b.h");
+
+  std::string error;
+  PackageMerger merger;
+  ASSERT_TRUE(merger.AddData("RFL\x01" + first.SerializeAsString(), "first",
+                             &error));
+  // version 2, header record followed by package file record
+  proto::Package header;
+  header.set_name(second.name());
+  std::string data("RFL\x02");
+  std::string record;
+  second.SerializeToString(&record);
+  data += static_cast<char>(header.ByteSize());
+  data += header.SerializeAsString();
+  ASSERT_LT(record.size(), 128u);
+  data += static_cast<char>(record.size());
+  data += record;
+  ASSERT_TRUE(merger.AddData(data, "second", &error)) << error;
+  EXPECT_EQ(3u, merger.package_files());
+  EXPECT_EQ(1u, merger.duplicates());
+
+  std::string merged;
+  merger.Write(&merged);
+  ASSERT_EQ(0, merged.compare(0, 4, "RFL\x03"));
+  ASSERT_TRUE(merger.Write("merged.rfl"));
+  proto::Package pkg;
+  ASSERT_TRUE(ReadPackage("merged.rfl", &pkg));
+  EXPECT_EQ("test", pkg.name());
+  EXPECT_EQ("1.0", pkg.version());
+  ASSERT_EQ(1, pkg.imports_size());
+  ASSERT_EQ(1, pkg.libraries_size());
+  ASSERT_EQ(3, pkg.package_files_size());
+  EXPECT_EQ("a.h", pkg.package_files(0).name());
+  EXPECT_EQ("b.h", pkg.package_files(1).name());
+  EXPECT_EQ("B", pkg.package_files(1).classes(0).name());
+  EXPECT_EQ("c.h", pkg.package_files(2).name());
+  EXPECT_EQ("c.cc", pkg.package_files(2).source_file());
+  ASSERT_EQ(1, pkg.provided_classes_size());
+
+  proto::Package other;
+  other.set_name("other");
+  EXPECT_FALSE(merger.AddData("RFL\x01" + other.SerializeAsString(), "other",
+                              &error));
+  EXPECT_FALSE(merger.AddData("RFL\x01\x0a\x05te", "truncated", &error));
+}
+
+TEST(TestTypeTable, MergeAndResolve) {
+  proto::TypeRef float_type;
+  float_type.set_kind(proto::TypeRef::SYSTEM);
+  float_type.set_type_name("float");
+  proto::TypeRef int_type(float_type);
+  int_type.set_type_name("int");
+
+  proto::Package first;
+  first.set_name("test");
+  TypeTable table;
+  proto::PackageFile *file = first.add_package_files();
+  file->set_name("a.h");
+  proto::Class *klass = file->add_classes();
+  klass->add_fields()->set_type_index(table.Add(float_type, &first));
+  klass->add_fields()->set_type_index(table.Add(int_type, &first));
+  klass->add_fields()->set_type_index(table.Add(float_type, &first));
+  EXPECT_EQ(2, first.types_size());
+  EXPECT_EQ(0u, klass->fields(2).type_index());
+
+  proto::Package second;
+  second.set_name("test");
+  table.Clear();
+  file = second.add_package_files();
+  file->set_name("b.h");
+  proto::Function *function = file->add_namespaces()->add_functions();
+  function->mutable_return_value()->set_type_index(
+      table.Add(int_type, &second));
+
+  std::string error;
+  PackageMerger merger;
+  ASSERT_TRUE(merger.AddData("RFL\x01" + first.SerializeAsString(), "first",
+                             &error));
+  ASSERT_TRUE(merger.AddData("RFL\x01" + second.SerializeAsString(),
+                             "second", &error));
+  ASSERT_TRUE(merger.Write("merged_types.rfl"));
+  proto::Package pkg;
+  ASSERT_TRUE(ReadPackage("merged_types.rfl", &pkg));
+  ASSERT_EQ(3, pkg.types_size());
+  ASSERT_EQ(2, pkg.package_files_size());
+  EXPECT_EQ(0u, pkg.package_files(0).type_base());
+  EXPECT_EQ(2u, pkg.package_files(1).type_base());
+  EXPECT_EQ("b.h", pkg.package_files(1).name());
+  proto::Argument const &ret =
+      pkg.package_files(1).namespaces(0).functions(0).return_value();
+  EXPECT_EQ("int", GetTypeRef(pkg, pkg.package_files(1), ret).type_name());
+
+  ResolveTypes(&pkg);
+  EXPECT_EQ(0, pkg.types_size());
+  proto::Class const &resolved = pkg.package_files(0).classes(0);
+  EXPECT_FALSE(resolved.fields(0).has_type_index());
+  EXPECT_EQ("float", resolved.fields(0).type_ref().type_name());
+  EXPECT_EQ("int", resolved.fields(1).type_ref().type_name());
+  EXPECT_EQ("float", resolved.fields(2).type_ref().type_name());
+  EXPECT_EQ("int", pkg.package_files(1)
+                       .namespaces(0)
+                       .functions(0)
+                       .return_value()
+                       .type_ref()
+                       .type_name());
+}
+
+TEST(TestPackageIndex, LazyLoad) {
+  proto::Package header;
+  header.set_name("test");
+  PackageWriter writer;
+  ASSERT_TRUE(writer.Open("indexed.rfl", header));
+
+  proto::TypeRef type;
+  type.set_kind(proto::TypeRef::SYSTEM);
+  type.set_type_name("float");
+  proto::Package record;
+  record.add_types()->CopyFrom(type);
+  proto::PackageFile *file = record.add_package_files();
+  file->set_name("a.h");
+  file->add_classes()->add_fields()->set_type_index(0);
+  record.add_package_files()->set_name("b.h");
+  ASSERT_TRUE(writer.WriteRecord(record));
+  record.Clear();
+  type.set_type_name("int");
+  record.add_types()->CopyFrom(type);
+  file = record.add_package_files();
+  file->set_name("c.h");
+  file->add_classes()->add_fields()->set_type_index(1);
+  ASSERT_TRUE(writer.WriteRecord(record));
+  ASSERT_TRUE(writer.Close());
+
+  proto::Package pkg;
+  ASSERT_TRUE(ReadPackage("indexed.rfl", &pkg));
+  EXPECT_EQ("test", pkg.name());
+  EXPECT_EQ(3, pkg.package_files_size());
+  EXPECT_EQ(2, pkg.types_size());
+
+  PackageIndexReader reader;
+  ASSERT_TRUE(reader.Open("indexed.rfl"));
+  proto::PackageIndex const &index = reader.index();
+  ASSERT_EQ(3, index.files_size());
+  EXPECT_EQ(2, reader.FindFile("c.h"));
+  EXPECT_EQ(-1, reader.FindFile("d.h"));
+  EXPECT_EQ(pkg.package_files(2).SerializeAsString().size(),
+            index.files(2).size());
+  EXPECT_NE(index.files(0).hash(), index.files(1).hash());
+
+  ASSERT_TRUE(reader.ReadHeader(&header));
+  EXPECT_EQ("test", header.name());
+  proto::Package types;
+  ASSERT_TRUE(reader.ReadTypes(&types));
+  EXPECT_EQ(2, types.types_size());
+  proto::PackageFile loaded;
+  ASSERT_TRUE(reader.ReadPackageFile(2, &loaded));
+  EXPECT_EQ("c.h", loaded.name());
+  EXPECT_EQ("int",
+            GetTypeRef(types, loaded, loaded.classes(0).fields(0)).type_name());
+  EXPECT_FALSE(reader.ReadPackageFile(3, &loaded));
+
+  // the merger writes the same index
+  PackageMerger merger;
+  std::string error;
+  ASSERT_TRUE(merger.AddFile("indexed.rfl", &error)) << error;
+  ASSERT_TRUE(merger.Write("indexed_merged.rfl"));
+  PackageIndexReader merged;
+  ASSERT_TRUE(merged.Open("indexed_merged.rfl"));
+  ASSERT_EQ(3, merged.index().files_size());
+  EXPECT_EQ(index.files(1).hash(), merged.index().files(1).hash());
+  ASSERT_TRUE(merged.ReadTypes(&types));
+  EXPECT_EQ(2, types.types_size());
+
+  EXPECT_FALSE(reader.Open("merged_types.rfl.missing"));
+}
+
+TEST(TestPackageWriter, Compressed) {
+  proto::Package header;
+  header.set_name("test");
+  PackageWriter writer;
+  ASSERT_TRUE(writer.Open("compressed.rfl", header, true));
+  EXPECT_TRUE(writer.is_compressed());
+  proto::Package record;
+  for (int i = 0; i < 100; ++i) {
+    record.add_package_files()->set_name("file" + std::to_string(i) + ".h");
+  }
+  ASSERT_TRUE(writer.WriteRecord(record));
+  ASSERT_TRUE(writer.Close());
+
+  PackageReader reader;
+  ASSERT_TRUE(reader.Open("compressed.rfl"));
+  EXPECT_TRUE(reader.is_compressed());
+  EXPECT_EQ(kV2_PackageFormat, reader.version());
+  reader.Close();
+  proto::Package pkg;
+  ASSERT_TRUE(ReadPackage("compressed.rfl", &pkg));
+  EXPECT_EQ("test", pkg.name());
+  EXPECT_EQ(100, pkg.package_files_size());
+
+  // no index to seek through
+  PackageIndexReader index_reader;
+  EXPECT_FALSE(index_reader.Open("compressed.rfl"));
+
+  PackageMerger merger;
+  std::string error;
+  ASSERT_TRUE(merger.AddFile("compressed.rfl", &error)) << error;
+  EXPECT_EQ(100u, merger.package_files());
+  EXPECT_FALSE(merger.AddData("RFL\x82garbage", "garbage", &error));
+}
+
 } // namespace rfl
@@ -0,0 +1,162 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Builds synthetic package through PackageArena, then compares memory of
+// its interned names to that of a std::string per name, as nodes had
+// before, and looks up every class and field by name and by atom.
+//
+//   atom_table_benchmark [classes] [iterations]
+
+#include "rfl/reflected.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace rfl;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+unsigned const kClassesPerNamespace = 500;
+unsigned const kFieldsPerClass = 10;
+char const *const kTypeNames[] = {"float", "int", "bool", "std::string",
+                                  "std::vector<float>", "bench::Vector3"};
+
+// Bytes of |str| held by std::string, short strings are stored in place.
+size_t StringBytes(char const *str) {
+  std::string probe;
+  size_t size = strlen(str);
+  return sizeof(std::string) + (size > probe.capacity() ? size + 1 : 0);
+}
+
+struct Names {
+  Names() : references(0), string_bytes(0) {}
+
+  void Add(char const *str) {
+    ++references;
+    string_bytes += StringBytes(str);
+  }
+
+  size_t references;
+  size_t string_bytes;
+};
+
+void BuildPackage(unsigned classes, Package *pkg, Names *names) {
+  PackageArena *arena = pkg->arena();
+  PackageFile *file = pkg->GetOrCreatePackageFile("bench/bench.h");
+  Namespace *ns = nullptr;
+  for (unsigned i = 0; i < classes; ++i) {
+    if (i % kClassesPerNamespace == 0) {
+      std::string ns_name =
+          "bench" + std::to_string(i / kClassesPerNamespace);
+      ns = arena->NewNamespace(ns_name.c_str());
+      pkg->AddNamespace(ns);
+      names->Add(ns->name());
+    }
+    std::string class_name = "BenchmarkClass" + std::to_string(i);
+    Class *klass = arena->NewClass(class_name.c_str(), file, Annotation());
+    ns->AddClass(klass);
+    names->Add(klass->name());
+    for (unsigned j = 0; j < kFieldsPerClass; ++j) {
+      TypeRef type;
+      type.set_type_name(pkg->atoms()->Intern(kTypeNames[(i + j) % 6]));
+      std::string field_name = "field_number" + std::to_string(j) + "_";
+      Field *field = arena->NewField(field_name.c_str(), type, j * 4,
+                                     TypeQualifier(), Annotation());
+      klass->AddField(field);
+      names->Add(field->name());
+      names->Add(field->type_ref().type_name());
+    }
+  }
+}
+
+// Looks up all classes and their fields by name or by atom.
+template <class Key>
+size_t LookupAll(Package *pkg, std::vector<Key> const &class_keys,
+                 std::vector<Key> const &field_keys) {
+  size_t found = 0;
+  for (size_t n = 0; n < pkg->GetNumNamespaces(); ++n) {
+    Namespace *ns = pkg->GetNamespaceAt(n);
+    for (size_t c = 0; c < ns->GetNumClasses(); ++c) {
+      Class *klass =
+          ns->FindClass(class_keys[n * kClassesPerNamespace + c]);
+      if (!klass)
+        continue;
+      for (Key const &key : field_keys) {
+        found += klass->FindField(key) != nullptr;
+      }
+    }
+  }
+  return found;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned classes = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 5;
+  if (classes == 0 || iterations == 0) {
+    fprintf(stderr, "Expected non zero classes and iterations\n");
+    return 1;
+  }
+
+  Package pkg("bench", "1.0");
+  Names names;
+  BuildPackage(classes, &pkg, &names);
+  AtomTable *atoms = pkg.atoms();
+  size_t atom_bytes = names.references * sizeof(Atom) + atoms->bytes_used();
+
+  std::vector<std::string> class_names;
+  std::vector<std::string> field_names;
+  for (unsigned i = 0; i < classes; ++i) {
+    class_names.push_back("BenchmarkClass" + std::to_string(i));
+  }
+  for (unsigned j = 0; j < kFieldsPerClass; ++j) {
+    field_names.push_back("field_number" + std::to_string(j) + "_");
+  }
+  std::vector<char const *> class_strs;
+  std::vector<char const *> field_strs;
+  std::vector<Atom> class_atoms;
+  std::vector<Atom> field_atoms;
+  for (std::string const &name : class_names) {
+    class_strs.push_back(name.c_str());
+    class_atoms.push_back(atoms->Intern(name.c_str()));
+  }
+  for (std::string const &name : field_names) {
+    field_strs.push_back(name.c_str());
+    field_atoms.push_back(atoms->Intern(name.c_str()));
+  }
+
+  Milliseconds by_name(0), by_atom(0);
+  size_t name_found = 0, atom_found = 0;
+  for (unsigned i = 0; i < iterations; ++i) {
+    Clock::time_point start = Clock::now();
+    name_found = LookupAll(&pkg, class_strs, field_strs);
+    Clock::time_point middle = Clock::now();
+    atom_found = LookupAll(&pkg, class_atoms, field_atoms);
+    by_name += middle - start;
+    by_atom += Clock::now() - middle;
+  }
+  if (name_found != atom_found) {
+    fprintf(stderr, "Lookups differ\n");
+    return 1;
+  }
+
+  printf("%u classes, %zu names, %zu atoms\n", classes, names.references,
+         atoms->size());
+  printf("  std::string names: %9zu bytes\n", names.string_bytes);
+  printf("  atoms:             %9zu bytes (+ hash set of atoms)\n",
+         atom_bytes);
+  printf("  lookup by name: %8.3f ms, by atom: %8.3f ms, %zu found\n",
+         by_name.count() / iterations, by_atom.count() / iterations,
+         atom_found);
+  return 0;
+}
@@ -0,0 +1,224 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Builds synthetic package with nodes allocated one by one on the heap and
+// by PackageArena, then compares time to build, walk and destroy them. Node
+// allocations are interleaved with others, as they are while scanner walks
+// the AST.
+//
+//   package_arena_benchmark [classes] [walks]
+
+#include "rfl/reflected.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace rfl;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+unsigned const kClassesPerFile = 50;
+unsigned const kFieldsPerClass = 10;
+unsigned const kMethodsPerClass = 4;
+unsigned const kArgumentsPerMethod = 3;
+
+// Creates nodes either on the heap or in the arena.
+class NodeFactory {
+public:
+  explicit NodeFactory(PackageArena *arena) : arena_(arena) {}
+
+  ~NodeFactory() {
+    for (Argument *node : arguments_) delete node;
+    for (Method *node : methods_) delete node;
+    for (Field *node : fields_) delete node;
+    for (Class *node : classes_) delete node;
+    for (Namespace *node : namespaces_) delete node;
+    for (PackageFile *node : files_) delete node;
+  }
+
+  PackageFile *NewPackageFile(char const *path) {
+    Churn();
+    if (arena_)
+      return arena_->NewPackageFile(path);
+    files_.push_back(new PackageFile(path));
+    return files_.back();
+  }
+
+  Namespace *NewNamespace(char const *name) {
+    Churn();
+    if (arena_)
+      return arena_->NewNamespace(name);
+    namespaces_.push_back(new Namespace(Atom(name)));
+    return namespaces_.back();
+  }
+
+  Class *NewClass(char const *name, PackageFile *file) {
+    Churn();
+    if (arena_)
+      return arena_->NewClass(name, file, Annotation());
+    classes_.push_back(new Class(Atom(name), file, Annotation()));
+    return classes_.back();
+  }
+
+  Field *NewField(char const *name, TypeRef const &type, uint32 offset) {
+    Churn();
+    if (arena_)
+      return arena_->NewField(name, type, offset, TypeQualifier(),
+                              Annotation());
+    fields_.push_back(
+        new Field(Atom(name), type, offset, TypeQualifier(), Annotation()));
+    return fields_.back();
+  }
+
+  Method *NewMethod(char const *name) {
+    Churn();
+    if (arena_)
+      return arena_->NewMethod(name, Annotation());
+    methods_.push_back(new Method(Atom(name), Annotation()));
+    return methods_.back();
+  }
+
+  Argument *NewArgument(char const *name) {
+    Churn();
+    if (arena_)
+      return arena_->NewArgument(name, Argument::kInput_Kind, "int",
+                                 Annotation());
+    arguments_.push_back(
+        new Argument(Atom(name), Argument::kInput_Kind, Atom("int"),
+                     Annotation()));
+    return arguments_.back();
+  }
+
+private:
+  // stands for allocations of the AST between scanned declarations
+  void Churn() { churn_.push_back(std::unique_ptr<char[]>(new char[96])); }
+
+  PackageArena *arena_;
+  std::vector<std::unique_ptr<char[]>> churn_;
+  std::vector<PackageFile *> files_;
+  std::vector<Namespace *> namespaces_;
+  std::vector<Class *> classes_;
+  std::vector<Field *> fields_;
+  std::vector<Method *> methods_;
+  std::vector<Argument *> arguments_;
+};
+
+void BuildPackage(unsigned classes, Package *pkg, NodeFactory *factory) {
+  TypeRef type;
+  type.set_type_name(Atom("float"));
+  Namespace *ns = factory->NewNamespace("bench");
+  pkg->AddNamespace(ns);
+  PackageFile *file = nullptr;
+  for (unsigned i = 0; i < classes; ++i) {
+    if (i % kClassesPerFile == 0) {
+      std::string path =
+          "bench/file" + std::to_string(i / kClassesPerFile) + ".h";
+      file = factory->NewPackageFile(path.c_str());
+      pkg->AddPackageFile(file);
+    }
+    Class *klass =
+        factory->NewClass(("Class" + std::to_string(i)).c_str(), file);
+    klass->set_order(i);
+    ns->AddClass(klass);
+    for (unsigned j = 0; j < kFieldsPerClass; ++j) {
+      klass->AddField(factory->NewField(
+          ("field" + std::to_string(j) + "_").c_str(), type, j * 4));
+    }
+    for (unsigned j = 0; j < kMethodsPerClass; ++j) {
+      Method *method =
+          factory->NewMethod(("Method" + std::to_string(j)).c_str());
+      klass->AddMethod(method);
+      for (unsigned k = 0; k < kArgumentsPerMethod; ++k) {
+        method->AddArgument(
+            factory->NewArgument(("arg" + std::to_string(k)).c_str()));
+      }
+    }
+  }
+}
+
+// Touches every node, as generators do.
+uint64 WalkPackage(Package const *pkg) {
+  uint64 sum = 0;
+  for (size_t n = 0; n < pkg->GetNumNamespaces(); ++n) {
+    Namespace const *ns = pkg->GetNamespaceAt(n);
+    for (size_t c = 0; c < ns->GetNumClasses(); ++c) {
+      Class const *klass = ns->GetClassAt(c);
+      sum += klass->order() + strlen(klass->header_file());
+      for (size_t f = 0; f < klass->GetNumFields(); ++f) {
+        Field const *field = klass->GetFieldAt(f);
+        sum += field->offset() + field->type_ref().kind();
+      }
+      for (size_t m = 0; m < klass->GetNumMethods(); ++m) {
+        Method const *method = klass->GetMethodAt(m);
+        for (size_t a = 0; a < method->GetNumArguments(); ++a) {
+          sum += method->GetArgumentAt(a)->kind();
+        }
+      }
+    }
+  }
+  return sum;
+}
+
+struct Result {
+  Milliseconds build;
+  Milliseconds walk;
+  Milliseconds destroy;
+  uint64 sum;
+};
+
+void Run(unsigned classes, unsigned walks, bool use_arena, Result *result) {
+  Clock::time_point start = Clock::now();
+  std::unique_ptr<Package> pkg(new Package("bench", "1.0"));
+  std::unique_ptr<NodeFactory> factory(
+      new NodeFactory(use_arena ? pkg->arena() : nullptr));
+  BuildPackage(classes, pkg.get(), factory.get());
+  Clock::time_point built = Clock::now();
+  result->sum = 0;
+  for (unsigned i = 0; i < walks; ++i) {
+    result->sum += WalkPackage(pkg.get());
+  }
+  Clock::time_point walked = Clock::now();
+  factory.reset();
+  pkg.reset();
+  result->build = built - start;
+  result->walk = walked - built;
+  result->destroy = Clock::now() - walked;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned classes = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned walks = argc > 2 ? atoi(argv[2]) : 20;
+  if (classes == 0 || walks == 0) {
+    fprintf(stderr, "Expected non zero classes and walks\n");
+    return 1;
+  }
+
+  Result heap, arena;
+  Run(classes, walks, false, &heap);
+  Run(classes, walks, true, &arena);
+  if (heap.sum != arena.sum) {
+    fprintf(stderr, "Packages differ\n");
+    return 1;
+  }
+
+  printf("%u classes, %u walks\n", classes, walks);
+  printf("  heap:  build %8.3f ms, walk %8.3f ms, destroy %8.3f ms\n",
+         heap.build.count(), heap.walk.count() / walks,
+         heap.destroy.count());
+  printf("  arena: build %8.3f ms, walk %8.3f ms, destroy %8.3f ms\n",
+         arena.build.count(), arena.walk.count() / walks,
+         arena.destroy.count());
+  return 0;
+}
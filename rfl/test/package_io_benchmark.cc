@@ -0,0 +1,122 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Writes synthetic package record by record as plain and compressed .rfl,
+// then compares file sizes, time to write them and time to load them back.
+//
+//   package_io_benchmark [classes] [iterations]
+
+#include "rfl/package_io.h"
+#include "rfl/test/synthetic_package.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace rfl;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+// Builds one record per package file, as rfl-scan writes them.
+void BuildRecords(unsigned classes, std::vector<proto::Package> *records) {
+  for (unsigned i = 0; i < classes; i += test::kSyntheticClassesPerFile) {
+    records->push_back(proto::Package());
+    test::AddSyntheticPackageFile(
+        i, std::min(test::kSyntheticClassesPerFile, classes - i),
+        &records->back());
+  }
+}
+
+bool WriteRecords(std::vector<proto::Package> const &records,
+                  std::string const &path,
+                  bool compress) {
+  proto::Package header;
+  header.set_name("bench");
+  header.set_version("1.0");
+  PackageWriter writer;
+  if (!writer.Open(path, header, compress))
+    return false;
+  for (proto::Package const &record : records) {
+    if (!writer.WriteRecord(record))
+      return false;
+  }
+  return writer.Close();
+}
+
+struct Result {
+  Result() : write(0), load(0), size(0) {}
+
+  Milliseconds write;
+  Milliseconds load;
+  off_t size;
+};
+
+bool Run(std::vector<proto::Package> const &records,
+         std::string const &path,
+         bool compress,
+         unsigned iterations,
+         Result *result) {
+  for (unsigned i = 0; i < iterations; ++i) {
+    Clock::time_point start = Clock::now();
+    if (!WriteRecords(records, path, compress)) {
+      fprintf(stderr, "Failed to write %s\n", path.c_str());
+      return false;
+    }
+    Clock::time_point written = Clock::now();
+    proto::Package pkg;
+    if (!ReadPackage(path, &pkg) ||
+        pkg.package_files_size() != static_cast<int>(records.size())) {
+      fprintf(stderr, "Failed to read %s\n", path.c_str());
+      return false;
+    }
+    result->write += written - start;
+    result->load += Clock::now() - written;
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+  result->size = st.st_size;
+  unlink(path.c_str());
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned classes = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 5;
+  if (classes == 0 || iterations == 0) {
+    fprintf(stderr, "Expected non zero classes and iterations\n");
+    return 1;
+  }
+
+  std::vector<proto::Package> records;
+  BuildRecords(classes, &records);
+
+  Result plain, compressed;
+  if (!Run(records, "package_io_benchmark.rfl", false, iterations, &plain) ||
+      !Run(records, "package_io_benchmark.rflz", true, iterations,
+           &compressed)) {
+    return 1;
+  }
+
+  printf("%u classes, %u iterations\n", classes, iterations);
+  printf("  plain:      %9lld bytes, write %8.3f ms, load %8.3f ms\n",
+         static_cast<long long>(plain.size), plain.write.count() / iterations,
+         plain.load.count() / iterations);
+  printf("  compressed: %9lld bytes, write %8.3f ms, load %8.3f ms\n",
+         static_cast<long long>(compressed.size),
+         compressed.write.count() / iterations,
+         compressed.load.count() / iterations);
+  return 0;
+}
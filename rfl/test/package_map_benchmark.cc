@@ -0,0 +1,128 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Writes synthetic package as .rfl and .rflm files, then measures time to
+// load each of them and to visit names of all classes and fields.
+//
+//   package_map_benchmark [classes] [iterations]
+
+#include "rfl/package_io.h"
+#include "rfl/package_map.h"
+#include "rfl/test/synthetic_package.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+using namespace rfl;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+bool WriteRfl(proto::Package const &pkg, std::string const &path) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  std::string data("RFL\x01");
+  pkg.AppendToString(&data);
+  bool ret = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ret;
+}
+
+size_t VisitPackage(proto::Package const &pkg) {
+  size_t size = 0;
+  for (int f = 0; f < pkg.package_files_size(); ++f) {
+    proto::Namespace const &ns = pkg.package_files(f).namespaces(0);
+    for (int c = 0; c < ns.classes_size(); ++c) {
+      proto::Class const &klass = ns.classes(c);
+      size += klass.name().size();
+      for (int i = 0; i < klass.fields_size(); ++i) {
+        size += klass.fields(i).name().size();
+      }
+    }
+  }
+  return size;
+}
+
+size_t VisitMap(package_map::PackageMap const &map) {
+  size_t size = 0;
+  for (int f = 0; f < map.files_size(); ++f) {
+    package_map::Namespace ns = map.files(f).namespaces(0);
+    for (int c = 0; c < ns.classes_size(); ++c) {
+      package_map::Class klass = ns.classes(c);
+      size += klass.name().size();
+      for (int i = 0; i < klass.fields_size(); ++i) {
+        size += klass.fields(i).name().size();
+      }
+    }
+  }
+  return size;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned classes = argc > 1 ? atoi(argv[1]) : 10000;
+  unsigned iterations = argc > 2 ? atoi(argv[2]) : 10;
+  if (classes == 0 || iterations == 0) {
+    fprintf(stderr, "Expected non zero classes and iterations\n");
+    return 1;
+  }
+
+  std::string rfl_file = "package_map_benchmark.rfl";
+  std::string map_file = "package_map_benchmark.rflm";
+  {
+    proto::Package pkg;
+    test::BuildSyntheticPackage(classes, &pkg);
+    if (!WriteRfl(pkg, rfl_file) ||
+        !package_map::WritePackageMap(pkg, map_file)) {
+      fprintf(stderr, "Failed to write package files\n");
+      return 1;
+    }
+  }
+
+  std::chrono::duration<double, std::milli> rfl_load(0), rfl_visit(0);
+  std::chrono::duration<double, std::milli> map_load(0), map_visit(0);
+  size_t rfl_size = 0, map_size = 0;
+  for (unsigned i = 0; i < iterations; ++i) {
+    Clock::time_point start = Clock::now();
+    proto::Package pkg;
+    if (!ReadPackage(rfl_file, &pkg)) {
+      fprintf(stderr, "Failed to read %s\n", rfl_file.c_str());
+      return 1;
+    }
+    Clock::time_point loaded = Clock::now();
+    rfl_size = VisitPackage(pkg);
+    rfl_load += loaded - start;
+    rfl_visit += Clock::now() - loaded;
+
+    start = Clock::now();
+    package_map::PackageMap map;
+    if (!map.Open(map_file)) {
+      fprintf(stderr, "Failed to open %s\n", map_file.c_str());
+      return 1;
+    }
+    loaded = Clock::now();
+    map_size = VisitMap(map);
+    map_load += loaded - start;
+    map_visit += Clock::now() - loaded;
+  }
+  unlink(rfl_file.c_str());
+  unlink(map_file.c_str());
+
+  if (rfl_size != map_size) {
+    fprintf(stderr, "Visited names differ\n");
+    return 1;
+  }
+  printf("%u classes, %u iterations\n", classes, iterations);
+  printf("  .rfl:  load %8.3f ms, visit %8.3f ms\n",
+         rfl_load.count() / iterations, rfl_visit.count() / iterations);
+  printf("  .rflm: load %8.3f ms, visit %8.3f ms\n",
+         map_load.count() / iterations, map_visit.count() / iterations);
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "rfl/test/synthetic_package.h"
+
+#include <algorithm>
+#include <string>
+
+namespace rfl {
+namespace test {
+
+void AddSyntheticPackageFile(unsigned first_class,
+                             unsigned count,
+                             proto::Package *pkg) {
+  proto::PackageFile *file = pkg->add_package_files();
+  file->set_name("bench/file" +
+                 std::to_string(first_class / kSyntheticClassesPerFile) +
+                 ".h");
+  proto::Namespace *ns = file->add_namespaces();
+  ns->set_name("bench");
+  for (unsigned i = first_class; i < first_class + count; ++i) {
+    proto::Class *klass = ns->add_classes();
+    klass->set_name("Class" + std::to_string(i));
+    klass->set_order(i);
+    klass->mutable_annotation()->set_kind("class");
+    pkg->add_provided_classes("bench::" + klass->name());
+    for (unsigned j = 0; j < kSyntheticFieldsPerClass; ++j) {
+      proto::Field *field = klass->add_fields();
+      field->set_name("field" + std::to_string(j) + "_");
+      field->set_offset(j * 4);
+      field->mutable_type_ref()->set_kind(proto::TypeRef::SYSTEM);
+      field->mutable_type_ref()->set_type_name("float");
+      field->mutable_type_ref()->set_source_file(file->name());
+      proto::Annotation::Entry *entry =
+          field->mutable_annotation()->add_entries();
+      entry->set_key("name");
+      entry->set_value("Field " + std::to_string(j));
+    }
+  }
+}
+
+void BuildSyntheticPackage(unsigned classes, proto::Package *pkg) {
+  pkg->set_name("bench");
+  pkg->set_version("1.0");
+  for (unsigned i = 0; i < classes; i += kSyntheticClassesPerFile) {
+    AddSyntheticPackageFile(
+        i, std::min(kSyntheticClassesPerFile, classes - i), pkg);
+  }
+}
+
+} // namespace test
+} // namespace rfl
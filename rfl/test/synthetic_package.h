@@ -0,0 +1,31 @@
+// Copyright (c) 2015 Pavel Novy. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef __RFL_TEST_SYNTHETIC_PACKAGE_H__
+#define __RFL_TEST_SYNTHETIC_PACKAGE_H__
+
+#include "rfl/reflected.pb.h"
+
+namespace rfl {
+namespace test {
+
+// Synthetic packages of benchmarks have classes Class<n> in namespace bench,
+// split to package files bench/file<n>.h. Every class has annotated float
+// fields field<n>_.
+unsigned const kSyntheticClassesPerFile = 50;
+unsigned const kSyntheticFieldsPerClass = 10;
+
+// Adds package file of |count| classes numbered from |first_class| to |pkg|
+// and lists them as provided classes.
+void AddSyntheticPackageFile(unsigned first_class,
+                             unsigned count,
+                             proto::Package *pkg);
+
+// Builds package bench of |classes| classes.
+void BuildSyntheticPackage(unsigned classes, proto::Package *pkg);
+
+} // namespace test
+} // namespace rfl
+
+#endif /* __RFL_TEST_SYNTHETIC_PACKAGE_H__ */
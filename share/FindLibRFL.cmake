@@ -5,6 +5,8 @@
 # Find librfl
 # Defines the following variables:
 # LIBRFL_RFLSCAN_EXE
+# LIBRFL_RFLSCAN_CLIENT
+# LIBRFL_RFLMERGE_EXE
 # LIBRFL_FOUND
 # LIBRFL_INCLUDE_DIRS
 # LIBRFL_LIBRARIES
@@ -14,6 +16,16 @@ find_program(LIBRFL_RFLSCAN_EXE
   HINTS ${LIBRFL_PATH}/bin $ENV{LIBRFL_PATH}/bin
   DOC "rfl-scan executable location")
 
+find_program(LIBRFL_RFLSCAN_CLIENT
+  NAMES rfl-scan-client
+  HINTS ${LIBRFL_PATH}/bin $ENV{LIBRFL_PATH}/bin
+  DOC "rfl-scan server client location")
+
+find_program(LIBRFL_RFLMERGE_EXE
+  NAMES rfl-merge
+  HINTS ${LIBRFL_PATH}/bin $ENV{LIBRFL_PATH}/bin
+  DOC "rfl-merge executable location")
+
 find_program(LIBRFL_RFLGEN_PY
   NAMES rfl-gen.py
   HINTS ${LIBRFL_PATH}/bin/rfl-gen $ENV{LIBRFL_PATH}/bin/rfl-gen
@@ -2,6 +2,50 @@
 # Use of this source code is governed by a BSD-style license that can be
 # found in the LICENSE file.
 
+option (RFL_SCAN_PER_FILE "Run rfl-scan separately for every reflected file" OFF)
+option (RFL_SCAN_COMPRESS "Write gzip compressed .rfl files" OFF)
+option (RFL_SCAN_CDB_SNAPSHOT "Keep compile commands of scanned files in binary snapshot" ON)
+
+# number of translation units scanned in parallel by one rfl-scan process
+if (NOT RFL_SCAN_JOBS)
+  include (ProcessorCount)
+  ProcessorCount (RFL_SCAN_JOBS)
+  if (RFL_SCAN_JOBS EQUAL 0)
+    set (RFL_SCAN_JOBS 1)
+  endif ()
+endif ()
+
+# Sets <var> to command running rfl-scan. When RFL_SCAN_SERVER is set,
+# the scan goes through rfl-scan-client to server listening on that socket,
+# falling back to rfl-scan when it's not running.
+macro (rfl_scan_command var)
+  if (RFL_SCAN_SERVER)
+    set (${var} ${LIBRFL_RFLSCAN_CLIENT}
+      --socket ${RFL_SCAN_SERVER}
+      --fallback ${LIBRFL_RFLSCAN_EXE})
+  else ()
+    set (${var} ${LIBRFL_RFLSCAN_EXE})
+  endif ()
+  if (RFL_SCAN_COMPRESS)
+    list (APPEND ${var} -compress)
+  endif ()
+  if (RFL_SCAN_CDB_SNAPSHOT)
+    list (APPEND ${var} -cdb-snapshot ${CMAKE_BINARY_DIR}/rfl-scan.cdb)
+  endif ()
+endmacro ()
+
+# Sets <option_var> to rfl-scan arguments writing depfile of <output> and
+# <args_var> to matching add_custom_command arguments. Only Ninja supports
+# DEPFILE (CMake 3.7+), other generators rescan only when sources change.
+macro (rfl_scan_depfile output option_var args_var)
+  set (${option_var})
+  set (${args_var})
+  if (CMAKE_GENERATOR MATCHES "Ninja" AND NOT CMAKE_VERSION VERSION_LESS 3.7)
+    set (${option_var} -depfile ${output}.d)
+    set (${args_var} DEPFILE ${output}.d)
+  endif ()
+endmacro ()
+
 macro (rfl_scan mid version rfl_files_var)
   set (rfl_args)
   foreach (dep ${${mid}_DEPS})
@@ -12,31 +56,62 @@ macro (rfl_scan mid version rfl_files_var)
     list (APPEND rfl_args "-i${imp}")
   endforeach ()
 
-  set (scans)
-  set (rfl_files)
+  rfl_scan_command(scan_command)
   set (working_dir ${CMAKE_CURRENT_BINARY_DIR})
-  foreach (src ${${mid}_RFL_SOURCES})
-    set (input_file ${CMAKE_CURRENT_SOURCE_DIR}/${src})
-    add_custom_target(${mid}_scan_${src}
-      COMMAND ${LIBRFL_RFLSCAN_EXE}
+  if (RFL_SCAN_PER_FILE)
+    set (scans)
+    set (rfl_files)
+    foreach (src ${${mid}_RFL_SOURCES})
+      set (input_file ${CMAKE_CURRENT_SOURCE_DIR}/${src})
+      add_custom_target(${mid}_scan_${src}
+        COMMAND ${scan_command}
+          -p ${CMAKE_BINARY_DIR}
+          -basedir ${CMAKE_SOURCE_DIR}
+          -output-dir ${working_dir}/${mid}
+          -pkg-name ${mid} -pkg-version=${version}
+          -verbose=${RFL_VERBOSE}
+          -proto
+          -o ${src}.rfl
+          ${input_file}
+        WORKING_DIRECTORY ${working_dir}
+        COMMENT Scanning ${src} to ${working_dir}
+        DEPENDS ${src} ${LIBRFL_RFLSCAN_EXE}
+        BYPRODUCTS ${src}.rfl
+        )
+      list(APPEND scans ${mid}_scan_${src})
+      list(APPEND rfl_files ${src}.rfl)
+    endforeach ()
+
+    add_custom_target(${mid}_rfl_scan DEPENDS ${scans})
+  else ()
+    # single rfl-scan process scans all sources of the module into one
+    # merged package
+    set (input_files)
+    foreach (src ${${mid}_RFL_SOURCES})
+      list (APPEND input_files ${CMAKE_CURRENT_SOURCE_DIR}/${src})
+    endforeach ()
+    set (rfl_files ${working_dir}/${mid}.rfl)
+    rfl_scan_depfile(${working_dir}/${mid}.rfl depfile_option depfile_args)
+    add_custom_command(
+      OUTPUT ${working_dir}/${mid}.rfl
+      COMMAND ${scan_command}
         -p ${CMAKE_BINARY_DIR}
         -basedir ${CMAKE_SOURCE_DIR}
         -output-dir ${working_dir}/${mid}
         -pkg-name ${mid} -pkg-version=${version}
         -verbose=${RFL_VERBOSE}
         -proto
-        -o ${src}.rfl
-        ${input_file}
+        -j ${RFL_SCAN_JOBS}
+        -o ${mid}.rfl
+        ${depfile_option}
+        ${input_files}
       WORKING_DIRECTORY ${working_dir}
-      COMMENT Scanning ${src} to ${working_dir}
-      DEPENDS ${src} ${LIBRFL_RFLSCAN_EXE}
-      BYPRODUCTS ${src}.rfl
+      COMMENT Scanning ${mid} to ${working_dir}
+      DEPENDS ${input_files} ${LIBRFL_RFLSCAN_EXE}
+      ${depfile_args}
       )
-    list(APPEND scans ${mid}_scan_${src})
-    list(APPEND rfl_files ${src}.rfl)
-  endforeach ()
-
-  add_custom_target(${mid}_rfl_scan DEPENDS ${scans})
+    add_custom_target(${mid}_rfl_scan DEPENDS ${working_dir}/${mid}.rfl)
+  endif ()
   set(${rfl_files_var} ${rfl_files} PARENT_SCOPE)
 endmacro ()
 
@@ -44,6 +119,20 @@ macro (rfl_gen mid version)
   unset(rfl_files)
   rfl_scan(${mid} ${version} rfl_files)
 
+  # per file packages are merged by rfl-merge when available, so rfl-gen
+  # reads a single package instead of decoding and merging all of them
+  if (RFL_SCAN_PER_FILE AND LIBRFL_RFLMERGE_EXE)
+    set (merged_rfl ${CMAKE_CURRENT_BINARY_DIR}/${mid}.rfl)
+    add_custom_command(
+      OUTPUT ${merged_rfl}
+      COMMAND ${LIBRFL_RFLMERGE_EXE} -o ${merged_rfl} ${rfl_files}
+      DEPENDS ${mid}_rfl_scan ${rfl_files} ${LIBRFL_RFLMERGE_EXE}
+      WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+      COMMENT Merging ${mid} packages
+      )
+    set (rfl_files ${merged_rfl})
+  endif ()
+
   # used to cut path to be relative to CMAKE_SOURCE_DIR
   string(LENGTH "${CMAKE_SOURCE_DIR}/" src_dir_len)
   set (input_args "-i")
@@ -145,9 +234,11 @@ macro (add_module_rfl mid version)
     list (APPEND ${mid}_INCLUDE_DIRS ${${imp}_RFL_INCLUDE_DIR})
   endforeach ()
 
+  rfl_scan_command(scan_command)
+  rfl_scan_depfile(${working_dir}/${mid}.rfl depfile_option depfile_args)
   add_custom_command (
     DEPENDS ${input_files} ${RFL_GENERATOR}
-    COMMAND ${LIBRFL_RFLSCAN_EXE} -p ${CMAKE_BINARY_DIR}
+    COMMAND ${scan_command} -p ${CMAKE_BINARY_DIR}
       -basedir ${CMAKE_SOURCE_DIR}
       -output-dir ${mid}
       -pkg-name ${mid} -pkg-version=${version}
@@ -156,10 +247,14 @@ macro (add_module_rfl mid version)
       -verbose=${RFL_VERBOSE}
       -proto
       -o ${mid}.rfl
+      ${depfile_option}
       ${input_files}
     WORKING_DIRECTORY ${working_dir}
     COMMENT Generating ${mid} to ${working_dir}
-    OUTPUT ${output_files}
+    # depfile is written for the package, which Ninja expects to be the
+    # first output
+    OUTPUT ${working_dir}/${mid}.rfl ${output_files}
+    ${depfile_args}
     )
 
   # setup <mid>_rfl module
@@ -4,5 +4,6 @@
 
 set (LIBRFL_PATH ${CMAKE_CURRENT_LIST_DIR}/../..)
 set (RFL_VERBOSE 0 CACHE INTERNAL "rfl-scan verbositity level" FORCE)
+set (RFL_SCAN_SERVER "" CACHE STRING "Socket of rfl-scan server (rfl-scan -serve)")
 set (CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH} ${CMAKE_CURRENT_LIST_DIR})
 include (RFLMacros)
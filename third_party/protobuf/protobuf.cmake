@@ -111,6 +111,17 @@ set (protobuf_full_SOURCES
   src/google/protobuf/io/zero_copy_stream_impl.cc
 )
 
+# gzip streams are kept out of protobuf_full, so that only modules using them
+# link zlib.
+set (protobuf_gzip_TARGET_TYPE STATIC)
+set (protobuf_gzip_INCLUDE_DIRS ${protobuf_lite_INCLUDE_DIRS})
+set (protobuf_gzip_SOURCES
+  src/google/protobuf/io/gzip_stream.cc
+  src/google/protobuf/io/gzip_stream.h
+)
+set (protobuf_gzip_DEPS protobuf_full)
+set (protobuf_gzip_LIBS z)
+
 set (protoc_TARGET_TYPE executable)
 set (protoc_SOURCES
   src/google/protobuf/compiler/code_generator.cc